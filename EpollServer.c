@@ -0,0 +1,737 @@
+// Program representing a server that uses a single process and epoll() to
+// serve many clients at once. Every connection is a small state machine
+// that walks through the same protocol steps that runQuery in
+// MultiServer.c does with blocking recv/send calls, so one process can
+// multiplex thousands of sockets against the shared docIndex/docs.
+//
+// v2 sessions keep their connection open between queries. Connections
+// that sit waiting for the client for SESSION_IDLE_TIMEOUT seconds are
+// closed by a sweep that runs about once a second.
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+
+
+#include "QueryProtocol.h"
+#include "MovieSet.h"
+#include "MovieIndex.h"
+#include "DocIdMap.h"
+#include "htll/Hashtable.h"
+#include "QueryProcessor.h"
+#include "FileParser.h"
+#include "FileLoader.h"
+#include "FileCrawler.h"
+
+#define BUFFER_SIZE 1000
+#define SEARCH_RESULT_LENGTH 1500
+#define BACKLOG_SIZE SOMAXCONN
+#define MAX_EVENTS 256
+
+int Cleanup();
+
+DocIdMap docs;
+Index docIndex;
+DocMapping *docMaps;  // Every file mapped into memory, by doc id.
+
+// Global socketfds for easy cleanup.
+int socketfd;
+int epollfd;
+
+// The steps a connection goes through. Each step either waits for the
+// socket to become readable (CONN_READ_*) or writable (CONN_SEND_*).
+enum ConnState {
+  CONN_SEND_ACK,      // Sending the greeting ACK.
+  CONN_READ_QUERY,    // Waiting for the search term.
+  CONN_SEND_COUNT,    // Sending the number of results.
+  CONN_READ_ACK,      // Waiting for the client to ask for the next row.
+  CONN_SEND_ROW,      // Sending one row.
+  CONN_SEND_GOODBYE,  // Sending GOODBYE; the connection closes afterwards.
+  CONN_STREAM,        // Streaming v2 frames without waiting for ACKs.
+  CONN_READ_FRAME,    // Waiting for the next frame of a v2 session.
+  CONN_DONE
+};
+
+// Per-connection state, replacing the globals used by MultiServer.c.
+typedef struct connection {
+  int fd;
+  enum ConnState state;
+  char in_buf[BUFFER_SIZE];
+  char out_buf[SEARCH_RESULT_LENGTH];
+  int out_len;
+  int out_sent;
+  SearchResultIter results;
+  int first_row;  // 1 until the first row has been sent.
+  FrameBuffer *frames;  // Only used by v2 queries.
+  int row_pending;  // 1 if pending_row didn't fit in frames yet.
+  struct rowSlice pending_row;
+  int stream_done;  // 1 once the goodbye or end frame is in frames.
+  int session;  // 1 while a v2 session is open.
+  int in_len;  // Bytes of unread session frames in in_buf.
+  time_t last_active;
+  struct connection *prev;  // Every open connection is on one list,
+  struct connection *next;  // so idle ones can be found and closed.
+} *Connection;
+
+Connection connections = NULL;
+
+void sigint_handler(int sig) {
+  write(0, "Ahhh! SIGINT!\n", 14);
+  Cleanup();
+  exit(0);
+}
+
+// Makes the given socket non-blocking.
+int SetNonBlocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags == -1) {
+    return -1;
+  }
+  return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Queues a message to be written to the connection.
+void QueueMessage(Connection conn, const char *msg, enum ConnState state) {
+  int len = strlen(msg);
+  if (len >= SEARCH_RESULT_LENGTH) {
+    len = SEARCH_RESULT_LENGTH - 1;
+  }
+  memmove(conn->out_buf, msg, len);
+  conn->out_len = len;
+  conn->out_sent = 0;
+  conn->state = state;
+}
+
+// Returns 1 if the connection is waiting to hear from the client.
+int IsReading(Connection conn) {
+  return conn->state == CONN_READ_QUERY || conn->state == CONN_READ_ACK ||
+      conn->state == CONN_READ_FRAME;
+}
+
+// Tells epoll which event the connection is waiting for next.
+void WatchConnection(Connection conn, int op) {
+  struct epoll_event ev;
+  ev.data.ptr = conn;
+  if (IsReading(conn)) {
+    ev.events = EPOLLIN;
+  } else {
+    ev.events = EPOLLOUT;
+  }
+  epoll_ctl(epollfd, op, conn->fd, &ev);
+}
+
+void CloseConnection(Connection conn) {
+  if (conn->prev != NULL) {
+    conn->prev->next = conn->next;
+  } else {
+    connections = conn->next;
+  }
+  if (conn->next != NULL) {
+    conn->next->prev = conn->prev;
+  }
+  epoll_ctl(epollfd, EPOLL_CTL_DEL, conn->fd, NULL);
+  close(conn->fd);
+  if (conn->results != NULL) {
+    DestroySearchResultIter(conn->results);
+  }
+  if (conn->frames != NULL) {
+    free(conn->frames);
+  }
+  free(conn);
+}
+
+// Moves to the next row of the result and gets it.
+// Returns 0 if there was a row, -1 otherwise.
+int NextRow(Connection conn, SearchResult sr) {
+  if (!conn->first_row) {
+    if (SearchResultIterHasMore(conn->results) == 0) {
+      return -1;
+    }
+    if (SearchResultNext(conn->results) < 0) {
+      printf("error retrieving result\n");
+      return -1;
+    }
+  }
+  conn->first_row = 0;
+  SearchResultGet(conn->results, sr);
+  return 0;
+}
+
+// Copies the next row of the result into the output buffer.
+// Returns 0 if there was a row to copy, -1 otherwise.
+int CopyNextRow(Connection conn) {
+  struct searchResult sr;
+  struct rowSlice slice;
+
+  if (NextRow(conn, &sr) != 0) {
+    return -1;
+  }
+  // The client is waiting for a row either way.
+  if (GetRowSlice(docIndex, &sr, docMaps, &slice) != 0 ||
+      slice.length >= SEARCH_RESULT_LENGTH) {
+    slice.data = MISSING_ROW;
+    slice.length = strlen(MISSING_ROW);
+  }
+  memcpy(conn->out_buf, slice.data, slice.length);
+  conn->out_buf[slice.length] = '\0';
+  return 0;
+}
+
+// Packs as many v2 row frames as fit into the connection's frames,
+// followed by the goodbye frame (or the end frame in a session) once the
+// rows run out. Rows are copied into the frames straight from the mapped
+// files.
+void FillFrames(Connection conn) {
+  char end_type = conn->session ? FRAME_END : FRAME_GOODBYE;
+  struct searchResult sr;
+  while (!conn->stream_done) {
+    if (!conn->row_pending) {
+      if (conn->results == NULL || !ResultRowsWanted(conn->results) ||
+          NextRow(conn, &sr) != 0) {
+        if (PutFrame(conn->frames, end_type, "", 0) == 0) {
+          conn->stream_done = 1;
+        }
+        return;
+      }
+      // The client is waiting for as many rows as the count said.
+      if (GetRowSlice(docIndex, &sr, docMaps, &conn->pending_row) != 0) {
+        conn->pending_row.data = MISSING_ROW;
+        conn->pending_row.length = strlen(MISSING_ROW);
+      }
+      conn->row_pending = 1;
+    }
+    if (PutFrame(conn->frames, FRAME_ROW, conn->pending_row.data,
+                 conn->pending_row.length) != 0) {
+      return;
+    }
+    conn->row_pending = 0;
+  }
+}
+
+// Makes sure the connection has an empty FrameBuffer.
+// Returns 0 on success, -1 if it couldn't be allocated.
+int ResetFrames(Connection conn) {
+  if (conn->frames == NULL) {
+    conn->frames = (FrameBuffer*)malloc(sizeof(FrameBuffer));
+    if (conn->frames == NULL) {
+      printf("Couldn't malloc FrameBuffer\n");
+      return -1;
+    }
+  }
+  InitFrameBuffer(conn->frames);
+  return 0;
+}
+
+// Looks up a v2 query and starts streaming its results.
+void StartStream(Connection conn, char *term) {
+  if (ResetFrames(conn) != 0) {
+    conn->state = CONN_DONE;
+    return;
+  }
+  conn->row_pending = 0;
+  conn->stream_done = 0;
+
+  conn->results = FindMovies(docIndex, term);
+  if (conn->results == NULL) {
+    PutFrame(conn->frames, FRAME_COUNT, "0", 1);
+  } else {
+    int count_len = sprintf(conn->out_buf, "%d",
+                            NumResultsInIter(conn->results));
+    PutFrame(conn->frames, FRAME_COUNT, conn->out_buf, count_len);
+    const char *facets = GetFacets(conn->results);
+    if (facets != NULL) {
+      PutFrame(conn->frames, FRAME_FACETS, facets, strlen(facets));
+    }
+    conn->first_row = 1;
+  }
+  FillFrames(conn);
+  conn->state = CONN_STREAM;
+}
+
+// Queues the goodbye frame that ends a v2 session.
+void EndSession(Connection conn) {
+  printf("Closing Client Connection...\n");
+  conn->session = 0;
+  if (ResetFrames(conn) != 0) {
+    conn->state = CONN_DONE;
+    return;
+  }
+  PutFrame(conn->frames, FRAME_GOODBYE, "", 0);
+  conn->row_pending = 0;
+  conn->stream_done = 1;
+  conn->state = CONN_STREAM;
+}
+
+// Starts on the next complete frame of a v2 session, if one has arrived.
+// Returns -1 if the connection should be closed.
+int ProcessFrames(Connection conn) {
+  char term[BUFFER_SIZE];
+  char type;
+
+  if (conn->in_len < FRAME_HEADER_SIZE) {
+    return 0;
+  }
+  int len = ParseFrameHeader(conn->in_buf, &type);
+  if (len < 0 || len >= BUFFER_SIZE - FRAME_HEADER_SIZE) {
+    return -1;
+  }
+  if (conn->in_len < FRAME_HEADER_SIZE + len) {
+    return 0;
+  }
+  memcpy(term, conn->in_buf + FRAME_HEADER_SIZE, len);
+  term[len] = '\0';
+  conn->in_len -= FRAME_HEADER_SIZE + len;
+  memmove(conn->in_buf, conn->in_buf + FRAME_HEADER_SIZE + len,
+          conn->in_len);
+
+  if (type == FRAME_QUERY) {
+    printf("Query Received: %s \n", term);
+    StartStream(conn, term);
+  } else {
+    EndSession(conn);
+  }
+  return 0;
+}
+
+// Opens a v2 session. Anything after SESSION_V2 in in_buf is already
+// session frames.
+int StartSession(Connection conn, int session_len, int bytes_received) {
+  conn->session = 1;
+  conn->in_len = bytes_received - session_len;
+  memmove(conn->in_buf, conn->in_buf + session_len, conn->in_len);
+  conn->state = CONN_READ_FRAME;
+  return ProcessFrames(conn);
+}
+
+// Looks up the query and queues the number of results.
+void StartQuery(Connection conn) {
+  printf("Query Received: %s \n", conn->in_buf);
+  char *term = CheckQueryV2(conn->in_buf);
+  if (term != NULL) {
+    StartStream(conn, term);
+    return;
+  }
+  conn->results = FindMovies(docIndex, conn->in_buf);
+  if (conn->results == NULL) {
+    QueueMessage(conn, "0", CONN_SEND_COUNT);
+    return;
+  }
+  sprintf(conn->out_buf, "%d", NumResultsInIter(conn->results));
+  QueueMessage(conn, conn->out_buf, CONN_SEND_COUNT);
+  conn->first_row = 1;
+}
+
+// Queues the next row of the result to be sent.
+// Returns 0 if there was a row to send, -1 otherwise.
+int QueueNextRow(Connection conn) {
+  if (CopyNextRow(conn) != 0) {
+    return -1;
+  }
+  QueueMessage(conn, conn->out_buf, CONN_SEND_ROW);
+  return 0;
+}
+
+// Moves the connection to the state after a write has finished.
+void FinishWrite(Connection conn) {
+  switch (conn->state) {
+    case CONN_SEND_ACK:
+      conn->state = CONN_READ_QUERY;
+      break;
+    case CONN_SEND_COUNT:
+      if (conn->results == NULL) {
+        QueueMessage(conn, GOODBYE, CONN_SEND_GOODBYE);
+      } else {
+        conn->state = CONN_READ_ACK;
+      }
+      break;
+    case CONN_SEND_ROW:
+      if (SearchResultIterHasMore(conn->results) == 0) {
+        QueueMessage(conn, GOODBYE, CONN_SEND_GOODBYE);
+      } else {
+        conn->state = CONN_READ_ACK;
+      }
+      break;
+    case CONN_SEND_GOODBYE:
+      conn->state = CONN_DONE;
+      break;
+    default:
+      break;
+  }
+}
+
+// Reads whatever the client has sent and moves the connection along.
+// Returns -1 if the connection should be closed.
+int HandleReadable(Connection conn) {
+  if (conn->state == CONN_READ_FRAME) {
+    int bytes_received = recv(conn->fd, conn->in_buf + conn->in_len,
+                              BUFFER_SIZE - conn->in_len, 0);
+    if (bytes_received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return 0;
+    }
+    if (bytes_received <= 0) {
+      return -1;
+    }
+    conn->in_len += bytes_received;
+    return ProcessFrames(conn);
+  }
+
+  int bytes_received = recv(conn->fd, conn->in_buf, BUFFER_SIZE - 1, 0);
+  if (bytes_received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return 0;
+  }
+  if (bytes_received <= 0) {
+    return -1;
+  }
+  conn->in_buf[bytes_received] = '\0';
+
+  if (conn->state == CONN_READ_QUERY) {
+    int session_len = CheckSessionV2(conn->in_buf, bytes_received);
+    if (session_len > 0) {
+      return StartSession(conn, session_len, bytes_received);
+    }
+    StartQuery(conn);
+  } else if (conn->state == CONN_READ_ACK) {
+    if (CheckAck(conn->in_buf) != 0) {
+      return -1;
+    }
+    if (QueueNextRow(conn) != 0) {
+      QueueMessage(conn, GOODBYE, CONN_SEND_GOODBYE);
+    }
+  }
+  return 0;
+}
+
+// Returns 1 if the connection is waiting to write, 0 otherwise.
+int IsSending(Connection conn) {
+  return conn->state == CONN_SEND_ACK || conn->state == CONN_SEND_COUNT ||
+      conn->state == CONN_SEND_ROW || conn->state == CONN_SEND_GOODBYE ||
+      conn->state == CONN_STREAM;
+}
+
+// Writes v2 frames until the socket is full, refilling the frames from
+// the results each time they have all gone out. In a session, moves on
+// to any query the client has already sent once a result is finished.
+// Returns -1 if the connection should be closed.
+int HandleStream(Connection conn) {
+  FrameBuffer *frames = conn->frames;
+  while (1) {
+    while (frames->sent < frames->len) {
+      int sent = send(conn->fd, frames->data + frames->sent,
+                      frames->len - frames->sent, MSG_NOSIGNAL);
+      if (sent == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          return 0;
+        }
+        return -1;
+      }
+      frames->sent += sent;
+    }
+    if (conn->stream_done && !conn->session) {
+      conn->state = CONN_DONE;
+      return 0;
+    }
+    if (conn->stream_done) {
+      if (conn->results != NULL) {
+        DestroySearchResultIter(conn->results);
+        conn->results = NULL;
+      }
+      conn->state = CONN_READ_FRAME;
+      if (ProcessFrames(conn) < 0) {
+        return -1;
+      }
+      if (conn->state != CONN_STREAM) {
+        return 0;
+      }
+      continue;
+    }
+    InitFrameBuffer(frames);
+    FillFrames(conn);
+  }
+}
+
+// Writes pending messages until the socket is full or the connection
+// needs to hear from the client again.
+// Returns -1 if the connection should be closed.
+int HandleWritable(Connection conn) {
+  if (conn->state == CONN_STREAM) {
+    return HandleStream(conn);
+  }
+  while (IsSending(conn)) {
+    while (conn->out_sent < conn->out_len) {
+      int sent = send(conn->fd, conn->out_buf + conn->out_sent,
+                      conn->out_len - conn->out_sent, MSG_NOSIGNAL);
+      if (sent == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          return 0;
+        }
+        return -1;
+      }
+      conn->out_sent += sent;
+    }
+    FinishWrite(conn);
+  }
+  return 0;
+}
+
+// Accepts every pending connection on the listening socket.
+void AcceptConnections(int sock_fd) {
+  struct sockaddr_storage client_addr_storage;
+  socklen_t addr_size;
+
+  while (1) {
+    addr_size = sizeof(client_addr_storage);
+    int client_socketfd = accept(sock_fd,
+                                 (struct sockaddr *)&client_addr_storage,
+                                 &addr_size);
+    if (client_socketfd == -1) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        perror("accept");
+      }
+      return;
+    }
+    SetNonBlocking(client_socketfd);
+    SetNoDelay(client_socketfd);
+
+    Connection conn = (Connection)malloc(sizeof(struct connection));
+    if (conn == NULL) {
+      printf("Couldn't malloc Connection\n");
+      close(client_socketfd);
+      continue;
+    }
+    conn->fd = client_socketfd;
+    conn->results = NULL;
+    conn->first_row = 0;
+    conn->frames = NULL;
+    conn->session = 0;
+    conn->in_len = 0;
+    conn->last_active = time(NULL);
+    QueueMessage(conn, ACK, CONN_SEND_ACK);
+    if (HandleWritable(conn) < 0) {
+      close(client_socketfd);
+      free(conn);
+      continue;
+    }
+    conn->prev = NULL;
+    conn->next = connections;
+    if (connections != NULL) {
+      connections->prev = conn;
+    }
+    connections = conn;
+    WatchConnection(conn, EPOLL_CTL_ADD);
+  }
+}
+
+// Closes every connection that has waited on its client for longer than
+// SESSION_IDLE_TIMEOUT seconds. Sessions get a goodbye frame first.
+void CloseIdleConnections(time_t now) {
+  Connection conn = connections;
+  while (conn != NULL) {
+    Connection next = conn->next;
+    if (IsReading(conn) && now - conn->last_active >= SESSION_IDLE_TIMEOUT) {
+      int result = 0;
+      if (conn->session) {
+        EndSession(conn);
+        result = HandleWritable(conn);
+      } else {
+        conn->state = CONN_DONE;
+      }
+      if (result < 0 || conn->state == CONN_DONE) {
+        CloseConnection(conn);
+      } else {
+        WatchConnection(conn, EPOLL_CTL_MOD);
+      }
+    }
+    conn = next;
+  }
+}
+
+// Handles every connection from one process, using epoll to find out which
+// sockets are ready instead of forking a process per connection.
+int HandleConnections(int sock_fd) {
+  struct epoll_event ev, events[MAX_EVENTS];
+
+  if ((epollfd = epoll_create1(0)) == -1) {
+    perror("epoll_create1");
+    return -1;
+  }
+
+  SetNonBlocking(sock_fd);
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;  // NULL marks the listening socket.
+  if (epoll_ctl(epollfd, EPOLL_CTL_ADD, sock_fd, &ev) == -1) {
+    perror("epoll_ctl");
+    return -1;
+  }
+
+  printf("Waiting for client connections...\n");
+  time_t last_sweep = time(NULL);
+  while (1) {
+    // Wake up at least once a second to look for idle connections.
+    int num_ready = epoll_wait(epollfd, events, MAX_EVENTS, 1000);
+    if (num_ready == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("epoll_wait");
+      return -1;
+    }
+    time_t now = time(NULL);
+
+    for (int i = 0; i < num_ready; i++) {
+      Connection conn = (Connection)events[i].data.ptr;
+      if (conn == NULL) {
+        AcceptConnections(sock_fd);
+        continue;
+      }
+
+      enum ConnState before = conn->state;
+      int result;
+      if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+        result = -1;
+      } else if (events[i].events & EPOLLIN) {
+        result = HandleReadable(conn);
+        // Try to answer right away; most replies fit in the socket buffer.
+        if (result == 0 && IsSending(conn)) {
+          result = HandleWritable(conn);
+        }
+      } else {
+        result = HandleWritable(conn);
+      }
+
+      if (result < 0 || conn->state == CONN_DONE) {
+        CloseConnection(conn);
+        continue;
+      }
+      conn->last_active = now;
+      if (conn->state != before) {
+        WatchConnection(conn, EPOLL_CTL_MOD);
+      }
+    }
+
+    if (now != last_sweep) {
+      CloseIdleConnections(now);
+      last_sweep = now;
+    }
+  }
+}
+
+// Sets up clean up structures and builds the movie index.
+void Setup(char *dir) {
+  struct sigaction kill;
+
+  kill.sa_handler = sigint_handler;
+  kill.sa_flags = 0;  // or SA_RESTART
+  sigemptyset(&kill.sa_mask);
+
+  if (sigaction(SIGINT, &kill, NULL) == -1) {
+    perror("sigaction");
+    exit(1);
+  }
+
+  printf("Crawling directory tree starting at: %s\n", dir);
+  // Create a DocIdMap
+  docs = CreateDocIdMap();
+  CrawlFilesToMap(dir, docs);
+  printf("Crawled %d files.\n", NumElemsInHashtable(docs));
+
+  // Create the index
+  docIndex = CreateIndex();
+  // Keep every movie's fields in dense columns as well.
+  if (AddColumnStore(docIndex) != 0) {
+    printf("Couldn't make a column store; going without one.\n");
+  }
+
+  // Index the files
+  printf("Parsing and indexing files...\n");
+  LoadTheFiles(docs, docIndex);
+  printf("%d entries in the index.\n", NumElemsInHashtable(docIndex->ht));
+
+  // Map every file so rows are served straight from the page cache.
+  docMaps = MapDocFiles(docs, DOC_MAP_POPULATE);
+  if (docMaps == NULL) {
+    exit(1);
+  }
+}
+
+// Cleans up program after it exits.
+int Cleanup() {
+  DestroyOffsetIndex(docIndex);
+  UnmapDocFiles(docs, docMaps);
+  DestroyDocIdMap(docs);
+  close(epollfd);
+  close(socketfd);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  // Get args
+  char *dir_to_crawl, *port_number;
+  if (argc != 3) {
+    printf("Incorrect number of arguments.\n");
+    printf("Please use the following format when running the program: \n");
+    printf("./epollserver <directory_to_index> <port_number>\n");
+    printf("NOW EXITING...\n");
+    return 0;
+  } else {
+    // Set up structs for socket opening, port binding.
+    struct addrinfo hints, *server_info;
+    int check;
+    int yes = 1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    dir_to_crawl = argv[1];
+    port_number = argv[2];
+
+    Setup(dir_to_crawl);
+
+    // Step 1: get address/port info to open
+    if ((check = getaddrinfo(NULL, port_number, &hints, &server_info)) != 0) {
+      fprintf(stderr, "getaddrinfo error: %s\n", gai_strerror(check));
+      exit(1);
+    }
+
+    // Open socket.
+    if ((socketfd = socket(server_info->ai_family, server_info->ai_socktype,
+                           server_info->ai_protocol)) == -1) {
+      perror("Server: socket\n");
+      exit(1);
+    }
+
+    // Clears addresses to avoid "address already in use" error.
+    if (setsockopt(socketfd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)) == -1) {
+      perror("setsockopt");
+      exit(1);
+    }
+
+    // Binding socket to port.
+    if (bind(socketfd, server_info->ai_addr, server_info->ai_addrlen) == -1) {
+      perror("Server bind");
+      exit(1);
+    }
+
+    // Frees address (no longer using).
+    freeaddrinfo(server_info);
+
+    // Listen for connections.
+    listen(socketfd, BACKLOG_SIZE);
+
+    // Handle connections.
+    HandleConnections(socketfd);
+  }
+  Cleanup();
+  return 0;
+}
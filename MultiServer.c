@@ -24,7 +24,9 @@
 #include "htll/Hashtable.h"
 #include "QueryProcessor.h"
 #include "FileParser.h"
+#include "FileLoader.h"
 #include "FileCrawler.h"
+#include "ResultCache.h"
 
 #define BUFFER_SIZE 1000
 
@@ -32,6 +34,8 @@ int Cleanup();
 
 DocIdMap docs;
 Index docIndex;
+DocMapping *docMaps;  // Every file mapped into memory, by doc id.
+ResultCache resultCache;  // Shared by every child, or NULL.
 
 // Global variables to be shared across methods.
 // Socketfds are global for easy cleanup.
@@ -64,11 +68,37 @@ void sigint_handler(int sig) {
   exit(0);
 }
 
+// Finds the movies for a query, asking the shared cache first, so a
+// query any child has run before isn't run again.
+SearchResultIter FindMoviesCached(char *query) {
+  SearchResultIter results;
+
+  if (resultCache == NULL) {
+    return FindMovies(docIndex, query);
+  }
+  if (LookupResults(resultCache, query, &results)) {
+    return results;
+  }
+  results = FindMovies(docIndex, query);
+  CacheResults(resultCache, query, results);
+  return results;
+}
+
+// Sends the row of a v1 result, or MISSING_ROW if it can't be found.
+void SendRow(int client_socketfd, SearchResult sr) {
+  struct rowSlice slice;
+  if (GetRowSlice(docIndex, sr, docMaps, &slice) != 0) {
+    slice.data = MISSING_ROW;
+    slice.length = strlen(MISSING_ROW);
+  }
+  send(client_socketfd, slice.data, slice.length, 0);
+}
+
 // Function used to handle a single connection and query from the client.
 // Sends a Goodbye message and closes the connection after this query is finished.
 void runQuery(int client_socketfd, char *buffer) {
   int result, bytes_received;
-  SearchResultIter results = FindMovies(docIndex, buffer);
+  SearchResultIter results = FindMoviesCached(buffer);
 
   if (results == NULL) {
     // If no results, sends Goodbye message and ends the connection.
@@ -96,8 +126,7 @@ void runQuery(int client_socketfd, char *buffer) {
       return;
     }
     SearchResultGet(results, sr);
-    CopyRowFromFile(sr, docs, movieSearchResult);
-    send(client_socketfd, movieSearchResult, strlen(movieSearchResult), 0);
+    SendRow(client_socketfd, sr);
 
     while (SearchResultIterHasMore(results) != 0) {
       // sleep(1); // Sleep used for testing multiprocessessing.
@@ -112,8 +141,7 @@ void runQuery(int client_socketfd, char *buffer) {
         return;
       }
       SearchResultGet(results, sr);
-      CopyRowFromFile(sr, docs, movieSearchResult);
-      send(client_socketfd, movieSearchResult, strlen(movieSearchResult), 0);
+      SendRow(client_socketfd, sr);
     }
 
     // Sends Goodbye message and ends the connection.
@@ -124,6 +152,86 @@ void runQuery(int client_socketfd, char *buffer) {
   }
 }
 
+// Function used to handle a single v2 query. Streams the count, the
+// facets if asked for, every row and an end_type frame without waiting
+// for the client to ACK each row.
+// Rows are copied into the frames straight from the mapped files.
+void runQueryV2(int client_socketfd, char *term, char end_type) {
+  FrameBuffer frames;
+  struct searchResult sr;
+  struct rowSlice slice;
+  int count_len;
+
+  InitFrameBuffer(&frames);
+  SearchResultIter results = FindMoviesCached(term);
+
+  if (results == NULL) {
+    printf("No results for this term. Please try another.\n");
+    BufferFrame(client_socketfd, &frames, FRAME_COUNT, "0", 1);
+  } else {
+    count_len = sprintf(movieSearchResult, "%d", NumResultsInIter(results));
+    printf("Number of Results: %s\n", movieSearchResult);
+    BufferFrame(client_socketfd, &frames, FRAME_COUNT, movieSearchResult,
+                count_len);
+    const char *facets = GetFacets(results);
+    if (facets != NULL) {
+      BufferFrame(client_socketfd, &frames, FRAME_FACETS, facets,
+                  strlen(facets));
+    }
+
+    while (ResultRowsWanted(results)) {
+      SearchResultGet(results, &sr);
+      // The client is waiting for as many rows as the count said.
+      if (GetRowSlice(docIndex, &sr, docMaps, &slice) != 0) {
+        slice.data = MISSING_ROW;
+        slice.length = strlen(MISSING_ROW);
+      }
+      if (BufferFrame(client_socketfd, &frames, FRAME_ROW, slice.data,
+                      slice.length) != 0) {
+        break;
+      }
+      if (SearchResultIterHasMore(results) == 0 ||
+          SearchResultNext(results) < 0) {
+        break;
+      }
+    }
+    DestroySearchResultIter(results);
+  }
+
+  BufferFrame(client_socketfd, &frames, end_type, "", 0);
+  SendFrames(client_socketfd, &frames);
+}
+
+// Function used to handle a v2 session. Answers query frames one after
+// another on the same connection until the client says goodbye or stays
+// idle for too long. pending holds the bytes that arrived together with
+// the session request.
+void runSessionV2(int client_socketfd, char *pending, int pending_len) {
+  FrameReader *reader = (FrameReader*)malloc(sizeof(FrameReader));
+  FrameBuffer frames;
+  char type;
+
+  if (reader == NULL) {
+    printf("Couldn't malloc FrameReader\n");
+    return;
+  }
+  InitFrameReader(reader, client_socketfd);
+  PreloadFrameReader(reader, pending, pending_len);
+  SetSessionTimeout(client_socketfd);
+
+  while (ReadFrame(reader, &type, buffer, BUFFER_SIZE) >= 0 &&
+         type == FRAME_QUERY) {
+    printf("Query Received: %s \n", buffer);
+    runQueryV2(client_socketfd, buffer, FRAME_END);
+  }
+
+  printf("Closing Client Connection...\n");
+  InitFrameBuffer(&frames);
+  BufferFrame(client_socketfd, &frames, FRAME_GOODBYE, "", 0);
+  SendFrames(client_socketfd, &frames);
+  free(reader);
+}
+
 // Handles multiple connections by forking everytime a connection is made.
 // Single parent process that loops through and starts connections while child
 // processes finish the query. Child processes then exit upon query completion.
@@ -133,16 +241,35 @@ int HandleConnections(int sock_fd) {
     printf("Waiting for client connection...\n");
     client_socketfd = accept(sock_fd, (struct sockaddr *)&client_addr_storage, &addr_size);
     printf("Client connected. Forking Process...\n");
+    SetNoDelay(client_socketfd);
     if (!fork()) {
       close(socketfd);
       SendAck(client_socketfd);
-      bytes_received = recv(client_socketfd, buffer, BUFFER_SIZE, 0);
+      bytes_received = recv(client_socketfd, buffer, BUFFER_SIZE - 1, 0);
+      if (bytes_received <= 0) {
+        close(client_socketfd);
+        exit(0);
+      }
       buffer[bytes_received] = '\0';
-      printf("Query Received: %s \n", buffer);
-      runQuery(client_socketfd, buffer);
+      int session_len = CheckSessionV2(buffer, bytes_received);
+      char *term = CheckQueryV2(buffer);
+      if (session_len > 0) {
+        runSessionV2(client_socketfd, buffer + session_len,
+                     bytes_received - session_len);
+      } else if (term != NULL) {
+        printf("Query Received: %s \n", buffer);
+        runQueryV2(client_socketfd, term, FRAME_GOODBYE);
+        printf("Closing Client Connection...\n");
+      } else {
+        printf("Query Received: %s \n", buffer);
+        runQuery(client_socketfd, buffer);
+      }
       close(client_socketfd);
       exit(0);
     }
+    // The child has its own copy; keeping this one open would stop the
+    // client from ever seeing the connection close.
+    close(client_socketfd);
   }
 }
 
@@ -177,16 +304,39 @@ void Setup(char *dir) {
 
   // Create the index
   docIndex = CreateIndex();
+  // Keep every movie's fields in dense columns as well.
+  if (AddColumnStore(docIndex) != 0) {
+    printf("Couldn't make a column store; going without one.\n");
+  }
 
   // Index the files
   printf("Parsing and indexing files...\n");
-  ParseTheFiles(docs, docIndex);
+  LoadTheFiles(docs, docIndex);
   printf("%d entries in the index.\n", NumElemsInHashtable(docIndex->ht));
+
+  // Made before any child is forked, so they all share it.
+  resultCache = CreateResultCache();
+  if (resultCache == NULL) {
+    printf("Couldn't make a result cache; going without one.\n");
+  }
+
+  // Map every file so rows are served straight from the page cache.
+  docMaps = MapDocFiles(docs, DOC_MAP_POPULATE);
+  if (docMaps == NULL) {
+    exit(1);
+  }
 }
 
 // Cleans up program after it exits.
 int Cleanup() {
+  if (resultCache != NULL) {
+    printf("Result cache: %lu hits, %lu misses\n",
+           (unsigned long)CacheHits(resultCache),
+           (unsigned long)CacheMisses(resultCache));
+    DestroyResultCache(resultCache);
+  }
   DestroyOffsetIndex(docIndex);
+  UnmapDocFiles(docs, docMaps);
   DestroyDocIdMap(docs);
   close(socketfd);
   return 0;
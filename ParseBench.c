@@ -0,0 +1,204 @@
+// Benchmark that measures how fast rows can be found and split into
+// fields, without indexing them. Every file in DIR is parsed REPEATS
+// times by each of:
+//
+//   - memcpy of the mapped files, which is as fast as anything that has
+//     to look at every byte can go;
+//   - fgets and CreateMovieFromRow, the way ParseTheFiles reads rows;
+//   - ScanNextRow and SplitRow over the mapped files, once with each
+//     delimiter scanner this CPU has (see FindDelimiters).
+//
+// Prints MB/s and rows/s for each. The checksum is made from the fields
+// of every movie, so a scanner that splits a row differently than
+// CreateMovieFromRow shows up as a different checksum.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "includes/DocIdMap.h"
+#include "includes/FileCrawler.h"
+#include "includes/Movie.h"
+#include "includes/RowParser.h"
+
+#define BUFFER_SIZE 1000
+
+// One file, mapped.
+typedef struct benchFile {
+  char *name;
+  const char *data;
+  size_t size;
+} BenchFile;
+
+// What one pass over the files counted.
+typedef struct benchCount {
+  long rows;
+  long movies;
+  uint64_t checksum;
+} BenchCount;
+
+BenchFile *files;
+int num_files = 0;
+size_t total_bytes = 0;
+
+double Now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+void AddToChecksum(BenchCount *count, int id_length, int year,
+                   int num_genres) {
+  count->movies++;
+  count->checksum = count->checksum * 31 + id_length;
+  count->checksum = count->checksum * 31 + year;
+  count->checksum = count->checksum * 31 + num_genres;
+}
+
+void CopyFiles(BenchCount *count) {
+  char *copy = (char*)malloc(total_bytes + 1);
+  if (copy == NULL) {
+    return;
+  }
+  size_t pos = 0;
+  for (int i = 0; i < num_files; i++) {
+    memcpy(copy + pos, files[i].data, files[i].size);
+    pos += files[i].size;
+  }
+  count->checksum += copy[total_bytes / 2];
+  free(copy);
+}
+
+void ParseWithFgets(BenchCount *count) {
+  char buffer[BUFFER_SIZE];
+
+  for (int i = 0; i < num_files; i++) {
+    FILE *file = fopen(files[i].name, "r");
+    if (file == NULL) {
+      continue;
+    }
+    while (fgets(buffer, BUFFER_SIZE, file) != NULL) {
+      count->rows++;
+      Movie *movie = CreateMovieFromRow(buffer);
+      if (movie == NULL) {
+        continue;
+      }
+      int num_genres = 0;
+      while (num_genres < NUM_GENRES && movie->genres[num_genres] != NULL) {
+        num_genres++;
+      }
+      AddToChecksum(count, movie->id == NULL ? 0 : strlen(movie->id),
+                    movie->year, num_genres);
+      DestroyMovie(movie);
+    }
+    fclose(file);
+  }
+}
+
+void ParseWithScanner(BenchCount *count) {
+  RowScanner scanner;
+  FieldView row;
+  RowView view;
+
+  for (int i = 0; i < num_files; i++) {
+    InitRowScanner(&scanner, files[i].data, files[i].size, 1);
+    while (ScanNextRow(&scanner, &row) == 0) {
+      count->rows++;
+      if (SplitRow(row, &view) != 0) {
+        continue;
+      }
+      AddToChecksum(count, view.id.length, view.year, view.num_genres);
+    }
+  }
+}
+
+void RunBench(const char *name, void (*parse)(BenchCount*), int repeats) {
+  BenchCount count = {0, 0, 0};
+
+  double start = Now();
+  for (int i = 0; i < repeats; i++) {
+    count.rows = 0;
+    count.movies = 0;
+    parse(&count);
+  }
+  double seconds = Now() - start;
+  if (seconds <= 0) {
+    seconds = 1e-9;
+  }
+  printf("%-14s %9.1f MB/s %12.0f rows/s %8ld movies  checksum %016llx\n",
+         name, total_bytes * (double)repeats / seconds / 1e6,
+         count.rows * (double)repeats / seconds, count.movies,
+         (unsigned long long)count.checksum);
+}
+
+int MapFiles(DocIdMap docs) {
+  files = (BenchFile*)malloc((NumElemsInHashtable(docs) + 1) *
+                             sizeof(BenchFile));
+  if (files == NULL) {
+    return -1;
+  }
+  for (int doc_id = 1; doc_id <= NumElemsInHashtable(docs); doc_id++) {
+    char *name = GetFileFromId(docs, doc_id);
+    if (name == NULL) {
+      continue;
+    }
+    BenchFile *file = &files[num_files];
+    file->name = name;
+    if (MapRowFile(name, &file->data, &file->size) != 0) {
+      printf("Couldn't map %s\n", name);
+      continue;
+    }
+    if (file->data == NULL) {
+      continue;
+    }
+    total_bytes += file->size;
+    num_files++;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  const char *scanner_names[] = {"scalar", "sse2", "avx2"};
+
+  if (argc < 2) {
+    printf("Usage: %s DIR [REPEATS]\n", argv[0]);
+    return 1;
+  }
+  int repeats = argc > 2 ? atoi(argv[2]) : 10;
+  if (repeats < 1) {
+    repeats = 1;
+  }
+
+  DocIdMap docs = CreateDocIdMap();
+  CrawlFilesToMap(argv[1], docs);
+  if (MapFiles(docs) != 0) {
+    printf("Out of memory\n");
+    DestroyDocIdMap(docs);
+    return 1;
+  }
+  printf("%d files, %.1f MB, %d repeats\n", num_files, total_bytes / 1e6,
+         repeats);
+
+  const char *picked = DelimiterScannerName();
+  RunBench("memcpy", CopyFiles, repeats);
+  RunBench("fgets", ParseWithFgets, repeats);
+  for (int i = 0; i < 3; i++) {
+    if (UseDelimiterScanner(scanner_names[i]) != 0) {
+      printf("%-14s not supported\n", scanner_names[i]);
+      continue;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "scan %s", scanner_names[i]);
+    RunBench(name, ParseWithScanner, repeats);
+  }
+  UseDelimiterScanner(picked);
+  printf("FindDelimiters uses %s on this CPU\n", picked);
+
+  for (int i = 0; i < num_files; i++) {
+    UnmapRowFile(files[i].data, files[i].size);
+  }
+  free(files);
+  DestroyDocIdMap(docs);
+  return 0;
+}
@@ -0,0 +1,291 @@
+// Benchmark that measures how many query connections per second a movie
+// server can handle. Several threads each open connection after
+// connection, run one query with the same protocol QueryClient.c uses and
+// read every row before closing.
+//
+// Run it against multiserver and epollserver with the same arguments to
+// compare the fork-per-connection model with the epoll model. Pass v2 as
+// the last argument to use protocol v2 instead of ACKing every row, or
+// session to have each thread open one v2 session and run all of its
+// queries over it, which shows what connection setup costs.
+//
+// Every query has to return as many rows as the server said it would;
+// a connection that doesn't is counted as failed, which makes this a
+// quick check that concurrent queries don't step on each other.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "includes/QueryProtocol.h"
+
+#define BUFFER_SIZE 1000
+
+char *ip;
+char *port_string;
+char *term;
+int connections_per_thread;
+int use_v2 = 0;
+int use_session = 0;
+
+// What each thread reports back when it is done.
+typedef struct benchResult {
+  int completed;
+  int failed;
+  long rows;
+} BenchResult;
+
+// Returns 1 if the buffer ends with the GOODBYE message.
+int EndsWithGoodbye(char *buffer, int len) {
+  int goodbye_len = strlen(GOODBYE);
+  if (len < goodbye_len) {
+    return 0;
+  }
+  return strcmp(buffer + len - goodbye_len, GOODBYE) == 0;
+}
+
+// Reads a v2 result stream, which ends with an end_type frame.
+// Returns the number of rows received, or -1 on failure.
+int ReadStreamV2(FrameReader *reader, char end_type) {
+  char buffer[BUFFER_SIZE];
+  char type;
+  int rows = 0;
+
+  if (ReadFrame(reader, &type, buffer, BUFFER_SIZE) < 0 ||
+      type != FRAME_COUNT) {
+    return -1;
+  }
+  int num_results = atoi(buffer);
+  while (ReadFrame(reader, &type, buffer, BUFFER_SIZE) >= 0) {
+    if (type == end_type) {
+      return rows == num_results ? rows : -1;
+    }
+    if (type != FRAME_ROW) {
+      return -1;
+    }
+    rows++;
+  }
+  return -1;
+}
+
+// Connects to the server and waits for its ACK.
+// Returns the socket, or -1 on failure.
+int Connect(struct addrinfo *res) {
+  char buffer[BUFFER_SIZE];
+  int bytes_received;
+
+  int socketfd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+  if (socketfd == -1) {
+    return -1;
+  }
+  if (connect(socketfd, res->ai_addr, res->ai_addrlen) == -1) {
+    close(socketfd);
+    return -1;
+  }
+
+  // Server greets us with an ACK.
+  bytes_received = recv(socketfd, buffer, BUFFER_SIZE - 1, 0);
+  if (bytes_received <= 0) {
+    close(socketfd);
+    return -1;
+  }
+  buffer[bytes_received] = '\0';
+  if (CheckAck(buffer) != 0) {
+    close(socketfd);
+    return -1;
+  }
+  return socketfd;
+}
+
+// Runs every query of one thread over a single v2 session.
+void RunSession(struct addrinfo *res, BenchResult *result) {
+  FrameReader *reader = (FrameReader*)malloc(sizeof(FrameReader));
+  FrameBuffer *frames = (FrameBuffer*)malloc(sizeof(FrameBuffer));
+  int i = 0;
+
+  int socketfd = Connect(res);
+  if (socketfd != -1 && reader != NULL && frames != NULL &&
+      send(socketfd, SESSION_V2, strlen(SESSION_V2), MSG_NOSIGNAL) != -1) {
+    InitFrameReader(reader, socketfd);
+    for (; i < connections_per_thread; i++) {
+      InitFrameBuffer(frames);
+      PutFrame(frames, FRAME_QUERY, term, strlen(term));
+      if (SendFrames(socketfd, frames) != 0) {
+        break;
+      }
+      int rows = ReadStreamV2(reader, FRAME_END);
+      if (rows < 0) {
+        break;
+      }
+      result->completed++;
+      result->rows += rows;
+    }
+    InitFrameBuffer(frames);
+    PutFrame(frames, FRAME_GOODBYE, "", 0);
+    SendFrames(socketfd, frames);
+  }
+  result->failed += connections_per_thread - i;
+
+  if (socketfd != -1) {
+    close(socketfd);
+  }
+  free(reader);
+  free(frames);
+}
+
+// Runs one query over a fresh connection.
+// Returns the number of rows received, or -1 on failure.
+int RunOneQuery(struct addrinfo *res) {
+  char buffer[BUFFER_SIZE];
+  int bytes_received, rows = 0;
+
+  int socketfd = Connect(res);
+  if (socketfd == -1) {
+    return -1;
+  }
+
+  if (use_v2) {
+    FrameReader *reader = (FrameReader*)malloc(sizeof(FrameReader));
+    if (reader == NULL) {
+      close(socketfd);
+      return -1;
+    }
+    InitFrameReader(reader, socketfd);
+    snprintf(buffer, BUFFER_SIZE, "%s%s", QUERY_V2_PREFIX, term);
+    send(socketfd, buffer, strlen(buffer), MSG_NOSIGNAL);
+    rows = ReadStreamV2(reader, FRAME_GOODBYE);
+    free(reader);
+    close(socketfd);
+    return rows;
+  }
+
+  send(socketfd, term, strlen(term), MSG_NOSIGNAL);
+  bytes_received = recv(socketfd, buffer, BUFFER_SIZE - 1, 0);
+  if (bytes_received <= 0) {
+    close(socketfd);
+    return -1;
+  }
+  buffer[bytes_received] = '\0';
+
+  int num_results = atoi(buffer);
+  if (num_results > 0) {
+    while (1) {
+      if (send(socketfd, ACK, strlen(ACK), MSG_NOSIGNAL) == -1) {
+        break;
+      }
+      bytes_received = recv(socketfd, buffer, BUFFER_SIZE - 1, 0);
+      if (bytes_received <= 0) {
+        break;
+      }
+      buffer[bytes_received] = '\0';
+      if (strcmp(buffer, GOODBYE) == 0) {
+        break;
+      }
+      rows++;
+      if (EndsWithGoodbye(buffer, bytes_received)) {
+        break;
+      }
+    }
+  }
+
+  close(socketfd);
+  if (rows != num_results) {
+    return -1;
+  }
+  return rows;
+}
+
+void *BenchThread(void *arg) {
+  BenchResult *result = (BenchResult*)arg;
+  struct addrinfo hints, *res;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  if (getaddrinfo(ip, port_string, &hints, &res) != 0) {
+    perror("getaddrinfo");
+    result->failed = connections_per_thread;
+    return NULL;
+  }
+
+  if (use_session) {
+    RunSession(res, result);
+    freeaddrinfo(res);
+    return NULL;
+  }
+
+  for (int i = 0; i < connections_per_thread; i++) {
+    int rows = RunOneQuery(res);
+    if (rows < 0) {
+      result->failed++;
+    } else {
+      result->completed++;
+      result->rows += rows;
+    }
+  }
+
+  freeaddrinfo(res);
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 6 && argc != 7) {
+    printf("The number of arguments is invalid.\n");
+    printf("Please run the program again using the following format:\n");
+    printf("'./querybench <IP address> <port number> <term> "
+           "<connections per thread> <threads> [v1|v2|session]\n");
+    printf("EXITING NOW...\n");
+    return 0;
+  }
+  ip = argv[1];
+  port_string = argv[2];
+  term = argv[3];
+  connections_per_thread = atoi(argv[4]);
+  int num_threads = atoi(argv[5]);
+  if (argc == 7 && strcmp(argv[6], "v2") == 0) {
+    use_v2 = 1;
+  }
+  if (argc == 7 && strcmp(argv[6], "session") == 0) {
+    use_session = 1;
+  }
+  if (connections_per_thread <= 0 || num_threads <= 0) {
+    printf("Connections and threads must be positive.\n");
+    return 0;
+  }
+
+  pthread_t threads[num_threads];
+  BenchResult results[num_threads];
+  struct timeval start, end;
+
+  memset(results, 0, sizeof(results));
+  gettimeofday(&start, NULL);
+  for (int i = 0; i < num_threads; i++) {
+    pthread_create(&threads[i], NULL, BenchThread, &results[i]);
+  }
+
+  int completed = 0, failed = 0;
+  long rows = 0;
+  for (int i = 0; i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+    completed += results[i].completed;
+    failed += results[i].failed;
+    rows += results[i].rows;
+  }
+  gettimeofday(&end, NULL);
+
+  double seconds = (end.tv_sec - start.tv_sec) +
+      (end.tv_usec - start.tv_usec) / 1000000.0;
+  const char *unit = use_session ? "queries" : "connections";
+  printf("%s: %d completed, %d failed\n",
+         use_session ? "Queries" : "Connections", completed, failed);
+  printf("Rows received: %ld\n", rows);
+  printf("Took %f seconds; %.1f %s/sec\n", seconds, completed / seconds, unit);
+  return 0;
+}
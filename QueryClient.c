@@ -13,7 +13,6 @@
 #include <arpa/inet.h>
 
 #include "includes/QueryProtocol.h"
-#include "QueryClient.h"
 
 char *port_string = "1500";
 unsigned short int port;
@@ -21,28 +20,32 @@ char *ip = "127.0.0.1";
 
 #define BUFFER_SIZE 1000
 
-// Runs a single query by connecting with the movie server, then ends the
-// connection after the results are received and server sends "GOODBYE" message.
-void RunQuery(char *query) {
+// The open session with the server. socketfd is -1 while there is none.
+int socketfd = -1;
+FrameReader *reader;
+FrameBuffer *frames;
+
+// Connects to the movie server and opens a v2 session, so every query
+// from the prompt can go over the same connection.
+// Returns 0 on success, -1 on failure.
+int OpenSession() {
   // Instantiate variables for the connection.
-  int socketfd, bytes_sent, bytes_received, check;
+  int bytes_received, check;
   char buffer[BUFFER_SIZE];
   struct addrinfo hints, *res;
 
-  // Set family to unspecified.
-  hints.ai_family = AF_UNSPEC;
-
   // Make sure that hints is empty.
   memset(&hints, 0, sizeof(hints));
 
-  // Set socket type.
+  // Set family to unspecified and socket type.
+  hints.ai_family = AF_UNSPEC;
   hints.ai_socktype = SOCK_STREAM;
   hints.ai_flags = AI_PASSIVE;
 
   // Get address info then make a socket.
   if ((check = getaddrinfo(ip, port_string, &hints, &res)) != 0) {
     perror("getaddrinfo");
-    return;
+    return -1;
   }
 
   socketfd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
@@ -51,65 +54,130 @@ void RunQuery(char *query) {
   if (connect(socketfd, res->ai_addr, res->ai_addrlen) == -1) {
     freeaddrinfo(res);
     close(socketfd);
+    socketfd = -1;
     perror("connecting");
-    return;
+    return -1;
   }
 
   // Free address info, no longer needed.
   freeaddrinfo(res);
 
-  // Message for user showing successful connection.
-  printf("Connected to Movie Query Server.\n\n");
-
   // Recieve and confirm acknowledgement info.
-  if ((bytes_received = recv(socketfd, buffer, BUFFER_SIZE, 0)) == -1) {
+  if ((bytes_received = recv(socketfd, buffer, BUFFER_SIZE - 1, 0)) <= 0) {
     close(socketfd);
+    socketfd = -1;
     perror("Client Recieve");
+    return -1;
+  }
+  buffer[bytes_received] =  '\0';
+  if (CheckAck(buffer) != 0) {
+    close(socketfd);
+    socketfd = -1;
+    return -1;
+  }
+
+  // Ask for a v2 session so the server streams every row without waiting
+  // for an ACK in between, and keeps the connection for the next query.
+  if (send(socketfd, SESSION_V2, strlen(SESSION_V2), MSG_NOSIGNAL) == -1) {
+    close(socketfd);
+    socketfd = -1;
+    perror("Client send");
+    return -1;
+  }
+  InitFrameReader(reader, socketfd);
+
+  // Message for user showing successful connection.
+  printf("Connected to Movie Query Server.\n\n");
+  return 0;
+}
+
+// Says goodbye to the server and closes the session.
+void CloseSession() {
+  char buffer[BUFFER_SIZE];
+  char type;
+
+  if (socketfd == -1) {
     return;
   }
+  InitFrameBuffer(frames);
+  PutFrame(frames, FRAME_GOODBYE, "", 0);
+  if (SendFrames(socketfd, frames) == 0) {
+    // Wait for the server's goodbye so it closes its side first.
+    while (ReadFrame(reader, &type, buffer, BUFFER_SIZE) >= 0 &&
+           type != FRAME_GOODBYE) {
+    }
+  }
+  close(socketfd);
+  socketfd = -1;
+}
 
-  buffer[bytes_received] =  '\0';
+// Sends one query over the session and reads the number of results.
+// Returns the number of results, or -1 if the session is gone (e.g. the
+// server closed it after it sat idle).
+int SendQuery(char *query) {
+  char buffer[BUFFER_SIZE];
+  char type;
+
+  InitFrameBuffer(frames);
+  PutFrame(frames, FRAME_QUERY, query, strlen(query));
+  if (SendFrames(socketfd, frames) != 0) {
+    return -1;
+  }
+  if (ReadFrame(reader, &type, buffer, BUFFER_SIZE) < 0 ||
+      type != FRAME_COUNT) {
+    return -1;
+  }
+  printf("Number of Results: %s\n", buffer);
+  return atoi(buffer);
+}
 
-  if (CheckAck(buffer) == 0) {
+// Runs a single query over the session, opening a new one if there is
+// none yet or the server has closed the old one.
+void RunQuery(char *query) {
+  char buffer[BUFFER_SIZE];
+  char type;
+  int num_results = -1;
 
-    // Begin query protocol.
-    buffer[0] = 0;
-    if ((bytes_sent = send(socketfd, query, strlen(query), 0)) == -1) {
+  if (socketfd != -1) {
+    num_results = SendQuery(query);
+    if (num_results < 0) {
       close(socketfd);
-      perror("Client send");
+      socketfd = -1;
+    }
+  }
+  if (num_results < 0) {
+    if (OpenSession() != 0) {
       return;
     }
-    if ((bytes_received = recv(socketfd, buffer, BUFFER_SIZE, 0)) == -1) {
+    num_results = SendQuery(query);
+  }
+  if (num_results < 0) {
+    printf("Client Recieve: expected the number of results\n");
+    close(socketfd);
+    socketfd = -1;
+    return;
+  }
+  if (num_results == 0) {
+    printf("There are no results for this query\n");
+  }
+
+  // Loop that receives and prints results. Terminates upon the end frame.
+  while (1) {
+    if (ReadFrame(reader, &type, buffer, BUFFER_SIZE) < 0 ||
+        type == FRAME_GOODBYE) {
       close(socketfd);
-      perror("Client Recieve");
+      socketfd = -1;
       return;
     }
-    buffer[bytes_received] =  '\0';
-    printf("Number of Results: %s\n", buffer);
-    int number_of_results = atoi(buffer);
-    if (number_of_results == 0) {
-      close(socketfd);
-      printf("There are no results for this query\n");
+    if (type == FRAME_END) {
       return;
     }
-
-    // Loop that receives and prints results. Terminates upon 'GOODBYE' message.
-    while (1) {
-      SendAck(socketfd);
-      if ((bytes_received = recv(socketfd, buffer, BUFFER_SIZE, 0)) == -1) {
-	close(socketfd);
-	perror("Client Recieve");
-	return;
-      }
-      buffer[bytes_received] = '\0';
-      if (strcmp(buffer, "GOODBYE") == 0) {
-	break;
-      }
-      printf("%s\n", buffer);
+    if (type == FRAME_FACETS) {
+      printf("Facets: %s\n", buffer);
+      continue;
     }
+    printf("%s", buffer);
   }
-  // End connection. Close socket.
-  close(socketfd);
 }
 
 // Loops and asks the client for a term to search for, then calls on RunQuery.
@@ -118,12 +186,22 @@ void RunPrompt() {
 
   while (1) {
     printf("Enter a term to search for, or q to quit: ");
-    scanf("%s", input);
+    // Read the whole line so queries like "star AND wars" stay together.
+    if (fgets(input, BUFFER_SIZE, stdin) == NULL) {
+      CloseSession();
+      printf("\n");
+      return;
+    }
+    input[strcspn(input, "\r\n")] = '\0';
 
     printf("input was: %s\n", input);
 
+    if (strlen(input) == 0) {
+      continue;
+    }
     if (strlen(input) == 1) {
       if (input[0] == 'q') {
+        CloseSession();
         printf("Thanks for playing! \n");
         return;
       }
@@ -146,7 +224,17 @@ int main(int argc, char **argv) {
     port_string = argv[2];
   }
 
+  reader = (FrameReader*)malloc(sizeof(FrameReader));
+  frames = (FrameBuffer*)malloc(sizeof(FrameBuffer));
+  if (reader == NULL || frames == NULL) {
+    printf("Couldn't malloc session buffers\n");
+    return 0;
+  }
+
   RunPrompt();
 
+  free(reader);
+  free(frames);
+
   return 0;
 }
@@ -0,0 +1,178 @@
+// Test that many threads can query one shared Index at once. Every query
+// is run once on a single thread first, and what it returned becomes the
+// answer; then THREADS threads run every query ROUNDS times, each
+// starting at a different query, and check that they get the same
+// answer every time.
+//
+// An answer is the count, the facets and every row, read with
+// GetRowSlice, plus the first row read again with CopyRowFromFile, so
+// FindMovies, the SearchResultIter functions and both ways of reading a
+// row are all run from many threads at once. `make querytest` builds it
+// and everything it calls with -fsanitize=thread, so ThreadSanitizer
+// reports any data race between the queries too.
+//
+// Exits with 1 if any thread got a different answer.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "includes/DocIdMap.h"
+#include "includes/FileCrawler.h"
+#include "includes/FileLoader.h"
+#include "includes/QueryProcessor.h"
+
+#define MAX_THREADS 64
+
+// One of every kind of query, and some that match nothing.
+const char *queries[] = {
+  "the", "love", "Derby", "star wars", "the AND love", "the OR man",
+  "the NOT love", "rank:the love", "rank:50 man", "prefix:lo",
+  "fuzzy:lvoe", "fuzzy:1 mna", "genre:comedy year:2013",
+  "love facets=on", "the facets=only", "year:2000..2010 type:movie",
+  "the sort=year limit=20", "man sort=title desc limit=100",
+  "runtime:90..120 sort=runtime", "zyzzyva", "adult:1",
+  "the year:1000..9999", "runtime:0..9999 year:1900..2000,2010..2020",
+};
+#define NUM_QUERIES ((int)(sizeof(queries) / sizeof(queries[0])))
+
+// What a query returned, as one string.
+typedef struct answer {
+  char *data;
+  int length;
+  int capacity;
+} Answer;
+
+DocIdMap docs;
+Index docIndex;
+DocMapping *docMaps;
+Answer expected[NUM_QUERIES];
+int rounds;
+int mismatches = 0;
+
+void AddToAnswer(Answer *answer, const char *data, int length) {
+  if (answer->length + length > answer->capacity) {
+    int capacity = 2 * (answer->length + length) + 1024;
+    char *bigger = (char*)realloc(answer->data, capacity);
+    if (bigger == NULL) {
+      printf("Out of memory\n");
+      exit(1);
+    }
+    answer->data = bigger;
+    answer->capacity = capacity;
+  }
+  memcpy(answer->data + answer->length, data, length);
+  answer->length += length;
+}
+
+void RunQuery(const char *query, Answer *answer) {
+  char term[1000];
+  char line[1000];
+  struct searchResult sr;
+  struct rowSlice slice;
+
+  answer->length = 0;
+  snprintf(term, sizeof(term), "%s", query);
+  SearchResultIter results = FindMovies(docIndex, term);
+  if (results == NULL) {
+    AddToAnswer(answer, "none\n", 5);
+    return;
+  }
+  int length = snprintf(line, sizeof(line), "%d %s\n",
+                        NumResultsInIter(results),
+                        GetFacets(results) != NULL ? GetFacets(results) : "");
+  AddToAnswer(answer, line, length);
+  int first = 1;
+  while (ResultRowsWanted(results)) {
+    SearchResultGet(results, &sr);
+    if (GetRowSlice(docIndex, &sr, docMaps, &slice) == 0) {
+      AddToAnswer(answer, slice.data, slice.length);
+    }
+    if (first && CopyRowFromFile(docIndex, &sr, docs, line) == 0) {
+      AddToAnswer(answer, line, strlen(line));
+    }
+    first = 0;
+    if (SearchResultIterHasMore(results) == 0 ||
+        SearchResultNext(results) < 0) {
+      break;
+    }
+  }
+  DestroySearchResultIter(results);
+}
+
+void *RunQueries(void *arg) {
+  int id = *(int*)arg;
+  Answer answer = { NULL, 0, 0 };
+
+  for (int round = 0; round < rounds; round++) {
+    for (int i = 0; i < NUM_QUERIES; i++) {
+      int q = (id + i) % NUM_QUERIES;
+      RunQuery(queries[q], &answer);
+      if (answer.length != expected[q].length ||
+          memcmp(answer.data, expected[q].data, answer.length) != 0) {
+        fprintf(stderr, "Thread %d got a different answer for \"%s\"\n", id,
+                queries[q]);
+        __atomic_fetch_add(&mismatches, 1, __ATOMIC_RELAXED);
+      }
+    }
+  }
+  free(answer.data);
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  pthread_t threads[MAX_THREADS];
+  int ids[MAX_THREADS];
+
+  if (argc < 2) {
+    printf("Usage: %s DIR [THREADS] [ROUNDS]\n", argv[0]);
+    return 1;
+  }
+  int num_threads = argc > 2 ? atoi(argv[2]) : 8;
+  if (num_threads < 1 || num_threads > MAX_THREADS) {
+    num_threads = 8;
+  }
+  rounds = argc > 3 ? atoi(argv[3]) : 10;
+  if (rounds < 1) {
+    rounds = 1;
+  }
+
+  docs = CreateDocIdMap();
+  CrawlFilesToMap(argv[1], docs);
+  docIndex = CreateIndex();
+  if (AddColumnStore(docIndex) != 0 || LoadTheFiles(docs, docIndex) != 0) {
+    printf("Couldn't load %s\n", argv[1]);
+    return 1;
+  }
+  docMaps = MapDocFiles(docs, 0);
+  if (docMaps == NULL) {
+    return 1;
+  }
+
+  for (int i = 0; i < NUM_QUERIES; i++) {
+    RunQuery(queries[i], &expected[i]);
+  }
+  int started = 0;
+  while (started < num_threads) {
+    ids[started] = started;
+    if (pthread_create(&threads[started], NULL, RunQueries,
+                       &ids[started]) != 0) {
+      break;
+    }
+    started++;
+  }
+  for (int i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  printf("%d threads ran %d queries %d times each: %d different answers\n",
+         started, NUM_QUERIES, rounds, mismatches);
+  for (int i = 0; i < NUM_QUERIES; i++) {
+    free(expected[i].data);
+  }
+  UnmapDocFiles(docs, docMaps);
+  DestroyOffsetIndex(docIndex);
+  DestroyDocIdMap(docs);
+  return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,489 @@
+// Program representing a server that builds the movie index once and
+// serves clients from a fixed pool of worker threads that all share it.
+//
+// The main thread accepts connections and hands them to the workers
+// through per-worker queues. A worker takes the oldest connection off its
+// own queue, so clients are served in the order they came; when its
+// queue is empty it steals the oldest connection from another worker's
+// queue, so a burst of connections that lands on one worker is spread
+// out over the whole pool.
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <errno.h>
+#include <pthread.h>
+
+
+#include "QueryProtocol.h"
+#include "MovieSet.h"
+#include "MovieIndex.h"
+#include "DocIdMap.h"
+#include "htll/Hashtable.h"
+#include "QueryProcessor.h"
+#include "FileParser.h"
+#include "FileLoader.h"
+#include "FileCrawler.h"
+
+#define BUFFER_SIZE 1000
+#define SEARCH_RESULT_LENGTH 1500
+#define BACKLOG_SIZE 128
+#define DEFAULT_NUM_WORKERS 8
+#define QUEUE_SIZE 256
+
+int Cleanup();
+
+// Built once in Setup and only read after the workers start.
+DocIdMap docs;
+Index docIndex;
+DocMapping *docMaps;  // Every file mapped into memory, by doc id.
+
+// Global socketfd for easy cleanup.
+int socketfd;
+
+// A queue of accepted client sockets belonging to one worker. The main
+// thread pushes at the bottom; the owner and thieves take from the top.
+typedef struct workQueue {
+  int fds[QUEUE_SIZE];
+  int top;
+  int bottom;
+  pthread_mutex_t lock;
+} WorkQueue;
+
+// Everything one worker needs to serve a query. These buffers replace the
+// process globals in MultiServer.c, so workers never share scratch space.
+typedef struct worker {
+  int id;
+  pthread_t thread;
+  WorkQueue queue;
+  char buffer[BUFFER_SIZE];
+  char movieSearchResult[SEARCH_RESULT_LENGTH];
+  FrameBuffer frames;
+  FrameReader reader;
+} Worker;
+
+Worker *workers;
+int num_workers;
+
+// How many sockets are in the queues that no worker has claimed yet.
+// Workers sleep on this when there is nothing to take or steal.
+pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t pending_cond = PTHREAD_COND_INITIALIZER;
+int num_pending = 0;
+
+void sigint_handler(int sig) {
+  write(0, "Ahhh! SIGINT!\n", 14);
+  Cleanup();
+  exit(0);
+}
+
+// Adds a client socket to the bottom of the queue.
+// Returns 0 on success, -1 if the queue is full.
+int PushQueue(WorkQueue *queue, int fd) {
+  pthread_mutex_lock(&queue->lock);
+  if (queue->bottom - queue->top == QUEUE_SIZE) {
+    pthread_mutex_unlock(&queue->lock);
+    return -1;
+  }
+  queue->fds[queue->bottom % QUEUE_SIZE] = fd;
+  queue->bottom++;
+  pthread_mutex_unlock(&queue->lock);
+  return 0;
+}
+
+// Takes the oldest client socket off the top of a queue, the worker's
+// own or someone else's.
+// Returns the socket, or -1 if the queue is empty.
+int PopQueue(WorkQueue *queue) {
+  int fd = -1;
+  pthread_mutex_lock(&queue->lock);
+  if (queue->bottom > queue->top) {
+    fd = queue->fds[queue->top % QUEUE_SIZE];
+    queue->top++;
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return fd;
+}
+
+// Finds the next client for this worker, waiting if there is none.
+int NextClient(Worker *self) {
+  // Claim a socket first. Sockets are queued before they are counted,
+  // and every worker that claims one takes just one, so a claimed socket
+  // is always in some queue: a worker never wakes up to find nothing.
+  pthread_mutex_lock(&pending_lock);
+  while (num_pending == 0) {
+    pthread_cond_wait(&pending_cond, &pending_lock);
+  }
+  num_pending--;
+  pthread_mutex_unlock(&pending_lock);
+
+  int fd = -1;
+  for (int i = 0; fd == -1; i = (i + 1) % num_workers) {
+    fd = PopQueue(&workers[(self->id + i) % num_workers].queue);
+  }
+  return fd;
+}
+
+// Sends the row of a v1 result, or MISSING_ROW if it can't be found.
+void SendRow(int client_socketfd, SearchResult sr) {
+  struct rowSlice slice;
+  if (GetRowSlice(docIndex, sr, docMaps, &slice) != 0) {
+    slice.data = MISSING_ROW;
+    slice.length = strlen(MISSING_ROW);
+  }
+  send(client_socketfd, slice.data, slice.length, MSG_NOSIGNAL);
+}
+
+// Function used to handle a single connection and query from the client.
+// Sends a Goodbye message when this query is finished.
+void runQuery(Worker *self, int client_socketfd) {
+  int result, bytes_received;
+  char *buffer = self->buffer;
+  char *movieSearchResult = self->movieSearchResult;
+  struct searchResult sr;
+
+  SearchResultIter results = FindMovies(docIndex, buffer);
+
+  if (results == NULL) {
+    // If no results, sends Goodbye message and ends the connection.
+    send(client_socketfd, "0", strlen("0"), MSG_NOSIGNAL);
+    printf("No results for this term. Please try another.\n");
+    printf("Closing Client Connection...\n");
+    SendGoodbye(client_socketfd);
+    return;
+  }
+
+  sprintf(movieSearchResult, "%d", NumResultsInIter(results));
+  printf("Number of Results: %s\n", movieSearchResult);
+  send(client_socketfd, movieSearchResult, strlen(movieSearchResult),
+       MSG_NOSIGNAL);
+
+  // Uses SearchResultIter to iterate through the movie index and sends
+  // results to the client.
+  bytes_received = recv(client_socketfd, buffer, BUFFER_SIZE - 1, 0);
+  if (bytes_received <= 0) {
+    DestroySearchResultIter(results);
+    return;
+  }
+  buffer[bytes_received] = '\0';
+  if (CheckAck(buffer) != 0) {
+    DestroySearchResultIter(results);
+    return;
+  }
+  SearchResultGet(results, &sr);
+  SendRow(client_socketfd, &sr);
+
+  while (SearchResultIterHasMore(results) != 0) {
+    result = SearchResultNext(results);
+    if (result < 0) {
+      printf("error retrieving result\n");
+      break;
+    }
+    bytes_received = recv(client_socketfd, buffer, BUFFER_SIZE - 1, 0);
+    if (bytes_received <= 0) {
+      DestroySearchResultIter(results);
+      return;
+    }
+    buffer[bytes_received] = '\0';
+    if (CheckAck(buffer) != 0) {
+      DestroySearchResultIter(results);
+      return;
+    }
+    SearchResultGet(results, &sr);
+    SendRow(client_socketfd, &sr);
+  }
+
+  // Sends Goodbye message and ends the connection.
+  printf("Closing Client Connection...\n");
+  SendGoodbye(client_socketfd);
+  DestroySearchResultIter(results);
+}
+
+// Function used to handle a single v2 query. Streams the count, the
+// facets if asked for, every row and an end_type frame without waiting
+// for the client to ACK each row.
+// Rows are copied into the frames straight from the mapped files.
+void runQueryV2(Worker *self, int client_socketfd, char *term,
+                char end_type) {
+  char *movieSearchResult = self->movieSearchResult;
+  FrameBuffer *frames = &self->frames;
+  struct searchResult sr;
+  struct rowSlice slice;
+  int count_len;
+
+  InitFrameBuffer(frames);
+  SearchResultIter results = FindMovies(docIndex, term);
+
+  if (results == NULL) {
+    printf("No results for this term. Please try another.\n");
+    BufferFrame(client_socketfd, frames, FRAME_COUNT, "0", 1);
+  } else {
+    count_len = sprintf(movieSearchResult, "%d", NumResultsInIter(results));
+    printf("Number of Results: %s\n", movieSearchResult);
+    BufferFrame(client_socketfd, frames, FRAME_COUNT, movieSearchResult,
+                count_len);
+    const char *facets = GetFacets(results);
+    if (facets != NULL) {
+      BufferFrame(client_socketfd, frames, FRAME_FACETS, facets,
+                  strlen(facets));
+    }
+
+    while (ResultRowsWanted(results)) {
+      SearchResultGet(results, &sr);
+      // The client is waiting for as many rows as the count said.
+      if (GetRowSlice(docIndex, &sr, docMaps, &slice) != 0) {
+        slice.data = MISSING_ROW;
+        slice.length = strlen(MISSING_ROW);
+      }
+      if (BufferFrame(client_socketfd, frames, FRAME_ROW, slice.data,
+                      slice.length) != 0) {
+        break;
+      }
+      if (SearchResultIterHasMore(results) == 0 ||
+          SearchResultNext(results) < 0) {
+        break;
+      }
+    }
+    DestroySearchResultIter(results);
+  }
+
+  BufferFrame(client_socketfd, frames, end_type, "", 0);
+  SendFrames(client_socketfd, frames);
+}
+
+// Function used to handle a v2 session. Answers query frames on the same
+// connection until the client says goodbye or stays idle for too long;
+// the worker is busy with this client for the whole session. pending
+// holds the bytes that arrived together with the session request.
+void runSessionV2(Worker *self, int client_socketfd, char *pending,
+                  int pending_len) {
+  FrameReader *reader = &self->reader;
+  char type;
+
+  InitFrameReader(reader, client_socketfd);
+  PreloadFrameReader(reader, pending, pending_len);
+  SetSessionTimeout(client_socketfd);
+
+  while (ReadFrame(reader, &type, self->buffer, BUFFER_SIZE) >= 0 &&
+         type == FRAME_QUERY) {
+    printf("Worker %d Query Received: %s \n", self->id, self->buffer);
+    runQueryV2(self, client_socketfd, self->buffer, FRAME_END);
+  }
+
+  printf("Closing Client Connection...\n");
+  InitFrameBuffer(&self->frames);
+  BufferFrame(client_socketfd, &self->frames, FRAME_GOODBYE, "", 0);
+  SendFrames(client_socketfd, &self->frames);
+}
+
+// Body of each worker thread: serve one client at a time, forever.
+void *WorkerLoop(void *arg) {
+  Worker *self = (Worker*)arg;
+
+  while (1) {
+    int client_socketfd = NextClient(self);
+    SendAck(client_socketfd);
+    int bytes_received = recv(client_socketfd, self->buffer,
+                              BUFFER_SIZE - 1, 0);
+    if (bytes_received > 0) {
+      self->buffer[bytes_received] = '\0';
+      int session_len = CheckSessionV2(self->buffer, bytes_received);
+      char *term = CheckQueryV2(self->buffer);
+      if (session_len > 0) {
+        // The pending bytes move into the reader before buffer is reused.
+        runSessionV2(self, client_socketfd, self->buffer + session_len,
+                     bytes_received - session_len);
+      } else if (term != NULL) {
+        printf("Worker %d Query Received: %s \n", self->id, self->buffer);
+        runQueryV2(self, client_socketfd, term, FRAME_GOODBYE);
+        printf("Closing Client Connection...\n");
+      } else {
+        printf("Worker %d Query Received: %s \n", self->id, self->buffer);
+        runQuery(self, client_socketfd);
+      }
+    }
+    close(client_socketfd);
+  }
+  return NULL;
+}
+
+// Starts the worker threads.
+void StartWorkers() {
+  workers = (Worker*)malloc(num_workers * sizeof(Worker));
+  if (workers == NULL) {
+    printf("Couldn't malloc workers\n");
+    exit(1);
+  }
+  for (int i = 0; i < num_workers; i++) {
+    workers[i].id = i;
+    workers[i].queue.top = 0;
+    workers[i].queue.bottom = 0;
+    pthread_mutex_init(&workers[i].queue.lock, NULL);
+  }
+  for (int i = 0; i < num_workers; i++) {
+    pthread_create(&workers[i].thread, NULL, WorkerLoop, &workers[i]);
+  }
+}
+
+// Accepts connections and hands them out to the workers round-robin.
+int HandleConnections(int sock_fd) {
+  struct sockaddr_storage client_addr_storage;
+  socklen_t addr_size;
+  int next_worker = 0;
+
+  while (1) {
+    printf("Waiting for client connection...\n");
+    addr_size = sizeof(client_addr_storage);
+    int client_socketfd = accept(sock_fd,
+                                 (struct sockaddr *)&client_addr_storage,
+                                 &addr_size);
+    if (client_socketfd == -1) {
+      if (errno != EINTR) {
+        perror("accept");
+      }
+      continue;
+    }
+    SetNoDelay(client_socketfd);
+
+    // Try each worker once, starting with the next in line.
+    int queued = -1;
+    for (int i = 0; i < num_workers && queued != 0; i++) {
+      queued = PushQueue(&workers[next_worker].queue, client_socketfd);
+      next_worker = (next_worker + 1) % num_workers;
+    }
+    if (queued != 0) {
+      printf("All workers are busy. Dropping connection.\n");
+      close(client_socketfd);
+      continue;
+    }
+
+    pthread_mutex_lock(&pending_lock);
+    num_pending++;
+    pthread_cond_signal(&pending_cond);
+    pthread_mutex_unlock(&pending_lock);
+  }
+}
+
+// Sets up clean up structures and builds the movie index.
+void Setup(char *dir) {
+  struct sigaction kill;
+
+  kill.sa_handler = sigint_handler;
+  kill.sa_flags = 0;  // or SA_RESTART
+  sigemptyset(&kill.sa_mask);
+
+  if (sigaction(SIGINT, &kill, NULL) == -1) {
+    perror("sigaction");
+    exit(1);
+  }
+
+  printf("Crawling directory tree starting at: %s\n", dir);
+  // Create a DocIdMap
+  docs = CreateDocIdMap();
+  CrawlFilesToMap(dir, docs);
+  printf("Crawled %d files.\n", NumElemsInHashtable(docs));
+
+  // Create the index
+  docIndex = CreateIndex();
+  // Keep every movie's fields in dense columns as well.
+  if (AddColumnStore(docIndex) != 0) {
+    printf("Couldn't make a column store; going without one.\n");
+  }
+
+  // Index the files
+  printf("Parsing and indexing files...\n");
+  LoadTheFiles(docs, docIndex);
+  printf("%d entries in the index.\n", NumElemsInHashtable(docIndex->ht));
+
+  // Map every file so rows are served straight from the page cache.
+  docMaps = MapDocFiles(docs, DOC_MAP_POPULATE);
+  if (docMaps == NULL) {
+    exit(1);
+  }
+}
+
+// Cleans up program after it exits.
+int Cleanup() {
+  DestroyOffsetIndex(docIndex);
+  UnmapDocFiles(docs, docMaps);
+  DestroyDocIdMap(docs);
+  close(socketfd);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  // Get args
+  char *dir_to_crawl, *port_number;
+  if (argc != 3 && argc != 4) {
+    printf("Incorrect number of arguments.\n");
+    printf("Please use the following format when running the program: \n");
+    printf("./threadserver <directory_to_index> <port_number> "
+           "[num_workers]\n");
+    printf("NOW EXITING...\n");
+    return 0;
+  } else {
+    // Set up structs for socket opening, port binding.
+    struct addrinfo hints, *server_info;
+    int check;
+    int yes = 1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    dir_to_crawl = argv[1];
+    port_number = argv[2];
+    num_workers = DEFAULT_NUM_WORKERS;
+    if (argc == 4 && atoi(argv[3]) > 0) {
+      num_workers = atoi(argv[3]);
+    }
+
+    // The index is finished before any worker starts, so the workers
+    // only ever read it.
+    Setup(dir_to_crawl);
+    StartWorkers();
+
+    // Step 1: get address/port info to open
+    if ((check = getaddrinfo(NULL, port_number, &hints, &server_info)) != 0) {
+      fprintf(stderr, "getaddrinfo error: %s\n", gai_strerror(check));
+      exit(1);
+    }
+
+    // Open socket.
+    if ((socketfd = socket(server_info->ai_family, server_info->ai_socktype,
+                           server_info->ai_protocol)) == -1) {
+      perror("Server: socket\n");
+      exit(1);
+    }
+
+    // Clears addresses to avoid "address already in use" error.
+    if (setsockopt(socketfd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)) == -1) {
+      perror("setsockopt");
+      exit(1);
+    }
+
+    // Binding socket to port.
+    if (bind(socketfd, server_info->ai_addr, server_info->ai_addrlen) == -1) {
+      perror("Server bind");
+      exit(1);
+    }
+
+    // Frees address (no longer using).
+    freeaddrinfo(server_info);
+
+    // Listen for connections.
+    listen(socketfd, BACKLOG_SIZE);
+
+    // Handle connections.
+    HandleConnections(socketfd);
+  }
+  Cleanup();
+  return 0;
+}
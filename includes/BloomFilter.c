@@ -0,0 +1,76 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BloomFilter.h"
+
+#define BLOCK_BITS 512
+
+BloomFilter CreateBloomFilter(int num_keys) {
+  BloomFilter filter = (BloomFilter)malloc(sizeof(struct bloomFilter));
+  if (filter == NULL) {
+    printf("Couldn't malloc for a BloomFilter\n");
+    return NULL;
+  }
+
+  uint64_t num_blocks = 1;
+  while (num_blocks * BLOCK_BITS < (uint64_t)num_keys * BLOOM_BITS_PER_KEY) {
+    num_blocks *= 2;
+  }
+  void *blocks;
+  if (posix_memalign(&blocks, 64, num_blocks * sizeof(*filter->blocks)) != 0) {
+    printf("Couldn't malloc for a BloomFilter\n");
+    free(filter);
+    return NULL;
+  }
+  memset(blocks, 0, num_blocks * sizeof(*filter->blocks));
+  filter->blocks = (uint64_t (*)[8])blocks;
+  filter->block_mask = num_blocks - 1;
+  return filter;
+}
+
+void DestroyBloomFilter(BloomFilter filter) {
+  free(filter->blocks);
+  free(filter);
+}
+
+// Spreads the bits of key around, so keys that are alike (FNV hashes of
+// similar words) still pick different blocks and bits.
+static uint64_t Mix(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
+// The bits of a key are a + i * b within its block, for i up to
+// BLOOM_PROBES.
+void AddToBloomFilter(BloomFilter filter, uint64_t key) {
+  uint64_t hash = Mix(key);
+  uint64_t *block = filter->blocks[hash & filter->block_mask];
+  uint32_t a = hash >> 32;
+  uint32_t b = (hash >> 16) | 1;
+
+  for (int i = 0; i < BLOOM_PROBES; i++) {
+    uint32_t bit = (a + i * b) % BLOCK_BITS;
+    block[bit / 64] |= 1ULL << (bit % 64);
+  }
+}
+
+int BloomFilterMayContain(BloomFilter filter, uint64_t key) {
+  uint64_t hash = Mix(key);
+  uint64_t *block = filter->blocks[hash & filter->block_mask];
+  uint32_t a = hash >> 32;
+  uint32_t b = (hash >> 16) | 1;
+
+  for (int i = 0; i < BLOOM_PROBES; i++) {
+    uint32_t bit = (a + i * b) % BLOCK_BITS;
+    if ((block[bit / 64] & (1ULL << (bit % 64))) == 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
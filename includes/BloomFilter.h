@@ -0,0 +1,43 @@
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+#include <stdint.h>
+
+// How many bits the filter has for each key it is sized for, and how
+// many of them each key sets. About 1 in 100 keys that were never added
+// get through.
+#define BLOOM_BITS_PER_KEY 10
+#define BLOOM_PROBES 6
+
+/**
+ * A BloomFilter answers "might this key have been added?" with no false
+ * negatives and a few false positives, in far less memory than the keys.
+ * Keys are 64-bit hashes, like the keys of a Hashtable.
+ *
+ * The bits are split into 512-bit blocks, one cache line each, and all
+ * of a key's bits are in the block its hash picks, so a lookup is one
+ * cache miss at most.
+ */
+typedef struct bloomFilter {
+  uint64_t (*blocks)[8];
+  uint64_t block_mask;  // The number of blocks, a power of 2, minus 1.
+} *BloomFilter;
+
+/**
+ * Creates an empty BloomFilter sized for num_keys keys. More can be
+ * added; it just lets more absent keys through.
+ *
+ * RETURNS: The filter, or NULL if out of memory.
+ */
+BloomFilter CreateBloomFilter(int num_keys);
+
+void DestroyBloomFilter(BloomFilter filter);
+
+void AddToBloomFilter(BloomFilter filter, uint64_t key);
+
+/**
+ * RETURNS: 0 if key was definitely never added, 1 if it might have been.
+ */
+int BloomFilterMayContain(BloomFilter filter, uint64_t key);
+
+#endif
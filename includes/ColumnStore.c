@@ -0,0 +1,309 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "ColumnStore.h"
+
+#define INITIAL_ROWS 1024
+#define INITIAL_POOL 16384
+
+ColumnStore CreateColumnStore() {
+  ColumnStore columns = (ColumnStore)calloc(1, sizeof(struct columnStore));
+  if (columns == NULL) {
+    printf("Couldn't malloc for a ColumnStore\n");
+    return NULL;
+  }
+  columns->title_pool = (char*)malloc(INITIAL_POOL);
+  if (columns->title_pool == NULL) {
+    printf("Couldn't malloc for a ColumnStore\n");
+    free(columns);
+    return NULL;
+  }
+  // Offset 0 is the empty title.
+  columns->title_pool[0] = '\0';
+  columns->pool_size = 1;
+  columns->pool_capacity = INITIAL_POOL;
+  columns->min_year = INT16_MAX;
+  columns->max_year = -1;
+  return columns;
+}
+
+void DestroyColumnStore(ColumnStore columns) {
+  free(columns->year);
+  free(columns->runtime);
+  free(columns->adult);
+  free(columns->type);
+  free(columns->genres);
+  free(columns->title);
+  free(columns->title_pool);
+  for (int i = 0; i < columns->num_types; i++) {
+    free(columns->type_names[i]);
+  }
+  for (int i = 0; i < columns->num_genres; i++) {
+    free(columns->genre_names[i]);
+  }
+  free(columns);
+}
+
+// Makes room for at least rows rows.
+// Returns 0 if successful, -1 if out of memory.
+static int GrowRows(ColumnStore columns, int rows) {
+  if (rows <= columns->capacity) {
+    return 0;
+  }
+  int capacity = columns->capacity == 0 ? INITIAL_ROWS : columns->capacity;
+  while (capacity < rows) {
+    capacity *= 2;
+  }
+
+  void *year = realloc(columns->year, capacity * sizeof(int16_t));
+  if (year != NULL) {
+    columns->year = (int16_t*)year;
+  }
+  void *runtime = realloc(columns->runtime, capacity * sizeof(int16_t));
+  if (runtime != NULL) {
+    columns->runtime = (int16_t*)runtime;
+  }
+  void *type = realloc(columns->type, capacity * sizeof(uint8_t));
+  if (type != NULL) {
+    columns->type = (uint8_t*)type;
+  }
+  void *genres = realloc(columns->genres, capacity * sizeof(uint32_t));
+  if (genres != NULL) {
+    columns->genres = (uint32_t*)genres;
+  }
+  void *title = realloc(columns->title, capacity * sizeof(uint32_t));
+  if (title != NULL) {
+    columns->title = (uint32_t*)title;
+  }
+  int old_words = columns->capacity / 64;
+  void *adult = realloc(columns->adult, capacity / 64 * sizeof(uint64_t));
+  if (adult != NULL) {
+    columns->adult = (uint64_t*)adult;
+    memset(columns->adult + old_words, 0,
+           (capacity / 64 - old_words) * sizeof(uint64_t));
+  }
+  if (year == NULL || runtime == NULL || type == NULL || genres == NULL ||
+      title == NULL || adult == NULL) {
+    printf("Couldn't grow the ColumnStore to %d rows\n", capacity);
+    return -1;
+  }
+  columns->capacity = capacity;
+  return 0;
+}
+
+// Makes room in the title pool for at least size bytes.
+// Returns 0 if successful, -1 if out of memory.
+static int GrowPool(ColumnStore columns, uint32_t size) {
+  if (size <= columns->pool_capacity) {
+    return 0;
+  }
+  uint32_t capacity = columns->pool_capacity;
+  while (capacity < size) {
+    capacity *= 2;
+  }
+  char *pool = (char*)realloc(columns->title_pool, capacity);
+  if (pool == NULL) {
+    printf("Couldn't grow the ColumnStore title pool\n");
+    return -1;
+  }
+  columns->title_pool = pool;
+  columns->pool_capacity = capacity;
+  return 0;
+}
+
+// Copies title into the pool.
+// Returns its offset, or 0 if out of memory.
+static uint32_t AddTitle(ColumnStore columns, FieldView title) {
+  uint32_t len = title.length + 1;
+  if (GrowPool(columns, columns->pool_size + len) != 0) {
+    return 0;
+  }
+  uint32_t offset = columns->pool_size;
+  memcpy(columns->title_pool + offset, title.data, title.length);
+  columns->title_pool[offset + title.length] = '\0';
+  columns->pool_size += len;
+  return offset;
+}
+
+// Returns the index of name in names, adding it if there is room,
+// or -1 if it isn't there and there is no room.
+static int FindOrAddName(char **names, int *num_names, int max,
+                         FieldView name) {
+  for (int i = 0; i < *num_names; i++) {
+    if (strncasecmp(names[i], name.data, name.length) == 0 &&
+        names[i][name.length] == '\0') {
+      return i;
+    }
+  }
+  if (*num_names == max) {
+    return -1;
+  }
+  names[*num_names] = strndup(name.data, name.length);
+  if (names[*num_names] == NULL) {
+    return -1;
+  }
+  return (*num_names)++;
+}
+
+static FieldView ViewOfName(const char *name) {
+  FieldView view = { name, strlen(name) };
+  return view;
+}
+
+static int16_t ToInt16(int value) {
+  if (value < 0) {
+    return -1;
+  }
+  return value > INT16_MAX ? INT16_MAX : value;
+}
+
+// Widens min_year and max_year to take in year.
+static void AddYearToRange(ColumnStore columns, int16_t year) {
+  if (year < 0) {
+    return;
+  }
+  if (year < columns->min_year) {
+    columns->min_year = year;
+  }
+  if (year > columns->max_year) {
+    columns->max_year = year;
+  }
+}
+
+int AddRowViewToColumns(ColumnStore columns, RowView *row) {
+  if (GrowRows(columns, columns->num_rows + 1) != 0) {
+    return -1;
+  }
+  int index = columns->num_rows;
+  columns->year[index] = -1;
+  columns->runtime[index] = -1;
+  columns->type[index] = NO_TYPE;
+  columns->genres[index] = 0;
+  columns->title[index] = 0;
+  columns->num_rows++;
+  if (row == NULL) {
+    return 0;
+  }
+
+  columns->year[index] = ToInt16(row->year);
+  AddYearToRange(columns, columns->year[index]);
+  columns->runtime[index] = ToInt16(row->runtime);
+  if (row->isAdult == 1) {
+    columns->adult[index / 64] |= 1ULL << (index % 64);
+  }
+  if (row->type.data != NULL) {
+    int code = FindOrAddName(columns->type_names, &columns->num_types,
+                             MAX_TYPE_CODES, row->type);
+    columns->type[index] = code < 0 ? NO_TYPE : code;
+  }
+  for (int i = 0; i < row->num_genres; i++) {
+    if (row->genres[i].length == 0 || row->genres[i].data[0] == '-') {
+      continue;
+    }
+    int code = FindOrAddName(columns->genre_names, &columns->num_genres,
+                             MAX_GENRE_CODES, row->genres[i]);
+    if (code >= 0) {
+      columns->genres[index] |= 1u << code;
+    }
+  }
+  if (row->title.data != NULL) {
+    columns->title[index] = AddTitle(columns, row->title);
+    if (columns->title[index] == 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int AddMovieToColumns(ColumnStore columns, Movie *movie) {
+  RowView view;
+  if (movie == NULL) {
+    return AddRowViewToColumns(columns, NULL);
+  }
+  RowViewOfMovie(movie, &view);
+  return AddRowViewToColumns(columns, &view);
+}
+
+int AppendColumns(ColumnStore dest, ColumnStore src) {
+  int type_codes[MAX_TYPE_CODES + 1];
+  int genre_codes[MAX_GENRE_CODES];
+
+  for (int i = 0; i < src->num_types; i++) {
+    type_codes[i] = FindOrAddName(dest->type_names, &dest->num_types,
+                                  MAX_TYPE_CODES,
+                                  ViewOfName(src->type_names[i]));
+    if (type_codes[i] < 0) {
+      type_codes[i] = NO_TYPE;
+    }
+  }
+  type_codes[NO_TYPE] = NO_TYPE;
+  for (int i = 0; i < src->num_genres; i++) {
+    genre_codes[i] = FindOrAddName(dest->genre_names, &dest->num_genres,
+                                   MAX_GENRE_CODES,
+                                   ViewOfName(src->genre_names[i]));
+  }
+
+  if (GrowRows(dest, dest->num_rows + src->num_rows) != 0) {
+    return -1;
+  }
+  AddYearToRange(dest, src->min_year);
+  AddYearToRange(dest, src->max_year);
+  // src's pool goes after dest's, so every title moves by the same
+  // amount. Both start with the empty title, which isn't copied.
+  uint32_t pool_base = dest->pool_size - 1;
+  if (GrowPool(dest, dest->pool_size + src->pool_size - 1) != 0) {
+    return -1;
+  }
+  memcpy(dest->title_pool + dest->pool_size, src->title_pool + 1,
+         src->pool_size - 1);
+  dest->pool_size += src->pool_size - 1;
+
+  for (int i = 0; i < src->num_rows; i++) {
+    int row = dest->num_rows + i;
+    dest->year[row] = src->year[i];
+    dest->runtime[row] = src->runtime[i];
+    dest->type[row] = type_codes[src->type[i]];
+    uint32_t genres = 0;
+    for (int g = 0; g < src->num_genres; g++) {
+      if ((src->genres[i] >> g & 1) && genre_codes[g] >= 0) {
+        genres |= 1u << genre_codes[g];
+      }
+    }
+    dest->genres[row] = genres;
+    dest->title[row] = src->title[i] == 0 ? 0 : pool_base + src->title[i];
+    if (IsAdultRow(src, i)) {
+      dest->adult[row / 64] |= 1ULL << (row % 64);
+    }
+  }
+  dest->num_rows += src->num_rows;
+  return 0;
+}
+
+int GetTypeCode(ColumnStore columns, const char *type) {
+  for (int i = 0; i < columns->num_types; i++) {
+    if (strcasecmp(columns->type_names[i], type) == 0) {
+      return i;
+    }
+  }
+  return NO_TYPE;
+}
+
+int GetGenreCode(ColumnStore columns, const char *genre) {
+  for (int i = 0; i < columns->num_genres; i++) {
+    if (strcasecmp(columns->genre_names[i], genre) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int IsAdultRow(ColumnStore columns, int row) {
+  return (columns->adult[row / 64] >> (row % 64)) & 1;
+}
+
+const char *GetRowTitle(ColumnStore columns, int row) {
+  return columns->title_pool + columns->title[row];
+}
@@ -0,0 +1,112 @@
+#ifndef COLUMNSTORE_H
+#define COLUMNSTORE_H
+
+#include <stdint.h>
+
+#include "Movie.h"
+#include "RowParser.h"
+
+// Most different types and genres a ColumnStore can give codes to.
+#define MAX_TYPE_CODES 255
+#define MAX_GENRE_CODES 32
+
+// The type code of a movie without a type.
+#define NO_TYPE 255
+
+/**
+ * A ColumnStore keeps the fields of every movie in dense arrays, one per
+ * field, indexed by the movie's global row: the row of its file plus the
+ * first_row of the file's RowTable. Scanning a field for every movie
+ * reads one contiguous array instead of chasing a pointer per Movie or
+ * parsing rows again.
+ *
+ * year and runtime are -1 if the movie doesn't have one. Bit i of
+ * adult[i / 64] is set if movie i is adult. type is a code into
+ * type_names, or NO_TYPE. Bit g of genres is set if the movie has
+ * genre_names[g]. title is the offset of the movie's NUL terminated
+ * title in title_pool, or 0 (an empty string) if it has none.
+ *
+ * min_year and max_year are the smallest and largest year of any movie,
+ * so a count per year only needs that many counters. max_year is -1 if
+ * no movie has a year.
+ */
+typedef struct columnStore {
+  int num_rows;
+  int capacity;
+  int16_t *year;
+  int16_t min_year;
+  int16_t max_year;
+  int16_t *runtime;
+  uint64_t *adult;
+  uint8_t *type;
+  uint32_t *genres;
+  uint32_t *title;
+
+  char *title_pool;
+  uint32_t pool_size;
+  uint32_t pool_capacity;
+
+  char *type_names[MAX_TYPE_CODES];
+  int num_types;
+  char *genre_names[MAX_GENRE_CODES];
+  int num_genres;
+} *ColumnStore;
+
+/**
+ * Creates an empty ColumnStore.
+ *
+ * RETURNS: The ColumnStore, or NULL if out of memory.
+ */
+ColumnStore CreateColumnStore();
+
+void DestroyColumnStore(ColumnStore columns);
+
+/**
+ * Adds a movie as the next row. movie may be NULL for a row that
+ * couldn't be parsed, which gets no fields, so the rows still line up
+ * with the file. Types past MAX_TYPE_CODES are left out as NO_TYPE and
+ * genres past MAX_GENRE_CODES are left out.
+ *
+ * RETURNS: 0 if successful, -1 if out of memory.
+ */
+int AddMovieToColumns(ColumnStore columns, Movie *movie);
+
+/**
+ * Does what AddMovieToColumns does for a row split with SplitRow, or
+ * NULL for a row that couldn't be.
+ */
+int AddRowViewToColumns(ColumnStore columns, RowView *row);
+
+/**
+ * Adds every row of src to the end of dest, changing src's type and
+ * genre codes to dest's. Files are parsed into their own ColumnStore and
+ * appended to the Index's when they are done, so parsing files at the
+ * same time doesn't mix up their rows.
+ *
+ * RETURNS: 0 if successful, -1 if out of memory.
+ */
+int AppendColumns(ColumnStore dest, ColumnStore src);
+
+/**
+ * RETURNS: The code of a type, or NO_TYPE if no movie has it.
+ *   Case doesn't matter.
+ */
+int GetTypeCode(ColumnStore columns, const char *type);
+
+/**
+ * RETURNS: The code of a genre, or -1 if no movie has it.
+ *   Case doesn't matter.
+ */
+int GetGenreCode(ColumnStore columns, const char *genre);
+
+/**
+ * RETURNS: 1 if the movie in the row is adult, 0 otherwise.
+ */
+int IsAdultRow(ColumnStore columns, int row);
+
+/**
+ * RETURNS: The title of the movie in the row.
+ */
+const char *GetRowTitle(ColumnStore columns, int row);
+
+#endif
@@ -1,5 +1,9 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "DocIdMap.h"
 #include "htll/Hashtable.h"
 
@@ -38,6 +42,80 @@ void DestroyDocIdIterator(DocIdIter iter) {
   DestroyHashtableIterator(iter);
 }
 
+// Maps one file; an empty file gets a NULL mapping.
+static int MapDocFile(char *file, int flags, DocMapping *map) {
+  map->data = NULL;
+  map->size = 0;
+
+  int fd = open(file, O_RDONLY);
+  if (fd == -1) {
+    printf("File could not be opened\n");
+    return -1;
+  }
+  struct stat info;
+  if (fstat(fd, &info) == -1) {
+    close(fd);
+    return -1;
+  }
+  if (info.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+
+  int mmap_flags = MAP_SHARED;
+  if (flags & DOC_MAP_POPULATE) {
+    mmap_flags |= MAP_POPULATE;
+  }
+  void *data = mmap(NULL, info.st_size, PROT_READ, mmap_flags, fd, 0);
+  // The mapping keeps the file; the descriptor isn't needed anymore.
+  close(fd);
+  if (data == MAP_FAILED) {
+    perror("mmap");
+    return -1;
+  }
+  madvise(data, info.st_size,
+          (flags & DOC_MAP_WILLNEED) ? MADV_WILLNEED : MADV_RANDOM);
+  map->data = (char*)data;
+  map->size = info.st_size;
+  return 0;
+}
+
+DocMapping *MapDocFiles(DocIdMap docs, int flags) {
+  int num_docs = NumElemsInHashtable(docs);
+  DocMapping *maps = (DocMapping*)malloc((num_docs + 1) * sizeof(DocMapping));
+  if (maps == NULL) {
+    printf("Couldn't malloc doc mappings\n");
+    return NULL;
+  }
+  maps[0].data = NULL;
+  maps[0].size = 0;
+  for (int i = 1; i <= num_docs; i++) {
+    if (MapDocFile(GetFileFromId(docs, i), flags, &maps[i]) != 0) {
+      for (int j = 1; j < i; j++) {
+        if (maps[j].data != NULL) {
+          munmap(maps[j].data, maps[j].size);
+        }
+      }
+      free(maps);
+      return NULL;
+    }
+  }
+  return maps;
+}
+
+void UnmapDocFiles(DocIdMap docs, DocMapping *maps) {
+  if (maps == NULL) {
+    return;
+  }
+  int num_docs = NumElemsInHashtable(docs);
+  for (int i = 1; i <= num_docs; i++) {
+    if (maps[i].data != NULL) {
+      munmap(maps[i].data, maps[i].size);
+    }
+  }
+  free(maps);
+}
+
 char *GetFileFromId(DocIdMap docs, int docId) {
   HTKeyValue kvp;
   int result = LookupInHashtable(docs, docId, &kvp);
@@ -87,5 +87,35 @@ void DestroyDocIdIterator(DocIdIter iter);
 // filename.
 char *GetFileFromId(DocIdMap docs, int docId);
 
+/**
+ * A file from the DocIdMap mapped read-only into memory.
+ */
+typedef struct docMapping {
+  char *data;
+  size_t size;
+} DocMapping;
+
+// Flags for MapDocFiles.
+#define DOC_MAP_POPULATE 1  // Fault every page in up front (MAP_POPULATE).
+#define DOC_MAP_WILLNEED 2  // Ask the kernel to read ahead (MADV_WILLNEED).
+
+/**
+ * Maps every file in the DocIdMap into memory, so rows can be used
+ * where they are instead of being read for every query. The mappings are
+ * read-only and shared, so threads and forked processes all use the
+ * same page cache pages. Without DOC_MAP_WILLNEED the kernel is told
+ * that rows are read in random order.
+ *
+ * \param docs the DocIdMap with the files to map.
+ * \param flags any of the DOC_MAP_ flags.
+ *
+ * \return an array of mappings indexed by docId (entry 0 is not used),
+ *   or NULL if a file couldn't be mapped. Free with UnmapDocFiles.
+ */
+DocMapping *MapDocFiles(DocIdMap docs, int flags);
+
+// Unmaps and frees the mappings from MapDocFiles.
+void UnmapDocFiles(DocIdMap docs, DocMapping *maps);
+
 
 #endif
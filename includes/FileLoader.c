@@ -0,0 +1,661 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "FileLoader.h"
+#include "ColumnStore.h"
+#include "Movie.h"
+#include "RowParser.h"
+#include "htll/RingQueue.h"
+
+// Rows of one file that travel through the pipeline together. The
+// reader fills in data and ends, a parser splits the rows into views of
+// data and adds them to columns, and an indexer indexes the views and
+// fills in title_terms.
+typedef struct loadBlock {
+  uint64_t doc_id;
+  int range;  // Which range of the loader it is from.
+  int first_row;  // Row of its range that is the block's first row.
+  int num_rows;
+  off_t offset;  // Where data starts in the file.
+  char *data;
+  int *ends;  // Where each row ends in data.
+  RowView *views;
+  unsigned char *is_movie;  // 0 for the rows SplitRow couldn't split.
+  ColumnStore columns;  // The block's rows, if index has a ColumnStore.
+  unsigned char *title_terms;
+  struct loadBlock *next;  // In its indexer's list of finished blocks.
+} *LoadBlock;
+
+// A run of whole rows of one file, read by one reader. Ranges start
+// right after a newline (or at the start of the file) and end at the
+// first newline at or after end - 1, so where rows longer than
+// MAX_ROW_LENGTH are split doesn't depend on the ranges before. The
+// ranges of a file are next to each other, in order. Until every range
+// has been read, a row is indexed as (range << SHARD_RUN_BITS) + its
+// row in the range, and MergeIndexShards renumbers it to its row
+// ordinal (see RowTable).
+typedef struct loadRange {
+  char *file;
+  uint64_t doc_id;
+  off_t start;
+  off_t end;
+  int last;  // 1 if it is the last range of its file.
+  int num_rows;  // Set by its reader once it has read them all.
+} LoadRange;
+
+typedef struct fileLoader {
+  Index index;
+  LoadRange *ranges;
+  int num_ranges;
+  int next_range;  // The next range no thread has taken yet.
+  RingQueue read_blocks;  // Readers to parsers.
+  RingQueue parsed_blocks;  // Parsers to indexers.
+} FileLoader;
+
+// One thread of a stage, and what it got done.
+typedef struct loadWorker {
+  pthread_t thread;
+  FileLoader *loader;
+  Index shard;  // Indexers only: where its blocks go.
+  LoadBlock done;  // Indexers only: its blocks, once indexed.
+  long blocks;
+  long rows;
+  long bytes;
+  double busy_seconds;  // Not counting waiting on the queues.
+} LoadWorker;
+
+static double SecondsBetween(struct timespec *start, struct timespec *end) {
+  return (end->tv_sec - start->tv_sec) +
+    (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void DestroyLoadBlock(LoadBlock block) {
+  if (block->columns != NULL) {
+    DestroyColumnStore(block->columns);
+  }
+  free(block->data);
+  free(block->ends);
+  free(block->views);
+  free(block->is_movie);
+  free(block->title_terms);
+  free(block);
+}
+
+static LoadBlock CreateLoadBlock(uint64_t doc_id, int range, int first_row,
+                                 off_t offset) {
+  LoadBlock block = (LoadBlock)calloc(1, sizeof(struct loadBlock));
+  if (block == NULL) {
+    return NULL;
+  }
+  block->doc_id = doc_id;
+  block->range = range;
+  block->first_row = first_row;
+  block->offset = offset;
+  block->data = (char*)malloc(LOAD_BLOCK_SIZE);
+  if (block->data == NULL) {
+    free(block);
+    return NULL;
+  }
+  return block;
+}
+
+// Finds where the rows in the first len bytes of block->data end. A
+// row that runs past len is left out unless the file ends there.
+// Returns how many bytes the rows take, or -1 if out of memory.
+static int FindRowEnds(LoadBlock block, int len, int at_eof) {
+  RowScanner scanner;
+  FieldView row;
+  int capacity = 0;
+
+  InitRowScanner(&scanner, block->data, len, at_eof);
+  while (ScanNextRow(&scanner, &row) == 0) {
+    if (block->num_rows == capacity) {
+      capacity = capacity == 0 ? 1024 : 2 * capacity;
+      int *bigger = (int*)realloc(block->ends, capacity * sizeof(int));
+      if (bigger == NULL) {
+        return -1;
+      }
+      block->ends = bigger;
+    }
+    block->ends[block->num_rows++] = scanner.pos;
+  }
+  return scanner.pos;
+}
+
+// Splits the files in docs into ranges of about LOAD_RANGE_SIZE bytes.
+// Only where the ranges would start and end is set; their readers move
+// that to the start of a row.
+// Returns the ranges, or NULL if out of memory.
+static LoadRange *SplitTheFiles(DocIdMap docs, int *num_ranges) {
+  int capacity = NumElemsInHashtable(docs) + 1;
+  LoadRange *ranges = (LoadRange*)malloc(capacity * sizeof(LoadRange));
+  HTKeyValue kv;
+
+  *num_ranges = 0;
+  if (ranges == NULL || NumElemsInHashtable(docs) == 0) {
+    // There is no iterator over an empty DocIdMap, and no ranges in it.
+    return ranges;
+  }
+  HTIter iter = CreateHashtableIterator(docs);
+  if (iter == NULL) {
+    free(ranges);
+    return NULL;
+  }
+  do {
+    HTIteratorGet(iter, &kv);
+    struct stat info;
+    off_t size = 0;
+    if (stat((char*)kv.value, &info) == 0) {
+      size = info.st_size;
+    }
+    int file_ranges = size > 0 ? 1 + (size - 1) / LOAD_RANGE_SIZE : 1;
+    if (*num_ranges + file_ranges > capacity) {
+      capacity = 2 * (*num_ranges + file_ranges);
+      LoadRange *bigger =
+        (LoadRange*)realloc(ranges, capacity * sizeof(LoadRange));
+      if (bigger == NULL) {
+        free(ranges);
+        DestroyHashtableIterator(iter);
+        return NULL;
+      }
+      ranges = bigger;
+    }
+    for (int i = 0; i < file_ranges; i++) {
+      LoadRange *range = &ranges[(*num_ranges)++];
+      range->file = (char*)kv.value;
+      range->doc_id = kv.key;
+      range->start = (off_t)i * LOAD_RANGE_SIZE;
+      range->end = i + 1 < file_ranges ? (off_t)(i + 1) * LOAD_RANGE_SIZE
+                                       : size;
+      range->last = i + 1 == file_ranges;
+      range->num_rows = 0;
+    }
+  } while (HTIteratorNext(iter) == 0);
+  DestroyHashtableIterator(iter);
+  return ranges;
+}
+
+// Returns where the first row that starts at or after offset starts,
+// just past the next newline, or -1 if the file has no newline after
+// offset.
+static off_t FindRowStart(int fd, off_t offset) {
+  char buf[MAX_ROW_LENGTH + 1];
+
+  if (offset == 0) {
+    return 0;
+  }
+  // The byte before offset might be the newline.
+  off_t pos = offset - 1;
+  while (1) {
+    ssize_t got = pread(fd, buf, sizeof(buf), pos);
+    if (got <= 0) {
+      return -1;
+    }
+    const char *newline = (const char*)memchr(buf, '\n', got);
+    if (newline != NULL) {
+      return pos + (newline - buf) + 1;
+    }
+    pos += got;
+  }
+}
+
+// Drops the rows of block after the first one that ends the range: the
+// first one that ends with a newline at or after range->end - 1.
+// Returns how many bytes the rows left take, or -1 if none ends it.
+static int EndRangeInBlock(LoadRange *range, LoadBlock block) {
+  for (int i = 0; i < block->num_rows; i++) {
+    int row_end = block->ends[i];
+    if (block->offset + row_end >= range->end &&
+        block->data[row_end - 1] == '\n') {
+      block->num_rows = i + 1;
+      return row_end;
+    }
+  }
+  return -1;
+}
+
+// Reads range number r into blocks, counting its rows as it goes, and
+// pushes them to the parsers. The first range of every file that can
+// be opened gets at least one block, so the file gets a RowTable even
+// if it is empty.
+static void ReadRangeBlocks(LoadWorker *worker, int r) {
+  LoadRange *range = &worker->loader->ranges[r];
+  char carry[MAX_ROW_LENGTH];
+  int carried = 0;
+  int row = 0;
+  int pushed = range->start > 0;
+  int done = 0;
+
+  int fd = open(range->file, O_RDONLY);
+  if (fd == -1) {
+    printf("File could not be opened\n");
+    return;
+  }
+  off_t offset = FindRowStart(fd, range->start);
+  if (offset == -1 || (!range->last && offset >= range->end)) {
+    // Its rows all started in the range before. A first range starts at
+    // 0, so it always has a row, or is the last range of its file.
+    done = 1;
+  }
+  // Past range->end, only enough is read to find the row that ends the
+  // range, unless that row turns out to be longer.
+  off_t reach = range->end + MAX_ROW_LENGTH;
+  while (!done) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    LoadBlock block = CreateLoadBlock(range->doc_id, r, row, offset);
+    if (block == NULL) {
+      printf("Couldn't malloc to read %s\n", range->file);
+      break;
+    }
+    memcpy(block->data, carry, carried);
+    int len = carried;
+    int at_eof = 0;
+    while (len < LOAD_BLOCK_SIZE && !done) {
+      size_t want = LOAD_BLOCK_SIZE - len;
+      off_t pos = offset + len;
+      if (!range->last) {
+        if (pos >= reach) {
+          reach = pos + LOAD_BLOCK_SIZE;
+          break;
+        }
+        if ((off_t)want > reach - pos) {
+          want = reach - pos;
+        }
+      }
+      ssize_t got = pread(fd, block->data + len, want, pos);
+      if (got <= 0) {
+        at_eof = 1;
+        done = 1;
+        break;
+      }
+      len += got;
+    }
+    int used = FindRowEnds(block, len, at_eof);
+    if (used < 0) {
+      printf("Couldn't malloc to read %s\n", range->file);
+      DestroyLoadBlock(block);
+      break;
+    }
+    if (!range->last && offset + used >= range->end) {
+      int ended = EndRangeInBlock(range, block);
+      if (ended >= 0) {
+        used = ended;
+        done = 1;
+      }
+    }
+    // What is left after the row that ended the range isn't its.
+    carried = done ? 0 : len - used;
+    memcpy(carry, block->data + used, carried);
+    row += block->num_rows;
+    offset += used;
+
+    worker->bytes += used;
+    worker->rows += block->num_rows;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    worker->busy_seconds += SecondsBetween(&start, &end);
+    if (block->num_rows > 0 || !pushed) {
+      worker->blocks++;
+      PushRingQueue(worker->loader->read_blocks, block);
+      pushed = 1;
+    } else {
+      DestroyLoadBlock(block);
+    }
+  }
+  range->num_rows = row;
+  close(fd);
+}
+
+// Takes ranges no other reader has taken and reads them until there are
+// none left.
+static void *ReadBlocks(void *arg) {
+  LoadWorker *worker = (LoadWorker*)arg;
+  FileLoader *loader = worker->loader;
+
+  while (1) {
+    int i = __atomic_fetch_add(&loader->next_range, 1, __ATOMIC_RELAXED);
+    if (i >= loader->num_ranges) {
+      break;
+    }
+    ReadRangeBlocks(worker, i);
+  }
+  RingQueueProducerDone(loader->read_blocks);
+  return NULL;
+}
+
+static void *ParseBlocks(void *arg) {
+  LoadWorker *worker = (LoadWorker*)arg;
+  FileLoader *loader = worker->loader;
+  LoadBlock block;
+
+  while (PopRingQueue(loader->read_blocks, (void**)&block) == 0) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    block->views = (RowView*)malloc((block->num_rows + 1) * sizeof(RowView));
+    block->is_movie = (unsigned char*)calloc(block->num_rows + 1, 1);
+    if (loader->index->columns != NULL) {
+      block->columns = CreateColumnStore();
+    }
+    int row_start = 0;
+    for (int i = 0; i < block->num_rows && block->views != NULL &&
+                    block->is_movie != NULL; i++) {
+      FieldView row = { block->data + row_start, block->ends[i] - row_start };
+      row_start = block->ends[i];
+      block->is_movie[i] = SplitRow(row, &block->views[i]) == 0;
+      if (block->columns != NULL) {
+        AddRowViewToColumns(block->columns,
+                            block->is_movie[i] ? &block->views[i] : NULL);
+      }
+    }
+
+    worker->blocks++;
+    worker->rows += block->num_rows;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    worker->busy_seconds += SecondsBetween(&start, &end);
+    PushRingQueue(loader->parsed_blocks, block);
+  }
+  RingQueueProducerDone(loader->parsed_blocks);
+  return NULL;
+}
+
+static void *IndexBlocks(void *arg) {
+  LoadWorker *worker = (LoadWorker*)arg;
+  LoadBlock block;
+
+  while (PopRingQueue(worker->loader->parsed_blocks, (void**)&block) == 0) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    block->title_terms = (unsigned char*)calloc(block->num_rows + 1, 1);
+    for (int i = 0; i < block->num_rows && block->is_movie != NULL &&
+                    block->title_terms != NULL; i++) {
+      if (!block->is_movie[i]) {
+        continue;
+      }
+      uint64_t row = ((uint64_t)block->range << SHARD_RUN_BITS) +
+                     block->first_row + i;
+      int result = AddRowViewToIndex(worker->shard, &block->views[i], row);
+      if (result < 0) {
+        fprintf(stderr, "Didn't add MovieToIndex.\n");
+      } else {
+        block->title_terms[i] = result > 255 ? 255 : result;
+      }
+    }
+    // The views point into data, so they go with it.
+    free(block->views);
+    free(block->is_movie);
+    free(block->data);
+    block->views = NULL;
+    block->is_movie = NULL;
+    block->data = NULL;
+    block->next = worker->done;
+    worker->done = block;
+
+    worker->blocks++;
+    worker->rows += block->num_rows;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    worker->busy_seconds += SecondsBetween(&start, &end);
+  }
+  return NULL;
+}
+
+// Sorts blocks by row ordinal. An empty file has one empty block with
+// the ordinal of the file after it, so it goes first.
+static int CompareBlocks(const void *a, const void *b) {
+  LoadBlock x = *(LoadBlock*)a;
+  LoadBlock y = *(LoadBlock*)b;
+  if (x->first_row != y->first_row) {
+    return x->first_row - y->first_row;
+  }
+  if (x->num_rows != y->num_rows) {
+    return x->num_rows - y->num_rows;
+  }
+  return x->doc_id < y->doc_id ? -1 : x->doc_id > y->doc_id;
+}
+
+// Builds the RowTables of the files from their indexed blocks, and puts
+// the blocks' columns in index's ColumnStore in row order. Frees the
+// blocks.
+// Returns 0 if successful, -1 if out of memory.
+static int PutBlockRows(Index index, const uint64_t *range_rows,
+                        LoadWorker *indexers, int num_indexers) {
+  int num_blocks = 0;
+  int result = 0;
+
+  for (int i = 0; i < num_indexers; i++) {
+    num_blocks += indexers[i].blocks;
+  }
+  LoadBlock *blocks = (LoadBlock*)malloc((num_blocks + 1) * sizeof(LoadBlock));
+  if (blocks == NULL) {
+    return -1;
+  }
+  int n = 0;
+  for (int i = 0; i < num_indexers; i++) {
+    for (LoadBlock block = indexers[i].done; block != NULL;
+         block = block->next) {
+      // Now the rows are counted, the block's rows get their ordinals.
+      block->first_row += range_rows[block->range];
+      blocks[n++] = block;
+    }
+  }
+  qsort(blocks, n, sizeof(LoadBlock), CompareBlocks);
+
+  int i = 0;
+  while (i < n) {
+    uint64_t doc_id = blocks[i]->doc_id;
+    RowTable rows = CreateRowTable();
+    if (rows != NULL) {
+      rows->first_row = blocks[i]->first_row;
+    }
+    for (; i < n && blocks[i]->doc_id == doc_id; i++) {
+      LoadBlock block = blocks[i];
+      for (int j = 0; j < block->num_rows && rows != NULL; j++) {
+        int terms = block->title_terms != NULL ? block->title_terms[j] : 0;
+        if (AddRowToTable(rows, block->offset + block->ends[j], terms) != 0) {
+          DestroyRowTable(rows);
+          rows = NULL;
+        }
+      }
+      if (block->columns != NULL &&
+          AppendColumns(index->columns, block->columns) != 0) {
+        result = -1;
+      }
+      DestroyLoadBlock(block);
+    }
+    if (rows == NULL || PutRowTable(index, doc_id, rows, NULL) != 0) {
+      result = -1;
+    }
+  }
+  free(blocks);
+  return result;
+}
+
+// Prints what the threads of a stage got done and how often they
+// waited: for input on the queue before them, and for room on the queue
+// after them.
+static void PrintStage(const char *name, LoadWorker *workers, int num_workers,
+                       RingQueue input, RingQueue output) {
+  long blocks = 0;
+  long rows = 0;
+  double busy_seconds = 0;
+
+  for (int i = 0; i < num_workers; i++) {
+    blocks += workers[i].blocks;
+    rows += workers[i].rows;
+    busy_seconds += workers[i].busy_seconds;
+  }
+  printf("%-8s %2d threads %6ld blocks %9ld rows %9.3f s busy; "
+         "waited %ld times for blocks, %ld for room\n", name, num_workers,
+         blocks, rows, busy_seconds, input != NULL ? input->empty_waits : 0,
+         output != NULL ? output->full_waits : 0);
+}
+
+// Starts a thread of run for each worker. Returns how many started.
+static int StartStage(LoadWorker *workers, int num_workers,
+                      void *(*run)(void *)) {
+  int started = 0;
+  while (started < num_workers &&
+         pthread_create(&workers[started].thread, NULL, run,
+                        &workers[started]) == 0) {
+    started++;
+  }
+  return started;
+}
+
+// Returns n, but at least 1 and at most most.
+static int ClampThreads(int n, int most) {
+  if (n > most) {
+    n = most;
+  }
+  return n < 1 ? 1 : n;
+}
+
+int LoadTheFiles(DocIdMap docs, Index index) {
+  LoadWorker readers[MAX_LOAD_THREADS];
+  LoadWorker parsers[MAX_LOAD_THREADS];
+  LoadWorker indexers[MAX_LOAD_THREADS];
+  Index shards[MAX_LOAD_THREADS];
+  FileLoader loader;
+  struct timespec start, loaded, merged, end;
+  int result = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  memset(&loader, 0, sizeof(loader));
+  memset(readers, 0, sizeof(readers));
+  memset(parsers, 0, sizeof(parsers));
+  memset(indexers, 0, sizeof(indexers));
+  loader.index = index;
+
+  loader.ranges = SplitTheFiles(docs, &loader.num_ranges);
+  if (loader.ranges == NULL) {
+    printf("Couldn't malloc to load the files\n");
+    return -1;
+  }
+
+  // Half the cores parse and half index. Readers mostly wait on the
+  // disk, so a few of them are enough to keep it busy, and there is no
+  // use for more of them than ranges.
+  int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+  int num_parsers = ClampThreads(num_cores / 2, MAX_LOAD_THREADS);
+  int num_indexers = ClampThreads(num_cores - num_parsers, MAX_LOAD_THREADS);
+  int num_readers = ClampThreads(num_cores / 4, MAX_LOAD_THREADS);
+  if (num_readers > loader.num_ranges && loader.num_ranges > 0) {
+    num_readers = loader.num_ranges;
+  }
+
+  loader.read_blocks = CreateRingQueue(2 * num_parsers, num_readers);
+  loader.parsed_blocks = CreateRingQueue(2 * num_indexers, num_parsers);
+  uint64_t *range_rows =
+    (uint64_t*)malloc((loader.num_ranges + 1) * sizeof(uint64_t));
+  int num_shards = 0;
+  while (num_shards < num_indexers) {
+    shards[num_shards] = CreateIndex();
+    if (shards[num_shards] == NULL) {
+      break;
+    }
+    num_shards++;
+  }
+  if (loader.read_blocks == NULL || loader.parsed_blocks == NULL ||
+      range_rows == NULL || num_shards < num_indexers) {
+    printf("Couldn't malloc to load the files\n");
+    for (int i = 0; i < num_shards; i++) {
+      DestroyOffsetIndex(shards[i]);
+    }
+    if (loader.read_blocks != NULL) {
+      DestroyRingQueue(loader.read_blocks);
+    }
+    if (loader.parsed_blocks != NULL) {
+      DestroyRingQueue(loader.parsed_blocks);
+    }
+    free(range_rows);
+    free(loader.ranges);
+    return -1;
+  }
+
+  for (int i = 0; i < num_readers; i++) {
+    readers[i].loader = &loader;
+  }
+  for (int i = 0; i < num_parsers; i++) {
+    parsers[i].loader = &loader;
+  }
+  for (int i = 0; i < num_indexers; i++) {
+    indexers[i].loader = &loader;
+    indexers[i].shard = shards[i];
+  }
+
+  // Every stage needs a thread, or the queues would fill up with no one
+  // to empty them.
+  int parsing = StartStage(parsers, num_parsers, ParseBlocks);
+  int indexing = StartStage(indexers, num_indexers, IndexBlocks);
+  if (parsing == 0 || indexing == 0) {
+    printf("Couldn't start the threads to load the files\n");
+    exit(EXIT_FAILURE);
+  }
+  // This thread is the first reader.
+  int reading = 1 + StartStage(readers + 1, num_readers - 1, ReadBlocks);
+  // The stages that didn't get all their threads have fewer producers.
+  for (int i = reading; i < num_readers; i++) {
+    RingQueueProducerDone(loader.read_blocks);
+  }
+  for (int i = parsing; i < num_parsers; i++) {
+    RingQueueProducerDone(loader.parsed_blocks);
+  }
+  num_readers = reading;
+  num_parsers = parsing;
+  num_indexers = indexing;
+  ReadBlocks(&readers[0]);
+  for (int i = 1; i < num_readers; i++) {
+    pthread_join(readers[i].thread, NULL);
+  }
+  for (int i = 0; i < num_parsers; i++) {
+    pthread_join(parsers[i].thread, NULL);
+  }
+  for (int i = 0; i < num_indexers; i++) {
+    pthread_join(indexers[i].thread, NULL);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &loaded);
+
+  // Every range has been read, so the row ordinal each starts at is
+  // known now.
+  uint64_t row = index->num_rows;
+  for (int i = 0; i < loader.num_ranges; i++) {
+    range_rows[i] = row;
+    row += loader.ranges[i].num_rows;
+  }
+  result |= PutBlockRows(index, range_rows, indexers, num_indexers);
+  result |= MergeIndexShards(index, shards, num_shards, num_indexers,
+                             range_rows);
+  clock_gettime(CLOCK_MONOTONIC, &merged);
+  SortIndexTerms(index);
+  BuildTermFilter(index);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  long bytes = 0;
+  for (int i = 0; i < num_readers; i++) {
+    bytes += readers[i].bytes;
+  }
+  PrintStage("read", readers, num_readers, NULL, loader.read_blocks);
+  PrintStage("parse", parsers, num_parsers, loader.read_blocks,
+             loader.parsed_blocks);
+  PrintStage("index", indexers, num_indexers, loader.parsed_blocks, NULL);
+  printf("Read %ld bytes in %d ranges. Took %f seconds to load the files, "
+         "%f to merge them and %f to sort the words.\n", bytes,
+         loader.num_ranges, SecondsBetween(&start, &loaded),
+         SecondsBetween(&loaded, &merged), SecondsBetween(&merged, &end));
+
+  free(range_rows);
+  free(loader.ranges);
+  DestroyRingQueue(loader.read_blocks);
+  DestroyRingQueue(loader.parsed_blocks);
+  return result;
+}
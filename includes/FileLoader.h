@@ -0,0 +1,50 @@
+#ifndef FILELOADER_H
+#define FILELOADER_H
+
+#include "MovieIndex.h"
+#include "DocIdMap.h"
+
+// How many bytes of a file a reader reads at once.
+#define LOAD_BLOCK_SIZE (1 << 20)
+
+// Files bigger than this are split into ranges that readers read at the
+// same time.
+#define LOAD_RANGE_SIZE (16 << 20)
+
+// Most parser threads, and most indexer threads, LoadTheFiles starts.
+#define MAX_LOAD_THREADS 32
+
+/**
+ * Does what ParseTheFiles does as a pipeline of three stages, each with
+ * threads of its own, so reading the files overlaps parsing and
+ * indexing them:
+ *
+ *   - Readers read the files in blocks of LOAD_BLOCK_SIZE bytes and find
+ *     where their rows end. Files are split into ranges of about
+ *     LOAD_RANGE_SIZE bytes of whole rows, and each reader takes the
+ *     next range no other reader has, so even one big file is read by
+ *     every reader.
+ *   - Parser threads split every row of a block into fields with
+ *     SplitRow, in place, without making a Movie of it.
+ *   - Indexer threads add the rows to an Index of their own, which are
+ *     merged into index at the end (see MergeIndexShards).
+ *
+ * Readers count the rows of a range as they read it, so a row is
+ * indexed by its range and its row in the range until every range has
+ * been read; the shards are then renumbered to row ordinals as they are
+ * merged. The row ids, row ordinals and RowTables come out the same as
+ * ParseTheFiles', so GetRowFromFile works the same.
+ *
+ * The stages are joined by RingQueues of blocks, so a fast stage waits
+ * for a slow one instead of filling memory. Prints how busy each stage
+ * was and how often it waited on the stage before or after it; the
+ * slowest stage is the one the others wait for.
+ *
+ * \param docs the DocIdMap that contains all the files we want to parse.
+ * \param the index to hold all the indexed docs.
+ *
+ * \return 0 if successful, -1 if out of memory.
+ */
+int LoadTheFiles(DocIdMap docs, Index index);
+
+#endif
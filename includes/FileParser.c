@@ -21,6 +21,8 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/time.h>
 #include <time.h>
 
@@ -31,7 +33,6 @@
 
 void IndexTheFile(char *file, uint64_t docId, Index index);
 
-
 // Returns a LinkedList of Movie structs from the specified file
 LinkedList ReadFile(const char* filename){
   FILE *cfPtr;
@@ -68,10 +69,10 @@ LinkedList ReadFile(const char* filename){
  *
  */
 int ParseTheFiles(DocIdMap docs, Index index) {
-  clock_t start2, end2;
-  double cpu_time_used;
+  struct timespec start, end;
 
-  start2 = clock();
+  // Wall time, so time spent waiting on the disk counts too.
+  clock_gettime(CLOCK_MONOTONIC, &start);
 
   HTIter iter = CreateHashtableIterator(docs);
 
@@ -91,11 +92,12 @@ int ParseTheFiles(DocIdMap docs, Index index) {
   IndexTheFile(kv.value, kv.key, index);
 
   DestroyHashtableIterator(iter);
+  SortIndexTerms(index);
+  BuildTermFilter(index);
 
-  end2 = clock();
-  cpu_time_used = ((double) (end2 - start2)) / CLOCKS_PER_SEC;
-
-  printf("Took %f seconds to execute. \n", cpu_time_used);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  printf("Took %f seconds to execute. \n",
+         (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
   return 0;
 }
 
@@ -110,20 +112,81 @@ void IndexTheFile(char *file, uint64_t doc_id, Index index) {
     int buffer_size = 1000;
     char buffer[buffer_size];
     int row = 0;
+    // The file's rows come after the rows of every file before it.
+    int first_row = index->num_rows;
+    RowTable rows = CreateRowTable();
+    ColumnStore columns = NULL;
+    if (index->columns != NULL) {
+      columns = CreateColumnStore();
+    }
 
     while (fgets(buffer, buffer_size, cfPtr) != NULL) {
       Movie *movie = CreateMovieFromRow(buffer);
-      int result = AddMovieTitleToIndex(index, movie, doc_id, row);
+      if (movie != NULL) {
+        AddMovieFieldsToIndex(index, movie, first_row + row);
+      }
+      if (columns != NULL) {
+        AddMovieToColumns(columns, movie);
+      }
+      int result = AddMovieTitleToIndex(index, movie, first_row + row);
       if (result < 0) {
         fprintf(stderr, "Didn't add MovieToIndex.\n");
       }
+      // Rows are whatever fgets returns, so the table always agrees with
+      // the row ids in the index.
+      if (rows != NULL) {
+        AddRowToTable(rows, ftello(cfPtr), result < 0 ? 0 : result);
+      }
       row++;
-      DestroyMovie(movie);  // Done with this now
+      if (movie != NULL) {
+        DestroyMovie(movie);  // Done with this now
+      }
     }
     fclose(cfPtr);
+    if (rows != NULL) {
+      rows->first_row = first_row;
+      PutRowTable(index, doc_id, rows, columns);
+    } else {
+      // The rows are in the MovieSets anyway, so the next file mustn't
+      // reuse their ordinals.
+      index->num_rows = first_row + row;
+      if (columns != NULL) {
+        DestroyColumnStore(columns);
+      }
+    }
   }
 }
 
+int GetRowFromFile(char *file, RowTable rows, long rowId, char *dest,
+                   int dest_size) {
+  if (rows == NULL || rowId < 0 || rowId >= rows->num_rows) {
+    return -1;
+  }
+  off_t offset = rows->offsets[rowId];
+  int len = rows->offsets[rowId + 1] - offset;
+  if (len >= dest_size) {
+    return -1;
+  }
+
+  int fd = open(file, O_RDONLY);
+  if (fd == -1) {
+    printf("File could not be opened\n");
+    return -1;
+  }
+  int copied = 0;
+  while (copied < len) {
+    ssize_t result = pread(fd, dest + copied, len - copied, offset + copied);
+    if (result <= 0) {
+      close(fd);
+      return -1;
+    }
+    copied += result;
+  }
+  close(fd);
+  dest[len] = '\0';
+  return 0;
+}
+
 // Takes a linkedlist of movies, and builds a hashtable based on the given field
 Index BuildMovieIndex(LinkedList movies, enum IndexField field_to_index){
   // TODO: How big to make this hashtable? How to decide? What to think about?
@@ -151,4 +214,3 @@ Index BuildMovieIndex(LinkedList movies, enum IndexField field_to_index){
   
   return movie_index;
 }
-
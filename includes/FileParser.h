@@ -26,7 +26,10 @@
 
 /**
  * Given a map of all the files that we want to index
- * and search, open each file and index the contents to index
+ * and search, open each file and index the contents to index,
+ * then sort the index's words with SortIndexTerms. The files are read
+ * one at a time on this thread; LoadTheFiles (see FileLoader.h) does
+ * the same with every core. Prints how long it took, in wall time.
  *
  * \param docs the DocIdMap that contains all the files we want to parse.
  * \param the index to hold all the indexed docs.
@@ -34,12 +37,23 @@
 int ParseTheFiles(DocIdMap docs, Index index);
 
 
-int GetRowFromFile(char *file, long rowId);
+/**
+ * Copies one row of a file into dest with a single pread(), using the
+ * RowTable that ParseTheFiles recorded for the file.
+ *
+ * \param file the name of the file.
+ * \param rows the RowTable of the file.
+ * \param rowId which row to copy.
+ * \param dest where to copy the row; it is NUL terminated.
+ * \param dest_size how big dest is.
+ *
+ * \return 0 if successful, -1 if the row couldn't be read.
+ */
+int GetRowFromFile(char *file, RowTable rows, long rowId, char *dest,
+                   int dest_size);
 
 LinkedList ReadFile(const char* filename);
 
 Index BuildMovieIndex(LinkedList movies, enum IndexField field_to_index);
 
-int ParseTheFiles_MT(DocIdMap docs, Index index);
-
 #endif
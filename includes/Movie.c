@@ -18,10 +18,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 
 
 #include "Movie.h"
 
+// Removes leading and trailing whitespace from the string, in place.
+void Trim(char *string) {
+  char *start = string;
+  while (isspace((unsigned char)*start)) {
+    start++;
+  }
+  int len = strlen(start);
+  while (len > 0 && isspace((unsigned char)start[len - 1])) {
+    len--;
+  }
+  memmove(string, start, len);
+  string[len] = '\0';
+}
+
 Movie* CreateMovie() {
   Movie *mov = (Movie*)malloc(sizeof(Movie));
   if (mov == NULL) {
@@ -23,6 +23,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #include "MovieIndex.h"
 #include "htll/LinkedList.h"
@@ -42,6 +43,10 @@ void DestroySetOfMovieWrapper(void *set_movie) {
   DestroySetOfMovies((SetOfMovies)set_movie);
 }
 
+void DestroyRowTableWrapper(void *table) {
+  DestroyRowTable((RowTable)table);
+}
+
 void toLower(char *str, int len) {
   for (int i = 0; i < len; i++) {
     str[i] = tolower(str[i]);
@@ -56,11 +61,33 @@ Index CreateIndex() {
   // Make this "appropriate".
   ind->ht = CreateHashtable(128);
   ind->movies = NULL; // TO BE NULL until it's populated/used.
+  ind->rows = CreateHashtable(64);
+  ind->row_files = NULL;
+  ind->num_row_files = 0;
+  ind->row_files_capacity = 0;
+  ind->num_rows = 0;
+  ind->num_titles = 0;
+  ind->num_title_terms = 0;
+  ind->sorted_terms = NULL;
+  ind->num_sorted_terms = 0;
+  ind->term_filter = NULL;
+  ind->fields = CreateHashtable(128);
+  ind->columns = NULL;
   return ind;
 }
 
 int DestroyIndex(Index index, void (*destroyValue)(void *)) {
   DestroyHashtable(index->ht, destroyValue);
+  DestroyHashtable(index->rows, DestroyRowTableWrapper);
+  free(index->row_files);
+  free(index->sorted_terms);
+  if (index->term_filter != NULL) {
+    DestroyBloomFilter(index->term_filter);
+  }
+  DestroyHashtable(index->fields, DestroyMovieSetWrapper);
+  if (index->columns != NULL) {
+    DestroyColumnStore(index->columns);
+  }
 
   if (index->movies != NULL) {
     DestroyLinkedList(index->movies, DestroyMovieWrapper);
@@ -80,47 +107,479 @@ int DestroyTypeIndex(Index index) {
 }
 
 
-// Assumes Index is a hashtable with key=title word, and value=hashtable with key doc id and value linked list of rows
+RowTable CreateRowTable() {
+  RowTable table = (RowTable)malloc(sizeof(struct rowTable));
+  if (table == NULL) {
+    return NULL;
+  }
+  table->num_rows = 0;
+  table->first_row = 0;
+  table->capacity = 1024;
+  table->offsets = (off_t*)malloc(table->capacity * sizeof(off_t));
+  table->title_terms = (unsigned char*)malloc(table->capacity);
+  if (table->offsets == NULL || table->title_terms == NULL) {
+    free(table->offsets);
+    free(table->title_terms);
+    free(table);
+    return NULL;
+  }
+  table->offsets[0] = 0;
+  return table;
+}
+
+int AddRowToTable(RowTable table, off_t end, int title_terms) {
+  if (table->num_rows + 1 >= table->capacity) {
+    off_t *bigger = (off_t*)realloc(table->offsets,
+                                    2 * table->capacity * sizeof(off_t));
+    if (bigger == NULL) {
+      return -1;
+    }
+    table->offsets = bigger;
+    unsigned char *bigger_terms =
+      (unsigned char*)realloc(table->title_terms, 2 * table->capacity);
+    if (bigger_terms == NULL) {
+      return -1;
+    }
+    table->title_terms = bigger_terms;
+    table->capacity *= 2;
+  }
+  table->title_terms[table->num_rows] = title_terms > 255 ? 255 : title_terms;
+  table->num_rows++;
+  table->offsets[table->num_rows] = end;
+  return 0;
+}
+
+void DestroyRowTable(RowTable table) {
+  free(table->offsets);
+  free(table->title_terms);
+  free(table);
+}
+
+int AddColumnStore(Index index) {
+  index->columns = CreateColumnStore();
+  return index->columns == NULL ? -1 : 0;
+}
+
+int GetColumnRow(Index index, uint64_t doc_id, int row_id) {
+  RowTable rows = GetRowTable(index, doc_id);
+  if (index->columns == NULL || rows == NULL || row_id < 0 ||
+      row_id >= rows->num_rows) {
+    return -1;
+  }
+  return rows->first_row + row_id;
+}
+
+// Adds the rows of a file to row_files, keeping them in order of
+// first_row. Files almost always come in that order, so this appends.
+// Returns 0 if successful, -1 if out of memory.
+static int AddRowFile(Index index, uint64_t doc_id, RowTable table) {
+  if (index->num_row_files == index->row_files_capacity) {
+    int capacity = index->row_files_capacity == 0 ? 64 :
+      2 * index->row_files_capacity;
+    RowFile *bigger =
+      (RowFile*)realloc(index->row_files, capacity * sizeof(RowFile));
+    if (bigger == NULL) {
+      return -1;
+    }
+    index->row_files = bigger;
+    index->row_files_capacity = capacity;
+  }
+  int i = index->num_row_files++;
+  while (i > 0 && index->row_files[i - 1].first_row > table->first_row) {
+    index->row_files[i] = index->row_files[i - 1];
+    i--;
+  }
+  index->row_files[i].doc_id = doc_id;
+  index->row_files[i].first_row = table->first_row;
+  index->row_files[i].num_rows = table->num_rows;
+  if (table->first_row + table->num_rows > index->num_rows) {
+    index->num_rows = table->first_row + table->num_rows;
+  }
+  return 0;
+}
+
+int FindRowFile(Index index, uint64_t row, RowFile *file) {
+  // Finds the last file that starts at or before row.
+  int low = 0;
+  int high = index->num_row_files;
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    if ((uint64_t)index->row_files[mid].first_row <= row) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  // Empty files start where the next one does, so step back past them.
+  while (low > 0 && index->row_files[low - 1].num_rows == 0) {
+    low--;
+  }
+  if (low == 0) {
+    return -1;
+  }
+  RowFile *found = &index->row_files[low - 1];
+  if (row >= (uint64_t)found->first_row + found->num_rows) {
+    return -1;
+  }
+  *file = *found;
+  return 0;
+}
+
+int PutRowTable(Index index, uint64_t doc_id, RowTable table,
+                ColumnStore columns) {
+  HTKeyValue kvp;
+  HTKeyValue old_kvp;
+
+  if (columns != NULL) {
+    int appended = AppendColumns(index->columns, columns);
+    DestroyColumnStore(columns);
+    if (appended != 0) {
+      DestroyRowTable(table);
+      return -1;
+    }
+  }
+  if (AddRowFile(index, doc_id, table) != 0) {
+    DestroyRowTable(table);
+    return -1;
+  }
+  kvp.key = doc_id;
+  kvp.value = table;
+  int result = PutInHashtable(index->rows, kvp, &old_kvp);
+  if (result == 2) {
+    // The file was indexed before; keep the newer table.
+    DestroyRowTable((RowTable)old_kvp.value);
+  }
+  return result == 1 ? -1 : 0;
+}
+
+RowTable GetRowTable(Index index, uint64_t doc_id) {
+  HTKeyValue kvp;
+  if (LookupInHashtable(index->rows, doc_id, &kvp) < 0) {
+    return NULL;
+  }
+  return (RowTable)kvp.value;
+}
+
+// One thread of MergeIndexShards, which moves the MovieSets whose keys
+// are in its part of the key space out of every shard and into its own
+// tables, so no two threads ever touch the same MovieSet.
+typedef struct shardMerge {
+  pthread_t thread;
+  Index *shards;
+  int num_shards;
+  int part;
+  int num_parts;
+  const uint64_t *run_starts;
+  Hashtable terms;
+  Hashtable fields;
+  int result;
+} ShardMerge;
+
+// Moves the MovieSets in src whose keys are in part into dest, merging
+// the ones dest already has a set for, and renumbering their rows first
+// if run_starts isn't NULL (see MergeIndexShards). src is left with
+// pointers to sets it no longer owns.
+// Returns 0 if successful, -1 if out of memory.
+static int MoveSetsInPart(Hashtable dest, Hashtable src, int part,
+                          int num_parts, const uint64_t *run_starts) {
+  HTIter iter = CreateHashtableIterator(src);
+  int result = 0;
+
+  if (iter == NULL) {
+    return 0;
+  }
+  int more = 1;
+  while (more) {
+    HTKeyValue kvp;
+    HTKeyValue old_kvp;
+    HTIteratorGet(iter, &kvp);
+    if (kvp.key % num_parts == (uint64_t)part) {
+      if (run_starts != NULL &&
+          RebaseMovieSet((MovieSet)kvp.value, SHARD_RUN_BITS,
+                         run_starts) != 0) {
+        DestroyMovieSet((MovieSet)kvp.value);
+        result = -1;
+      } else if (LookupInHashtable(dest, kvp.key, &old_kvp) == 0) {
+        result |= MergeMovieSets((MovieSet)old_kvp.value,
+                                 (MovieSet)kvp.value);
+        DestroyMovieSet((MovieSet)kvp.value);
+      } else if (PutInHashtable(dest, kvp, &old_kvp) == 1) {
+        DestroyMovieSet((MovieSet)kvp.value);
+        result = -1;
+      }
+    }
+    more = HTIteratorHasMore(iter);
+    if (more) {
+      HTIteratorNext(iter);
+    }
+  }
+  DestroyHashtableIterator(iter);
+  return result;
+}
+
+static void *MergeShardPart(void *arg) {
+  ShardMerge *merge = (ShardMerge*)arg;
+
+  merge->result = 0;
+  for (int i = 0; i < merge->num_shards; i++) {
+    merge->result |= MoveSetsInPart(merge->terms, merge->shards[i]->ht,
+                                    merge->part, merge->num_parts,
+                                    merge->run_starts);
+    merge->result |= MoveSetsInPart(merge->fields,
+                                    merge->shards[i]->fields,
+                                    merge->part, merge->num_parts,
+                                    merge->run_starts);
+  }
+  return NULL;
+}
+
+// Moves the RowTables and ColumnStore of a shard into index. A shard's
+// first_rows must already be the index's, so they stay as they are.
+// Returns 0 if successful, -1 if out of memory.
+static int MoveShardRows(Index index, Index shard) {
+  int result = 0;
+
+  if (index->columns != NULL && shard->columns != NULL) {
+    result = AppendColumns(index->columns, shard->columns);
+  }
+  HTIter iter = CreateHashtableIterator(shard->rows);
+  if (iter == NULL) {
+    return result;
+  }
+  int more = 1;
+  while (more) {
+    HTKeyValue kvp;
+    HTIteratorGet(iter, &kvp);
+    if (PutRowTable(index, kvp.key, (RowTable)kvp.value, NULL) != 0) {
+      result = -1;
+    }
+    more = HTIteratorHasMore(iter);
+    if (more) {
+      HTIteratorNext(iter);
+    }
+  }
+  DestroyHashtableIterator(iter);
+  return result;
+}
+
+// Frees a shard whose MovieSets and RowTables have all been moved out.
+static void FreeMergedShard(Index shard) {
+  DestroyHashtable(shard->ht, NullFree);
+  DestroyHashtable(shard->fields, NullFree);
+  DestroyHashtable(shard->rows, NullFree);
+  if (shard->columns != NULL) {
+    DestroyColumnStore(shard->columns);
+  }
+  free(shard);
+}
+
+int MergeIndexShards(Index index, Index *shards, int num_shards,
+                     int num_threads, const uint64_t *run_starts) {
+  ShardMerge *merges = (ShardMerge*)malloc(num_threads * sizeof(ShardMerge));
+  int result = 0;
+
+  if (merges == NULL) {
+    printf("Couldn't malloc to merge index shards\n");
+    return -1;
+  }
+  int started = 0;
+  for (int i = 0; i < num_threads; i++) {
+    merges[i].shards = shards;
+    merges[i].num_shards = num_shards;
+    merges[i].part = i;
+    merges[i].num_parts = num_threads;
+    merges[i].run_starts = run_starts;
+    merges[i].terms = CreateHashtable(1024);
+    merges[i].fields = CreateHashtable(64);
+    merges[i].result = 0;
+  }
+  for (int i = 0; i < num_threads; i++) {
+    if (merges[i].terms == NULL || merges[i].fields == NULL) {
+      printf("Couldn't malloc to merge index shards\n");
+      result = -1;
+      break;
+    }
+  }
+  if (result == 0) {
+    while (started < num_threads &&
+           pthread_create(&merges[started].thread, NULL, MergeShardPart,
+                          &merges[started]) == 0) {
+      started++;
+    }
+    // Whatever parts didn't get a thread are merged on this one.
+    for (int i = started; i < num_threads; i++) {
+      MergeShardPart(&merges[i]);
+    }
+    for (int i = 0; i < started; i++) {
+      pthread_join(merges[i].thread, NULL);
+    }
+
+    // Each key is in only one part, so these are mostly plain puts.
+    for (int i = 0; i < num_threads; i++) {
+      result |= merges[i].result;
+      result |= MoveSetsInPart(index->ht, merges[i].terms, 0, 1, NULL);
+      result |= MoveSetsInPart(index->fields, merges[i].fields, 0, 1, NULL);
+    }
+    for (int i = 0; i < num_shards; i++) {
+      result |= MoveShardRows(index, shards[i]);
+      index->num_titles += shards[i]->num_titles;
+      index->num_title_terms += shards[i]->num_title_terms;
+      FreeMergedShard(shards[i]);
+    }
+  }
+
+  for (int i = 0; i < num_threads; i++) {
+    if (merges[i].terms != NULL) {
+      DestroyHashtable(merges[i].terms, NullFree);
+    }
+    if (merges[i].fields != NULL) {
+      DestroyHashtable(merges[i].fields, NullFree);
+    }
+  }
+  free(merges);
+  return result;
+}
+
+// Adds the movie to the MovieSet of word, a lowercase NUL terminated
+// word of its title.
+static void AddMovieToWordSet(Index index, const char *word, int length,
+                              uint64_t row) {
+  HTKeyValue kvp;
+  HTKeyValue old_kvp;
+  uint64_t key = FNVHash64((unsigned char*)word, length);
+
+  // If this key is already in the hashtable, get the MovieSet.
+  // Otherwise, create a MovieSet and put it in.
+  if (LookupInHashtable(index->ht, key, &kvp) < 0) {
+    kvp.value = CreateMovieSet((char*)word);
+    kvp.key = key;
+    PutInHashtable(index->ht, kvp, &old_kvp);
+    if (index->term_filter != NULL) {
+      AddToBloomFilter(index->term_filter, kvp.key);
+    }
+  }
+  AddMovieToSet((MovieSet)kvp.value, row);
+}
+
+// Adds the movie to the MovieSet of each word of title; words are split
+// on spaces. Returns how many words there were.
+static int AddTitleWords(Index index, FieldView title, uint64_t row) {
+  char word[title.length + 1];
+  int num_words = 0;
+  int pos = 0;
+
+  while (pos < title.length) {
+    if (title.data[pos] == ' ') {
+      pos++;
+      continue;
+    }
+    int length = 0;
+    while (pos + length < title.length && title.data[pos + length] != ' ') {
+      word[length] = tolower(title.data[pos + length]);
+      length++;
+    }
+    word[length] = '\0';
+    AddMovieToWordSet(index, word, length, row);
+    num_words++;
+    pos += length;
+  }
+
+  index->num_titles++;
+  index->num_title_terms += num_words;
+  return num_words;
+}
+
 int AddMovieTitleToIndex(Index index,
                          Movie *movie,
-                         uint64_t doc_id,
-                         int row_id) {
-  // Put in the index
-  HTKeyValue kvp;
+                         uint64_t row) {
+  RowView view;
+  if (movie == NULL) {
+    return 0;
+  }
+  RowViewOfMovie(movie, &view);
+  return AddTitleWords(index, view.title, row);
+}
 
-  // TODO: How to choose this number? What are the pros and cons of choosing the wrong number?
-  int numFields = 1000;
 
-  char *token[numFields];
-  char *rest = movie->title;
+// Adds the movie to the fields set for "field:value".
+// Returns 0 if successful, -1 if out of memory.
+static int AddMovieToFieldSet(Index index, const char *field,
+                              FieldView value, uint64_t row) {
+  char desc[strlen(field) + value.length + 2];
+  HTKeyValue kvp;
+  HTKeyValue old_kvp;
 
-  int i = 0;
-  token[i] = strtok_r(rest, " ", &rest);
-  while (token[i] != NULL) {
-    toLower(token[i], strlen(token[i]));
-    i++;
-    token[i] = strtok_r(rest, " ", &rest);
+  int length = sprintf(desc, "%s:%.*s", field, value.length, value.data);
+  toLower(desc, length);
+  uint64_t key = FNVHash64((unsigned char*)desc, length);
+  if (LookupInHashtable(index->fields, key, &kvp) < 0) {
+    kvp.key = key;
+    kvp.value = CreateMovieSet(desc);
+    if (kvp.value == NULL) {
+      return -1;
+    }
+    PutInHashtable(index->fields, kvp, &old_kvp);
   }
+  return AddMovieToSet((MovieSet)kvp.value, row);
+}
 
-  for (int j = 0; j < i; j++) {
-    // If this key is already in the hashtable, get the MovieSet.
-    // Otherwise, create a MovieSet and put it in.
-    int result = LookupInHashtable(index->ht,
-                          FNVHash64((unsigned char*)token[j],
-                                    (unsigned int)strlen(token[j])), &kvp);
-    HTKeyValue old_kvp;
+// Adds the movie to the fields set of a number field.
+static int AddMovieToNumberSet(Index index, const char *field, int value,
+                               uint64_t row) {
+  char number[16];
+  FieldView view = { number, snprintf(number, sizeof(number), "%d", value) };
+  return AddMovieToFieldSet(index, field, view, row);
+}
 
-    if (result < 0) {
-      kvp.value = CreateMovieSet(token[j]);
-      kvp.key = FNVHash64((unsigned char*)token[j], strlen(token[j]));
-      PutInHashtable(index->ht, kvp, &old_kvp);
+static int AddFieldViews(Index index, RowView *view, uint64_t row) {
+  int result = 0;
+
+  if (view->type.data != NULL) {
+    result |= AddMovieToFieldSet(index, "type", view->type, row);
+  }
+  for (int i = 0; i < view->num_genres; i++) {
+    // A movie without genres has "-", and a newline can be left on it.
+    if (view->genres[i].length > 0 && view->genres[i].data[0] != '-') {
+      result |= AddMovieToFieldSet(index, "genre", view->genres[i], row);
     }
+  }
+  if (view->year >= 0) {
+    result |= AddMovieToNumberSet(index, "year", view->year, row);
+  }
+  if (view->runtime >= 0) {
+    result |= AddMovieToNumberSet(index, "runtime", view->runtime, row);
+  }
+  if (view->isAdult >= 0) {
+    result |= AddMovieToNumberSet(index, "adult", view->isAdult, row);
+  }
+  return result < 0 ? -1 : 0;
+}
+
+int AddMovieFieldsToIndex(Index index, Movie *movie, uint64_t row) {
+  RowView view;
+  RowViewOfMovie(movie, &view);
+  return AddFieldViews(index, &view, row);
+}
 
-    AddMovieToSet((MovieSet)kvp.value, doc_id, row_id);
+int AddRowViewToIndex(Index index, RowView *view, uint64_t row) {
+  if (AddFieldViews(index, view, row) != 0) {
+    return -1;
   }
+  return AddTitleWords(index, view->title, row);
+}
 
-  return 0;
+MovieSet GetFieldSet(Index index, const char *field, const char *value) {
+  char desc[strlen(field) + strlen(value) + 2];
+  HTKeyValue kvp;
 
+  sprintf(desc, "%s:%s", field, value);
+  toLower(desc, strlen(desc));
+  if (LookupInHashtable(index->fields,
+                        FNVHash64((unsigned char*)desc, strlen(desc)),
+                        &kvp) < 0) {
+    return NULL;
+  }
+  return (MovieSet)kvp.value;
 }
 
 
@@ -226,23 +685,260 @@ uint64_t ComputeKey(Movie* movie, enum IndexField which_field) {
 }
 
 
+// FNVHash64 of term in lower case, the key the term is under in a title
+// index, without copying term to lower case it.
+static uint64_t TermKey(const char *term) {
+  uint64_t hval = 0xcbf29ce484222325ULL;
+  for (const char *c = term; *c != '\0'; c++) {
+    hval ^= (uint64_t)(unsigned char)tolower(*c);
+    hval *= 0x100000001b3ULL;
+  }
+  return hval;
+}
+
 MovieSet GetMovieSet(Index index, const char *term) {
   HTKeyValue kvp;
-  char lower[strlen(term)+1];
-  strcpy(lower, term);
-  toLower(lower, strlen(lower));
-  int result = LookupInHashtable(index->ht,
-                                 FNVHash64((unsigned char*)lower,
-                                           (unsigned int)strlen(lower)),
-                                 &kvp);
-  if (result < 0) {
-    printf("term couldn't be found: %s \n", term);
+  uint64_t key = TermKey(term);
+  // Most words that aren't in the index stop here.
+  if (index->term_filter != NULL &&
+      !BloomFilterMayContain(index->term_filter, key)) {
+    return NULL;
+  }
+  if (LookupInHashtable(index->ht, key, &kvp) < 0) {
     return NULL;
   }
   printf("returning movieset\n");
   return (MovieSet)kvp.value;
 }
 
+static int CompareTerms(const void *a, const void *b) {
+  return strcmp((*(MovieSet*)a)->desc, (*(MovieSet*)b)->desc);
+}
+
+int SortIndexTerms(Index index) {
+  int num_terms = NumElemsInHashtable(index->ht);
+  MovieSet *terms = (MovieSet*)malloc((num_terms + 1) * sizeof(MovieSet));
+  if (terms == NULL) {
+    printf("Couldn't malloc to sort the index terms\n");
+    return -1;
+  }
+
+  int n = 0;
+  HTIter iter = CreateHashtableIterator(index->ht);
+  if (iter != NULL) {
+    HTKeyValue kvp;
+    HTIteratorGet(iter, &kvp);
+    terms[n++] = (MovieSet)kvp.value;
+    while (HTIteratorHasMore(iter) && n < num_terms) {
+      HTIteratorNext(iter);
+      HTIteratorGet(iter, &kvp);
+      terms[n++] = (MovieSet)kvp.value;
+    }
+    DestroyHashtableIterator(iter);
+  }
+  qsort(terms, n, sizeof(MovieSet), &CompareTerms);
+
+  free(index->sorted_terms);
+  index->sorted_terms = terms;
+  index->num_sorted_terms = n;
+  return 0;
+}
+
+int BuildTermFilter(Index index) {
+  BloomFilter filter = CreateBloomFilter(NumElemsInHashtable(index->ht));
+  if (filter == NULL) {
+    return -1;
+  }
+
+  HTIter iter = CreateHashtableIterator(index->ht);
+  if (iter != NULL) {
+    HTKeyValue kvp;
+    HTIteratorGet(iter, &kvp);
+    AddToBloomFilter(filter, kvp.key);
+    while (HTIteratorHasMore(iter)) {
+      HTIteratorNext(iter);
+      HTIteratorGet(iter, &kvp);
+      AddToBloomFilter(filter, kvp.key);
+    }
+    DestroyHashtableIterator(iter);
+  }
+
+  if (index->term_filter != NULL) {
+    DestroyBloomFilter(index->term_filter);
+  }
+  index->term_filter = filter;
+  return 0;
+}
+
+// Returns 1 if a should come before b in the completions.
+static int CompletesBetter(MovieSet a, MovieSet b) {
+  if (NumMoviesInSet(a) != NumMoviesInSet(b)) {
+    return NumMoviesInSet(a) > NumMoviesInSet(b);
+  }
+  return strcmp(a->desc, b->desc) < 0;
+}
+
+int CompleteTerm(Index index, const char *prefix, MovieSet *completions,
+                 int max) {
+  char lower[strlen(prefix)+1];
+  strcpy(lower, prefix);
+  toLower(lower, strlen(lower));
+  size_t len = strlen(lower);
+
+  // Find the first word that isn't before the prefix.
+  int low = 0;
+  int high = index->num_sorted_terms;
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    if (strcmp(index->sorted_terms[mid]->desc, lower) < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  // Insertion sort the best max words into completions; max is small.
+  int found = 0;
+  for (int i = low; i < index->num_sorted_terms &&
+           strncmp(index->sorted_terms[i]->desc, lower, len) == 0; i++) {
+    MovieSet set = index->sorted_terms[i];
+    if (found == max && !CompletesBetter(set, completions[max - 1])) {
+      continue;
+    }
+    int j = found < max ? found++ : max - 1;
+    while (j > 0 && CompletesBetter(set, completions[j - 1])) {
+      completions[j] = completions[j - 1];
+      j--;
+    }
+    completions[j] = set;
+  }
+  return found;
+}
+
+// A word FuzzyMatchTerms found, and how far it is from the term.
+typedef struct fuzzyMatch {
+  MovieSet set;
+  int edits;
+} FuzzyMatch;
+
+// Returns 1 if a should come before b in the matches.
+static int MatchesBetter(FuzzyMatch *a, FuzzyMatch *b) {
+  if (a->edits != b->edits) {
+    return a->edits < b->edits;
+  }
+  return CompletesBetter(a->set, b->set);
+}
+
+// Returns the index of the first word after from that doesn't start
+// with the first len letters of word.
+static int SkipPrefix(Index index, int from, const char *word, int len) {
+  int low = from + 1;
+  int high = index->num_sorted_terms;
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    if (strncmp(index->sorted_terms[mid]->desc, word, len) <= 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+int FuzzyMatchTerms(Index index, const char *term, int max_edits,
+                    MovieSet *matches, int max, int *expanded) {
+  int len = strlen(term);
+  // A word can only match if it is at most this long.
+  int depth = len + max_edits;
+  // rows[k][j] is the edit distance between the first k letters of the
+  // word and the first j letters of the term.
+  int rows[FUZZY_MAX_TERM + FUZZY_MAX_EDITS + 1][FUZZY_MAX_TERM + 1];
+  char lower[FUZZY_MAX_TERM + 1];
+  FuzzyMatch found[max > 0 ? max : 1];
+  int num_found = 0;
+
+  *expanded = 0;
+  if (len > FUZZY_MAX_TERM || max_edits > FUZZY_MAX_EDITS || max < 1) {
+    return 0;
+  }
+  strcpy(lower, term);
+  toLower(lower, len);
+  for (int j = 0; j <= len; j++) {
+    rows[0][j] = j;
+  }
+
+  // How many rows of the table are right for the current word.
+  int good_rows = 0;
+  const char *last = "";
+  int i = 0;
+  while (i < index->num_sorted_terms) {
+    MovieSet set = index->sorted_terms[i];
+    const char *word = set->desc;
+    int word_len = strlen(word);
+    (*expanded)++;
+
+    int shared = 0;
+    while (shared < good_rows && word[shared] == last[shared]) {
+      shared++;
+    }
+    last = word;
+
+    // Fill in rows until the word runs out, it's too long to match, or
+    // no word with this prefix can match.
+    int k = shared + 1;
+    int dead = 0;
+    for (; k <= word_len && k <= depth; k++) {
+      int row_min = rows[k][0] = k;
+      for (int j = 1; j <= len; j++) {
+        int cost = rows[k - 1][j - 1] + (word[k - 1] != lower[j - 1]);
+        if (rows[k - 1][j] + 1 < cost) {
+          cost = rows[k - 1][j] + 1;
+        }
+        if (rows[k][j - 1] + 1 < cost) {
+          cost = rows[k][j - 1] + 1;
+        }
+        if (k > 1 && j > 1 && word[k - 1] == lower[j - 2] &&
+            word[k - 2] == lower[j - 1] && rows[k - 2][j - 2] + 1 < cost) {
+          cost = rows[k - 2][j - 2] + 1;
+        }
+        rows[k][j] = cost;
+        if (cost < row_min) {
+          row_min = cost;
+        }
+      }
+      if (row_min > max_edits) {
+        dead = 1;
+        break;
+      }
+    }
+    good_rows = k - 1;
+
+    if (dead || word_len > depth) {
+      // Every word that starts with the first k letters of this one is
+      // either too far from the term or too long.
+      i = SkipPrefix(index, i, word, k);
+      continue;
+    }
+    if (rows[word_len][len] <= max_edits) {
+      FuzzyMatch match = { set, rows[word_len][len] };
+      if (num_found < max || MatchesBetter(&match, &found[max - 1])) {
+        int j = num_found < max ? num_found++ : max - 1;
+        while (j > 0 && MatchesBetter(&match, &found[j - 1])) {
+          found[j] = found[j - 1];
+          j--;
+        }
+        found[j] = match;
+      }
+    }
+    i++;
+  }
+
+  for (int j = 0; j < num_found; j++) {
+    matches[j] = found[j].set;
+  }
+  return num_found;
+}
+
 // Function used to seek doubles within the same key chain and destroy the old
 // key to make room for the new key and value pair.
 void SeekAndDestroyDuplicates(LinkedList movie_list, Movie *movie) {
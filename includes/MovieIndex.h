@@ -19,10 +19,47 @@
 #ifndef MOVIEINDEX_H
 #define MOVIEINDEX_H
 
+#include <stdint.h>
+#include <sys/types.h>
+
 #include "htll/Hashtable.h"
 #include "htll/LinkedList.h"
 #include "Movie.h"
+#include "RowParser.h"
 #include "MovieSet.h"
+#include "ColumnStore.h"
+#include "BloomFilter.h"
+
+/**
+ * Where every row of one file starts, so a row can be read with a single
+ * pread() instead of reading the file up to it.
+ *
+ * Row i is the bytes from offsets[i] up to offsets[i + 1]; offsets has
+ * num_rows + 1 entries. title_terms[i] is how many words the title of
+ * row i has (up to 255), which ranked queries score with.
+ *
+ * Row i of the file is row first_row + i of the Index: its row ordinal
+ * in MovieSets, and its row in the ColumnStore if there is one. The
+ * files' rows are counted one file after another, in the order they
+ * are given to the Index.
+ */
+typedef struct rowTable {
+  int num_rows;
+  int capacity;
+  off_t *offsets;
+  unsigned char *title_terms;
+  int first_row;
+} *RowTable;
+
+/**
+ * Which rows of the Index a file has, so a row ordinal can be turned
+ * back into a doc id and a row id.
+ */
+typedef struct rowFile {
+  uint64_t doc_id;
+  int first_row;
+  int num_rows;
+} RowFile;
 
 
 /**
@@ -42,6 +79,53 @@ typedef struct index {
    * 
    */
   LinkedList movies; 
+  /**
+   * The RowTable of every file that was indexed, keyed by doc id.
+   * Filled in by ParseTheFiles.
+   */
+  Hashtable rows;
+  /**
+   * Every file in rows, in order of first_row, for FindRowFile; and how
+   * many rows they have altogether, which is the first_row of the next
+   * file. Filled in by PutRowTable.
+   */
+  RowFile *row_files;
+  int num_row_files;
+  int row_files_capacity;
+  int num_rows;
+  /**
+   * How many titles AddMovieTitleToIndex has indexed, and how many words
+   * they had altogether. Ranked queries use these for the average title
+   * length and the number of titles.
+   */
+  int num_titles;
+  long num_title_terms;
+  /**
+   * Every MovieSet in ht, sorted by its word, so the words that start
+   * with a prefix are next to each other. Filled in by SortIndexTerms;
+   * NULL until then.
+   */
+  MovieSet *sorted_terms;
+  int num_sorted_terms;
+  /**
+   * Every word in ht, so GetMovieSet can turn away most words that
+   * aren't there without walking a bucket. Filled in by
+   * BuildTermFilter; NULL until then.
+   */
+  BloomFilter term_filter;
+  /**
+   * The movies with each value of each field a query can filter on, so
+   * a filter is a PostingBitmap operation instead of a check of every
+   * row. The key is the hash of "field:value", like "year:2013" or
+   * "genre:comedy", and the value is a MovieSet with that desc.
+   * Filled in by AddMovieFieldsToIndex.
+   */
+  Hashtable fields;
+  /**
+   * The fields of every movie in dense arrays, if AddColumnStore was
+   * called before the files were parsed; NULL otherwise.
+   */
+  ColumnStore columns;
 } *Index; 
 
 /**
@@ -66,11 +150,43 @@ int AddMovieToIndex(Index index, Movie *movie, enum IndexField field);
  *
  * INPUT:
  *  index: the index to add the movie to.
+ *  movie: a Movie to be added to the index, or NULL for a row that
+ *    isn't one, which has no words.
+ *  row: the row ordinal of the movie (see RowTable).
+ *
+ *  \return the number of words in the title.
+ */
+int AddMovieTitleToIndex(Index index, Movie *movie, uint64_t row);
+
+/**
+ * Adds a movie to the fields sets of the index for its type, each of its
+ * genres, its year, its runtime and whether it is adult, so queries can
+ * filter on them. Fields the movie doesn't have are skipped.
+ *
+ * INPUT:
+ *  index: the index to add the movie to.
  *  movie: a Movie to be added to the index.
+ *  row: the row ordinal of the movie (see RowTable).
  *
  *  \return 0 if successful.
  */
-int AddMovieTitleToIndex(Index index, Movie *movie, uint64_t docId, int row);
+int AddMovieFieldsToIndex(Index index, Movie *movie, uint64_t row);
+
+/**
+ * Does what AddMovieFieldsToIndex and AddMovieTitleToIndex do, for a row
+ * split with SplitRow, without making a Movie of it.
+ *
+ *  \return the number of words in the title, or -1 if out of memory.
+ */
+int AddRowViewToIndex(Index index, RowView *view, uint64_t row);
+
+/**
+ * Gets the MovieSet of the movies whose field has a value, like
+ * GetFieldSet(index, "genre", "Comedy"). Case doesn't matter.
+ *
+ *  \return A MovieSet, or NULL if no movie has that value.
+ */
+MovieSet GetFieldSet(Index index, const char *field, const char *value);
 
 
 
@@ -87,6 +203,74 @@ int AddMovieTitleToIndex(Index index, Movie *movie, uint64_t docId, int row);
  */
 MovieSet GetMovieSet(Index index, const char *term);
 
+/**
+ * How many bits of a shard's row ordinal are the row within its run,
+ * when the shards were built before it was known how many rows each
+ * run has (see MergeIndexShards).
+ */
+#define SHARD_RUN_BITS 32
+
+/**
+ * Moves everything in shards into index and frees the shards. Each
+ * shard is an Index that one thread built from its own files with no
+ * locking; no file may be in two shards.
+ *
+ * The MovieSets are split by key into num_threads parts, and a thread
+ * per part moves the sets of its keys out of every shard, merging the
+ * postings of a word that more than one shard has. No two threads ever
+ * touch the same set, so none of this takes a lock. The RowTables and
+ * ColumnStores are then moved over one shard at a time.
+ *
+ * If run_starts is NULL, the shards' row ordinals are already the
+ * index's, so the shards' rows must come one after another, in shard
+ * order. Otherwise the shards' rows are in runs, and row i of run r is
+ * ordinal (r << SHARD_RUN_BITS) + i in the shards; the threads renumber
+ * it to run_starts[r] + i as they move the sets (see RebaseMovieSet).
+ *
+ *  \return 0 if successful, -1 if out of memory; some movies can be
+ *    missing from the index then.
+ */
+int MergeIndexShards(Index index, Index *shards, int num_shards,
+                     int num_threads, const uint64_t *run_starts);
+
+/**
+ * Sorts the words of a title index into sorted_terms, for CompleteTerm.
+ * Call it once every title is in the index; ParseTheFiles does. Calling
+ * it again re-sorts, picking up any words added since.
+ *
+ *  \return 0 if successful, -1 if out of memory.
+ */
+int SortIndexTerms(Index index);
+
+/**
+ * Builds term_filter from every word of a title index. Call it once
+ * every title is in the index; ParseTheFiles does. Words added after it
+ * is built are added to it too.
+ *
+ *  \return 0 if successful, -1 if out of memory.
+ */
+int BuildTermFilter(Index index);
+
+/**
+ * Finds the words in the index that start with prefix, and puts the
+ * ones in the most titles in completions, most titles first.
+ * Ties go to the word that sorts first.
+ *
+ * The words are found by binary search in sorted_terms, and only the
+ * ones that start with prefix are looked at.
+ *
+ * INPUT:
+ *  index: the index to search; SortIndexTerms must have been called.
+ *  prefix: the start of the words to find. Case doesn't matter.
+ *  completions: where to put the MovieSets of the words found; each
+ *    one's desc is the word and NumMoviesInSet its count.
+ *  max: how many completions there is room for.
+ *
+ *  \return how many completions were found.
+ */
+int CompleteTerm(Index index, const char *prefix, MovieSet *completions,
+                 int max);
+
 /**
  *
  *  Destroys the supplied index, freeing up all
@@ -109,6 +293,98 @@ int DestroyOffsetIndex(Index index);
  */
 Index CreateIndex();
 
+/**
+ * Gives the Index an empty ColumnStore, which ParseTheFiles then fills
+ * in with every row it parses. Indexes don't have one unless asked,
+ * since it costs about 16 bytes and the title of every row.
+ *
+ * \return 0 if successful, -1 if out of memory.
+ */
+int AddColumnStore(Index index);
+
+/**
+ * Finds the row of a movie in the Index's ColumnStore.
+ *
+ * \return the row, or -1 if the Index has no ColumnStore or no such row.
+ */
+int GetColumnRow(Index index, uint64_t doc_id, int row_id);
+
+/**
+ * Creates an empty RowTable.
+ */
+RowTable CreateRowTable();
+
+/**
+ * Adds a row to the end of the RowTable.
+ *
+ * \param table the RowTable to add to.
+ * \param end the offset just past the end of the row.
+ * \param title_terms how many words the row's title has.
+ *
+ * \return 0 if successful.
+ */
+int AddRowToTable(RowTable table, off_t end, int title_terms);
+
+void DestroyRowTable(RowTable table);
+
+/**
+ * Gives the Index the RowTable of a file; the Index destroys it.
+ * table->first_row must already be set, normally to index->num_rows.
+ * If columns isn't NULL, it has the file's rows, which are added to the
+ * end of the Index's ColumnStore, and it is destroyed. Files can be
+ * parsed at the same time, but only one can be given to the Index at
+ * once.
+ *
+ * \return 0 if successful.
+ */
+int PutRowTable(Index index, uint64_t doc_id, RowTable table,
+                ColumnStore columns);
+
+/**
+ * Gets the RowTable of a file from the Index.
+ *
+ * \return the RowTable, or NULL if the file wasn't indexed.
+ */
+RowTable GetRowTable(Index index, uint64_t doc_id);
+
+/**
+ * Finds the file a row ordinal is in, by binary search in row_files.
+ *
+ * \return 0 and sets file if successful, -1 if no file has the row.
+ */
+int FindRowFile(Index index, uint64_t row, RowFile *file);
+
+/**
+ * Most edits FuzzyMatchTerms allows, and the longest word it takes.
+ */
+#define FUZZY_MAX_EDITS 2
+#define FUZZY_MAX_TERM 64
+
+/**
+ * Finds the words in the index within max_edits edits of term, where an
+ * edit is adding, removing or changing a letter, or swapping two letters
+ * next to each other. The closest words come first, and then the ones
+ * in the most titles.
+ *
+ * The sorted words are walked like a trie: the edit distance table for
+ * a word reuses the rows of the prefix it shares with the word before
+ * it, and once every entry of a row is over max_edits, every word with
+ * that prefix is skipped with a binary search.
+ *
+ * INPUT:
+ *  index: the index to search; SortIndexTerms must have been called.
+ *  term: the word to match. Case doesn't matter.
+ *  max_edits: at most FUZZY_MAX_EDITS.
+ *  matches: where to put the MovieSets of the words found.
+ *  max: how many matches there is room for.
+ *  expanded: set to how many words had their edit distance worked out,
+ *    which is what the search costs.
+ *
+ *  \return how many matches were found.
+ */
+int FuzzyMatchTerms(Index index, const char *term, int max_edits,
+                    MovieSet *matches, int max, int *expanded);
+
 /**
  * Helper function to compute the key from a string, given
  * a Movie and which field is to be used as the key.
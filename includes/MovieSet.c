@@ -26,54 +26,80 @@
 
 void NullFree(void *freeme) { }
 
-void SimpleFree(void *payload) {
-  free(payload);
-}
-
-int AddMovieToSet(MovieSet set,  uint64_t docId, int rowId) {
-  Hashtable docInd = set->doc_index;
-
-  HTKeyValue kvp;
-  HTKeyValue old_kvp;
-  int result = LookupInHashtable(docInd, docId, &kvp);
-
-  // If the docId is in docInd, use it.
-  // Otherwise, create a new entry for this docId in docInd.
-  if (result < 0) {
-    kvp.key = docId;
-    kvp.value = CreateLinkedList();
-    PutInHashtable(docInd, kvp, &old_kvp);
+int AddMovieToSet(MovieSet set, uint64_t row) {
+  int result = PostingBitmapAdd(&set->postings, row);
+  // Already in the set, so the word is in the title again.
+  if (result == 0) {
+    result = PostingBitmapAdd(&set->repeats, row);
   }
-
-  // add rowId to the linked list.
-  void *val = malloc(sizeof(int));
-
-  if (val == NULL) {
+  if (result < 0) {
     // Out of mem
     printf("Out of memory adding movie to set: %s\n", set->desc);
     return -1;
   }
+  return 0;
+}
 
-  *((int*)val) = rowId;
-  result = InsertLinkedList((LinkedList)kvp.value, val);
+int MergeMovieSets(MovieSet dest, MovieSet src) {
+  struct postingBitmap postings;
+  struct postingBitmap repeats;
+
+  InitPostingBitmap(&postings);
+  InitPostingBitmap(&repeats);
+  if (PostingBitmapOr(&dest->postings, &src->postings, &postings) != 0 ||
+      PostingBitmapOr(&dest->repeats, &src->repeats, &repeats) != 0) {
+    printf("Out of memory merging movie sets: %s\n", dest->desc);
+    FreePostingBitmap(&postings);
+    FreePostingBitmap(&repeats);
+    return -1;
+  }
+  FreePostingBitmap(&dest->postings);
+  FreePostingBitmap(&dest->repeats);
+  dest->postings = postings;
+  dest->repeats = repeats;
+  return 0;
+}
 
-  return result;
+int RebaseMovieSet(MovieSet set, int run_bits, const uint64_t *run_starts) {
+  struct postingBitmap postings;
+  struct postingBitmap repeats;
+
+  InitPostingBitmap(&postings);
+  InitPostingBitmap(&repeats);
+  if (PostingBitmapRebase(&set->postings, run_bits, run_starts,
+                          &postings) != 0 ||
+      PostingBitmapRebase(&set->repeats, run_bits, run_starts,
+                          &repeats) != 0) {
+    printf("Out of memory renumbering movie set: %s\n", set->desc);
+    FreePostingBitmap(&postings);
+    FreePostingBitmap(&repeats);
+    return -1;
+  }
+  FreePostingBitmap(&set->postings);
+  FreePostingBitmap(&set->repeats);
+  set->postings = postings;
+  set->repeats = repeats;
+  return 0;
 }
 
-int MovieSetContainsDoc(MovieSet set, uint64_t docId) {
-  HTKeyValue kvp;
-  return LookupInHashtable(set->doc_index, docId, &kvp);
+int TimesInTitle(MovieSet set, uint64_t row) {
+  if (PostingBitmapContains(&set->postings, row) == 0) {
+    return 0;
+  }
+  return 1 + PostingBitmapContains(&set->repeats, row);
 }
 
-void PrintOffsetList(LinkedList list) {
-  printf("Printing offset list\n");
-  LLIter iter = CreateLLIter(list);
-  int* payload;
-  while (LLIterHasNext(iter) != 0) {
-    LLIterGetPayload(iter, (void**)&payload);
-    printf("%d\t", *((int*)payload));
-    LLIterNext(iter);
+int MovieSetContainsRows(MovieSet set, uint64_t first_row, int num_rows) {
+  uint64_t row;
+  if (PostingBitmapNextValue(&set->postings, first_row, &row) != 0 ||
+      row >= first_row + num_rows) {
+    return -1;
   }
+  return 0;
+}
+
+int NumMoviesInSet(MovieSet set) {
+  return PostingBitmapCardinality(&set->postings);
 }
 
 
@@ -90,7 +116,8 @@ MovieSet CreateMovieSet(char *desc) {
     return NULL;
   }
   strcpy(set->desc, desc);
-  set->doc_index = CreateHashtable(16);
+  InitPostingBitmap(&set->postings);
+  InitPostingBitmap(&set->repeats);
   return set;
 }
 
@@ -125,16 +152,12 @@ int AddMovieToSetOfMovies(SetOfMovies set, Movie *movie) {
 }
 
 
-void DestroyOffsetList(void *val) {
-  LinkedList list = (LinkedList)val;
-  DestroyLinkedList(list, &SimpleFree);
-}
-
 void DestroyMovieSet(MovieSet set) {
   // Free desc
   free(set->desc);
-  // Free doc_index
-  DestroyHashtable(set->doc_index, &DestroyOffsetList);
+  // Free postings
+  FreePostingBitmap(&set->postings);
+  FreePostingBitmap(&set->repeats);
   // Free set
   free(set);
 }
@@ -21,19 +21,23 @@
 
 #include "htll/Hashtable.h"
 #include "Movie.h"
+#include "PostingBitmap.h"
 
 /**
  * A MovieSet is a set of movies.
  *
- * doc_index is a hashtable where the key is a doc_id,
- * and the value is a linked list. The payloads in the linked
- * list is a row_id that indicates which row in the specified file
- * has the info about the movie that belongs in this set.
+ * postings holds the row ordinal of every movie in the set: the rows of
+ * every file the Index has, counted one file after another (see
+ * RowTable and FindRowFile), so each one says which row in which file
+ * has the info about the movie. Ordinals are dense, so the rows of
+ * neighbouring files share PostingBitmap containers. A movie whose
+ * title has the same word twice is in the set once, and is also in
+ * repeats.
  */
 typedef struct movieSet {
   char *desc; /*!< A string describing the movie set. */
-  Hashtable doc_index; /*!< A hashtable that holds the info about which doc each movie is in*/
-  int num_movies;
+  struct postingBitmap postings; /*!< Every movie in the set, by ordinal. */
+  struct postingBitmap repeats; /*!< Movies with the word more than once. */
 } *MovieSet;
 
 /**
@@ -52,42 +56,61 @@ typedef struct setOfMovies {
  * Adds a Movie to the set.
  *
  * \param set The MovieSet to add the movie to
- * \param doc_id Which document/file the movie is stored in
- * \param row_id Which row in the file the movie can be found.
+ * \param row The row ordinal of the movie.
  *
  * \return 0 if successful.
  */
-int AddMovieToSet(MovieSet set, uint64_t doc_id, int row_id);
+int AddMovieToSet(MovieSet set, uint64_t row);
 
 /**
- * Destroys a movie set, freeing everything necessary.
+ * Adds every movie in src to dest, which must be for the same word.
+ * Meant for sets built from different files, so no movie is in both.
  *
- * /param set the MovieSet to be destroyed.
+ * \param dest The MovieSet to add the movies to
+ * \param src The MovieSet to add them from; it isn't changed.
  *
+ * \return 0 if successful, -1 if out of memory.
  */
-void DestroyMovieSet(MovieSet set);
+int MergeMovieSets(MovieSet dest, MovieSet src);
 
-void DestroySetOfMovies(SetOfMovies set); 
+/**
+ * Renumbers the rows of the set in runs, as PostingBitmapRebase does:
+ * row i of run r, ordinal (r << run_bits) + i, becomes run_starts[r] + i.
+ *
+ * \return 0 if successful, -1 if out of memory; the set is unchanged
+ *   then.
+ */
+int RebaseMovieSet(MovieSet set, int run_bits, const uint64_t *run_starts);
 
 /**
- * Prints the "offsetList" for a given set of movies .
- * The offset list is the row IDs for each movie in the set.
- * Helpful for debugging.
+ * Counts how many times the set's word is in the title of a movie,
+ * for scoring. Counts past 2 aren't kept.
  *
- * \param list A linkedlist of row Ids (the value of the doc_index)
+ * \return 0 if the movie isn't in the set, otherwise 1 or 2.
  */
-void PrintOffsetList(LinkedList list);
+int TimesInTitle(MovieSet set, uint64_t row);
 
 /**
- * Determines if a MovieSet contains movies from a specifid
- * document or file.
+ * Destroys a movie set, freeing everything necessary.
+ *
+ * /param set the MovieSet to be destroyed.
+ *
+ */
+void DestroyMovieSet(MovieSet set);
+
+void DestroySetOfMovies(SetOfMovies set); 
+
+/**
+ * Determines if a MovieSet contains movies from a run of rows, such as
+ * the rows of one document or file.
  *
  * \param set The MovieSet to query
- * \param doc_id Which doc to look for.
+ * \param first_row The row ordinal of the first row to look for.
+ * \param num_rows How many rows to look for.
  *
- * \return 0 if the doc_id is found, -1 otherwise.
+ * \return 0 if one of the rows is found, -1 otherwise.
  */
-int MovieSetContainsDoc(MovieSet set, uint64_t doc_id);
+int MovieSetContainsRows(MovieSet set, uint64_t first_row, int num_rows);
 
 /**
  * Creates a new, empty MovieSet given the description.
@@ -98,14 +121,6 @@ int MovieSetContainsDoc(MovieSet set, uint64_t doc_id);
  */
 MovieSet CreateMovieSet(char *desc);
 
-/**
- * Destroys the offset lists that are the values
- * of the hashtable.
- *
- * \param val the Offset list to be destroyed.
- */
-void DestroyOffsetList(void *val);
-
 /**
  * Destroys the MovieSet.
  *
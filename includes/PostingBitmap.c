@@ -0,0 +1,835 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "PostingBitmap.h"
+
+#define KEY_OF(value) ((value) >> 16)
+#define LOW_OF(value) ((uint16_t)((value) & 0xFFFF))
+
+// Arrays this many times longer than the other side are galloped
+// through instead of merged.
+#define GALLOP_RATIO 32
+
+static int IsBitmap(PostingContainer *c) {
+  return c->cardinality > POSTING_ARRAY_MAX;
+}
+
+static int TestBit(uint64_t *words, uint16_t low) {
+  return (words[low >> 6] >> (low & 63)) & 1;
+}
+
+static int CountBits(uint64_t *words) {
+  int count = 0;
+  for (int i = 0; i < POSTING_BITMAP_WORDS; i++) {
+    count += __builtin_popcountll(words[i]);
+  }
+  return count;
+}
+
+// Returns the first set bit at or after from, or -1 if there is none.
+static int NextSetBit(uint64_t *words, int from) {
+  if (from >= 65536) {
+    return -1;
+  }
+  int i = from >> 6;
+  uint64_t word = words[i] & (~0ULL << (from & 63));
+  while (1) {
+    if (word != 0) {
+      return (i << 6) + __builtin_ctzll(word);
+    }
+    if (++i == POSTING_BITMAP_WORDS) {
+      return -1;
+    }
+    word = words[i];
+  }
+}
+
+// Returns the first index at or after from whose value is not less than
+// target, by doubling the step until it overshoots and then binary
+// searching the last step.
+static int GallopArray(uint16_t *array, int len, int from, uint16_t target) {
+  int step = 1;
+  int low = from;
+  int high = from;
+  while (high < len && array[high] < target) {
+    low = high + 1;
+    high += step;
+    step *= 2;
+  }
+  if (high > len) {
+    high = len;
+  }
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    if (array[mid] < target) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+// Same as GallopArray, over the container keys of a bitmap.
+static int GallopKeys(PostingBitmap bitmap, int from, uint64_t key) {
+  int step = 1;
+  int low = from;
+  int high = from;
+  while (high < bitmap->num_containers &&
+         bitmap->containers[high].key < key) {
+    low = high + 1;
+    high += step;
+    step *= 2;
+  }
+  if (high > bitmap->num_containers) {
+    high = bitmap->num_containers;
+  }
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    if (bitmap->containers[mid].key < key) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+static int ContainerContains(PostingContainer *c, uint16_t low) {
+  if (IsBitmap(c)) {
+    return TestBit(c->data.words, low);
+  }
+  int i = GallopArray(c->data.array, c->cardinality, 0, low);
+  return i < c->cardinality && c->data.array[i] == low;
+}
+
+// Returns the smallest value in the container that is at least low,
+// or -1 if there is none.
+static int ContainerFirstFrom(PostingContainer *c, uint16_t low) {
+  if (IsBitmap(c)) {
+    return NextSetBit(c->data.words, low);
+  }
+  int i = GallopArray(c->data.array, c->cardinality, 0, low);
+  return i < c->cardinality ? c->data.array[i] : -1;
+}
+
+// Turns a sorted array into a bitmap's words.
+// Returns NULL if out of memory.
+static uint64_t *ArrayToWords(uint16_t *array, int len) {
+  uint64_t *words = (uint64_t*)calloc(POSTING_BITMAP_WORDS, sizeof(uint64_t));
+  if (words == NULL) {
+    return NULL;
+  }
+  for (int i = 0; i < len; i++) {
+    words[array[i] >> 6] |= 1ULL << (array[i] & 63);
+  }
+  return words;
+}
+
+// Fills in c from words with cardinality set bits, turning them back into
+// an array if there are few enough. words belongs to c afterwards (or is
+// freed). Returns 0 if successful, -1 if out of memory.
+static int ContainerFromWords(PostingContainer *c, uint64_t key,
+                              uint64_t *words, int cardinality) {
+  c->key = key;
+  c->cardinality = cardinality;
+  if (cardinality > POSTING_ARRAY_MAX) {
+    c->capacity = 0;
+    c->data.words = words;
+    return 0;
+  }
+  c->capacity = cardinality;
+  c->data.array = (uint16_t*)malloc((cardinality + 1) * sizeof(uint16_t));
+  if (c->data.array == NULL) {
+    free(words);
+    return -1;
+  }
+  int n = 0;
+  for (int bit = NextSetBit(words, 0); bit >= 0;
+       bit = NextSetBit(words, bit + 1)) {
+    c->data.array[n++] = bit;
+  }
+  free(words);
+  return 0;
+}
+
+// Adds low to the container.
+// Returns 1 if it was added, 0 if it was already there, -1 if out of memory.
+static int ContainerAdd(PostingContainer *c, uint16_t low) {
+  if (IsBitmap(c)) {
+    if (TestBit(c->data.words, low)) {
+      return 0;
+    }
+    c->data.words[low >> 6] |= 1ULL << (low & 63);
+    c->cardinality++;
+    return 1;
+  }
+
+  // Rows are usually added in order, so check the end first.
+  int i = c->cardinality;
+  if (i > 0 && c->data.array[i - 1] >= low) {
+    i = GallopArray(c->data.array, c->cardinality, 0, low);
+    if (c->data.array[i] == low) {
+      return 0;
+    }
+  }
+
+  if (c->cardinality == POSTING_ARRAY_MAX) {
+    uint64_t *words = ArrayToWords(c->data.array, c->cardinality);
+    if (words == NULL) {
+      return -1;
+    }
+    free(c->data.array);
+    c->data.words = words;
+    c->capacity = 0;
+    c->data.words[low >> 6] |= 1ULL << (low & 63);
+    c->cardinality++;
+    return 1;
+  }
+
+  if (c->cardinality == c->capacity) {
+    int capacity = c->capacity < 4 ? 4 : c->capacity * 2;
+    if (capacity > POSTING_ARRAY_MAX) {
+      capacity = POSTING_ARRAY_MAX;
+    }
+    uint16_t *array = (uint16_t*)realloc(c->data.array,
+                                         capacity * sizeof(uint16_t));
+    if (array == NULL) {
+      return -1;
+    }
+    c->data.array = array;
+    c->capacity = capacity;
+  }
+  memmove(c->data.array + i + 1, c->data.array + i,
+          (c->cardinality - i) * sizeof(uint16_t));
+  c->data.array[i] = low;
+  c->cardinality++;
+  return 1;
+}
+
+static int ContainerCopy(PostingContainer *src, PostingContainer *out) {
+  *out = *src;
+  if (IsBitmap(src)) {
+    out->data.words = (uint64_t*)malloc(POSTING_BITMAP_WORDS *
+                                        sizeof(uint64_t));
+    if (out->data.words == NULL) {
+      return -1;
+    }
+    memcpy(out->data.words, src->data.words,
+           POSTING_BITMAP_WORDS * sizeof(uint64_t));
+    return 0;
+  }
+  out->capacity = src->cardinality;
+  out->data.array = (uint16_t*)malloc((src->cardinality + 1) *
+                                      sizeof(uint16_t));
+  if (out->data.array == NULL) {
+    return -1;
+  }
+  memcpy(out->data.array, src->data.array,
+         src->cardinality * sizeof(uint16_t));
+  return 0;
+}
+
+// Intersects two array containers into out's array, which has room.
+static int IntersectArrays(uint16_t *a, int len_a, uint16_t *b, int len_b,
+                           uint16_t *out) {
+  int n = 0;
+  if (len_a > len_b) {
+    uint16_t *tmp_array = a;
+    int tmp_len = len_a;
+    a = b;
+    len_a = len_b;
+    b = tmp_array;
+    len_b = tmp_len;
+  }
+  if (len_a * GALLOP_RATIO < len_b) {
+    int j = 0;
+    for (int i = 0; i < len_a && j < len_b; i++) {
+      j = GallopArray(b, len_b, j, a[i]);
+      if (j < len_b && b[j] == a[i]) {
+        out[n++] = a[i];
+      }
+    }
+    return n;
+  }
+  int i = 0, j = 0;
+  while (i < len_a && j < len_b) {
+    if (a[i] < b[j]) {
+      i++;
+    } else if (a[i] > b[j]) {
+      j++;
+    } else {
+      out[n++] = a[i];
+      i++;
+      j++;
+    }
+  }
+  return n;
+}
+
+// Intersects two containers with the same key. out's cardinality is 0
+// if nothing is in both. Returns 0 if successful, -1 if out of memory.
+static int ContainerAnd(PostingContainer *a, PostingContainer *b,
+                        PostingContainer *out) {
+  out->key = a->key;
+  if (IsBitmap(a) && IsBitmap(b)) {
+    uint64_t *words = (uint64_t*)malloc(POSTING_BITMAP_WORDS *
+                                        sizeof(uint64_t));
+    if (words == NULL) {
+      return -1;
+    }
+    for (int i = 0; i < POSTING_BITMAP_WORDS; i++) {
+      words[i] = a->data.words[i] & b->data.words[i];
+    }
+    return ContainerFromWords(out, a->key, words, CountBits(words));
+  }
+
+  // At least one side is an array, so the result fits in an array.
+  if (IsBitmap(a)) {
+    PostingContainer *tmp = a;
+    a = b;
+    b = tmp;
+  }
+  out->data.array = (uint16_t*)malloc((a->cardinality + 1) *
+                                      sizeof(uint16_t));
+  if (out->data.array == NULL) {
+    return -1;
+  }
+  out->capacity = a->cardinality;
+  if (IsBitmap(b)) {
+    int n = 0;
+    for (int i = 0; i < a->cardinality; i++) {
+      if (TestBit(b->data.words, a->data.array[i])) {
+        out->data.array[n++] = a->data.array[i];
+      }
+    }
+    out->cardinality = n;
+  } else {
+    out->cardinality = IntersectArrays(a->data.array, a->cardinality,
+                                       b->data.array, b->cardinality,
+                                       out->data.array);
+  }
+  return 0;
+}
+
+// Unions two containers with the same key.
+// Returns 0 if successful, -1 if out of memory.
+static int ContainerOr(PostingContainer *a, PostingContainer *b,
+                       PostingContainer *out) {
+  out->key = a->key;
+  if (!IsBitmap(a) && !IsBitmap(b) &&
+      a->cardinality + b->cardinality <= POSTING_ARRAY_MAX) {
+    out->data.array = (uint16_t*)malloc(
+        (a->cardinality + b->cardinality + 1) * sizeof(uint16_t));
+    if (out->data.array == NULL) {
+      return -1;
+    }
+    out->capacity = a->cardinality + b->cardinality;
+    int i = 0, j = 0, n = 0;
+    while (i < a->cardinality || j < b->cardinality) {
+      if (j == b->cardinality ||
+          (i < a->cardinality && a->data.array[i] < b->data.array[j])) {
+        out->data.array[n++] = a->data.array[i++];
+      } else if (i == a->cardinality ||
+                 b->data.array[j] < a->data.array[i]) {
+        out->data.array[n++] = b->data.array[j++];
+      } else {
+        out->data.array[n++] = a->data.array[i++];
+        j++;
+      }
+    }
+    out->cardinality = n;
+    return 0;
+  }
+
+  if (IsBitmap(b)) {
+    PostingContainer *tmp = a;
+    a = b;
+    b = tmp;
+  }
+  uint64_t *words;
+  if (IsBitmap(a)) {
+    words = (uint64_t*)malloc(POSTING_BITMAP_WORDS * sizeof(uint64_t));
+    if (words != NULL) {
+      memcpy(words, a->data.words, POSTING_BITMAP_WORDS * sizeof(uint64_t));
+    }
+  } else {
+    words = ArrayToWords(a->data.array, a->cardinality);
+  }
+  if (words == NULL) {
+    return -1;
+  }
+  if (IsBitmap(b)) {
+    for (int i = 0; i < POSTING_BITMAP_WORDS; i++) {
+      words[i] |= b->data.words[i];
+    }
+  } else {
+    for (int i = 0; i < b->cardinality; i++) {
+      uint16_t low = b->data.array[i];
+      words[low >> 6] |= 1ULL << (low & 63);
+    }
+  }
+  return ContainerFromWords(out, a->key, words, CountBits(words));
+}
+
+// Takes the values in b out of a, for two containers with the same key.
+// Returns 0 if successful, -1 if out of memory.
+static int ContainerAndNot(PostingContainer *a, PostingContainer *b,
+                           PostingContainer *out) {
+  out->key = a->key;
+  if (IsBitmap(a)) {
+    uint64_t *words = (uint64_t*)malloc(POSTING_BITMAP_WORDS *
+                                        sizeof(uint64_t));
+    if (words == NULL) {
+      return -1;
+    }
+    memcpy(words, a->data.words, POSTING_BITMAP_WORDS * sizeof(uint64_t));
+    if (IsBitmap(b)) {
+      for (int i = 0; i < POSTING_BITMAP_WORDS; i++) {
+        words[i] &= ~b->data.words[i];
+      }
+    } else {
+      for (int i = 0; i < b->cardinality; i++) {
+        uint16_t low = b->data.array[i];
+        words[low >> 6] &= ~(1ULL << (low & 63));
+      }
+    }
+    return ContainerFromWords(out, a->key, words, CountBits(words));
+  }
+
+  out->data.array = (uint16_t*)malloc((a->cardinality + 1) *
+                                      sizeof(uint16_t));
+  if (out->data.array == NULL) {
+    return -1;
+  }
+  out->capacity = a->cardinality;
+  int n = 0, j = 0;
+  for (int i = 0; i < a->cardinality; i++) {
+    uint16_t low = a->data.array[i];
+    int found;
+    if (IsBitmap(b)) {
+      found = TestBit(b->data.words, low);
+    } else {
+      j = GallopArray(b->data.array, b->cardinality, j, low);
+      found = j < b->cardinality && b->data.array[j] == low;
+    }
+    if (!found) {
+      out->data.array[n++] = low;
+    }
+  }
+  out->cardinality = n;
+  return 0;
+}
+
+// Makes room for a new, empty container at index.
+// Returns 0 if successful, -1 if out of memory.
+static int InsertContainer(PostingBitmap bitmap, int index, uint64_t key) {
+  if (bitmap->num_containers == bitmap->capacity) {
+    int capacity = bitmap->capacity == 0 ? 1 : bitmap->capacity * 2;
+    PostingContainer *containers = (PostingContainer*)realloc(
+        bitmap->containers, capacity * sizeof(PostingContainer));
+    if (containers == NULL) {
+      return -1;
+    }
+    bitmap->containers = containers;
+    bitmap->capacity = capacity;
+  }
+  memmove(bitmap->containers + index + 1, bitmap->containers + index,
+          (bitmap->num_containers - index) * sizeof(PostingContainer));
+  PostingContainer *c = &bitmap->containers[index];
+  c->key = key;
+  c->cardinality = 0;
+  c->capacity = 0;
+  c->data.array = NULL;
+  bitmap->num_containers++;
+  return 0;
+}
+
+// Adds a finished container to the end of out, or frees it if it is
+// empty. Containers must be appended in key order.
+// Returns 0 if successful, -1 if out of memory.
+static int AppendContainer(PostingBitmap out, PostingContainer *c) {
+  if (c->cardinality == 0) {
+    free(c->data.array);
+    return 0;
+  }
+  if (InsertContainer(out, out->num_containers, c->key) != 0) {
+    free(c->data.array);
+    return -1;
+  }
+  out->containers[out->num_containers - 1] = *c;
+  out->cardinality += c->cardinality;
+  return 0;
+}
+
+// Copies a container and appends the copy to out.
+static int AppendCopy(PostingBitmap out, PostingContainer *c) {
+  PostingContainer copy;
+  if (ContainerCopy(c, &copy) != 0) {
+    return -1;
+  }
+  return AppendContainer(out, &copy);
+}
+
+// Appends a container whose values are all bigger than every value in
+// out, ORing it into out's last container if that has the same key. c
+// belongs to out afterwards (or is freed).
+// Returns 0 if successful, -1 if out of memory.
+static int AppendAfter(PostingBitmap out, PostingContainer *c) {
+  int n = out->num_containers;
+  if (n == 0 || out->containers[n - 1].key != c->key) {
+    return AppendContainer(out, c);
+  }
+  PostingContainer *last = &out->containers[n - 1];
+  PostingContainer merged;
+  int result = ContainerOr(last, c, &merged);
+  free(c->data.array);
+  if (result != 0) {
+    return -1;
+  }
+  out->cardinality += merged.cardinality - last->cardinality;
+  free(last->data.array);
+  *last = merged;
+  return 0;
+}
+
+// Appends array[0..len) + shift, all bigger than every value in out, to
+// out as values of key. Most of the time out's last container is an
+// array with the same key and room, and they go on the end of it.
+// Returns 0 if successful, -1 if out of memory.
+static int AppendShiftedArray(PostingBitmap out, uint64_t key,
+                              uint16_t *array, int len, int shift) {
+  if (len == 0) {
+    return 0;
+  }
+  int n = out->num_containers;
+  PostingContainer *last = n > 0 ? &out->containers[n - 1] : NULL;
+  if (last != NULL && last->key == key && !IsBitmap(last) &&
+      last->cardinality + len <= POSTING_ARRAY_MAX) {
+    if (last->capacity < last->cardinality + len) {
+      uint16_t *bigger = (uint16_t*)realloc(
+          last->data.array, (last->cardinality + len + 1) * sizeof(uint16_t));
+      if (bigger == NULL) {
+        return -1;
+      }
+      last->data.array = bigger;
+      last->capacity = last->cardinality + len;
+    }
+    for (int i = 0; i < len; i++) {
+      last->data.array[last->cardinality + i] = array[i] + shift;
+    }
+    last->cardinality += len;
+    out->cardinality += len;
+    return 0;
+  }
+
+  PostingContainer c;
+  c.key = key;
+  c.cardinality = len;
+  c.capacity = len;
+  c.data.array = (uint16_t*)malloc((len + 1) * sizeof(uint16_t));
+  if (c.data.array == NULL) {
+    return -1;
+  }
+  for (int i = 0; i < len; i++) {
+    c.data.array[i] = array[i] + shift;
+  }
+  return AppendAfter(out, &c);
+}
+
+// Appends words, with every bit moved up by shift, to out: the bits
+// that stay under 65536 as values of key, and the rest as values of
+// key + 1.
+// Returns 0 if successful, -1 if out of memory.
+static int AppendShiftedWords(PostingBitmap out, uint64_t key,
+                              uint64_t *words, int shift) {
+  uint64_t *halves[2];
+  halves[0] = (uint64_t*)calloc(POSTING_BITMAP_WORDS, sizeof(uint64_t));
+  halves[1] = (uint64_t*)calloc(POSTING_BITMAP_WORDS, sizeof(uint64_t));
+  if (halves[0] == NULL || halves[1] == NULL) {
+    free(halves[0]);
+    free(halves[1]);
+    return -1;
+  }
+  int word_shift = shift >> 6;
+  int bit_shift = shift & 63;
+  for (int i = 0; i < POSTING_BITMAP_WORDS; i++) {
+    int to = i + word_shift;
+    halves[to / POSTING_BITMAP_WORDS][to % POSTING_BITMAP_WORDS] |=
+      words[i] << bit_shift;
+    if (bit_shift > 0) {
+      to++;
+      halves[to / POSTING_BITMAP_WORDS][to % POSTING_BITMAP_WORDS] |=
+        words[i] >> (64 - bit_shift);
+    }
+  }
+  int result = 0;
+  for (int half = 0; half < 2; half++) {
+    int cardinality = CountBits(halves[half]);
+    if (cardinality == 0 || result != 0) {
+      free(halves[half]);
+      continue;
+    }
+    PostingContainer c;
+    if (ContainerFromWords(&c, key + half, halves[half], cardinality) != 0 ||
+        AppendAfter(out, &c) != 0) {
+      result = -1;
+    }
+  }
+  return result;
+}
+
+int PostingBitmapRebase(PostingBitmap bitmap, int run_bits,
+                        const uint64_t *run_starts, PostingBitmap out) {
+  uint64_t run_mask = (1ULL << run_bits) - 1;
+
+  for (int i = 0; i < bitmap->num_containers; i++) {
+    PostingContainer *c = &bitmap->containers[i];
+    uint64_t first = c->key << 16;
+    // Where the container's value 0 would go. Every run starts on a
+    // container, so the whole container moves by the same amount.
+    uint64_t to = run_starts[first >> run_bits] + (first & run_mask);
+    int shift = to & 0xFFFF;
+    int result;
+    if (IsBitmap(c)) {
+      result = AppendShiftedWords(out, KEY_OF(to), c->data.words, shift);
+    } else {
+      // The values from 65536 - shift up go over into the next key.
+      int split = shift == 0 ? c->cardinality :
+        GallopArray(c->data.array, c->cardinality, 0, 65536 - shift);
+      result = AppendShiftedArray(out, KEY_OF(to), c->data.array, split,
+                                  shift);
+      if (result == 0) {
+        result = AppendShiftedArray(out, KEY_OF(to) + 1,
+                                    c->data.array + split,
+                                    c->cardinality - split, shift);
+      }
+    }
+    if (result != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void InitPostingBitmap(PostingBitmap bitmap) {
+  bitmap->containers = NULL;
+  bitmap->num_containers = 0;
+  bitmap->capacity = 0;
+  bitmap->cardinality = 0;
+}
+
+void FreePostingBitmap(PostingBitmap bitmap) {
+  for (int i = 0; i < bitmap->num_containers; i++) {
+    free(bitmap->containers[i].data.array);
+  }
+  free(bitmap->containers);
+  InitPostingBitmap(bitmap);
+}
+
+int PostingBitmapAdd(PostingBitmap bitmap, uint64_t value) {
+  uint64_t key = KEY_OF(value);
+  int n = bitmap->num_containers;
+  int index;
+
+  // Rows are usually added in order, so check the last container first.
+  if (n > 0 && bitmap->containers[n - 1].key == key) {
+    index = n - 1;
+  } else if (n == 0 || bitmap->containers[n - 1].key < key) {
+    index = n;
+  } else {
+    index = GallopKeys(bitmap, 0, key);
+  }
+  if (index == n || bitmap->containers[index].key != key) {
+    if (InsertContainer(bitmap, index, key) != 0) {
+      return -1;
+    }
+  }
+
+  int result = ContainerAdd(&bitmap->containers[index], LOW_OF(value));
+  if (result == 1) {
+    bitmap->cardinality++;
+  }
+  return result;
+}
+
+int PostingBitmapAppendWords(PostingBitmap bitmap, uint64_t key,
+                             uint64_t *words) {
+  int cardinality = CountBits(words);
+  if (cardinality == 0) {
+    return 0;
+  }
+  uint64_t *copy = (uint64_t*)malloc(POSTING_BITMAP_WORDS * sizeof(uint64_t));
+  if (copy == NULL) {
+    return -1;
+  }
+  memcpy(copy, words, POSTING_BITMAP_WORDS * sizeof(uint64_t));
+  PostingContainer c;
+  if (ContainerFromWords(&c, key, copy, cardinality) != 0) {
+    return -1;
+  }
+  return AppendContainer(bitmap, &c);
+}
+
+int PostingBitmapContains(PostingBitmap bitmap, uint64_t value) {
+  int index = GallopKeys(bitmap, 0, KEY_OF(value));
+  if (index == bitmap->num_containers ||
+      bitmap->containers[index].key != KEY_OF(value)) {
+    return 0;
+  }
+  return ContainerContains(&bitmap->containers[index], LOW_OF(value));
+}
+
+int PostingBitmapCardinality(PostingBitmap bitmap) {
+  return bitmap->cardinality;
+}
+
+int PostingBitmapNextValue(PostingBitmap bitmap, uint64_t from,
+                           uint64_t *value) {
+  int index = GallopKeys(bitmap, 0, KEY_OF(from));
+  int low = -1;
+  if (index < bitmap->num_containers &&
+      bitmap->containers[index].key == KEY_OF(from)) {
+    low = ContainerFirstFrom(&bitmap->containers[index], LOW_OF(from));
+    if (low < 0) {
+      index++;
+    }
+  }
+  if (low < 0) {
+    if (index == bitmap->num_containers) {
+      return -1;
+    }
+    low = ContainerFirstFrom(&bitmap->containers[index], 0);
+  }
+  *value = (bitmap->containers[index].key << 16) | (uint64_t)low;
+  return 0;
+}
+
+int PostingBitmapCopy(PostingBitmap src, PostingBitmap out) {
+  for (int i = 0; i < src->num_containers; i++) {
+    if (AppendCopy(out, &src->containers[i]) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int PostingBitmapAnd(PostingBitmap a, PostingBitmap b, PostingBitmap out) {
+  int i = 0, j = 0;
+  while (i < a->num_containers && j < b->num_containers) {
+    uint64_t key_a = a->containers[i].key;
+    uint64_t key_b = b->containers[j].key;
+    if (key_a < key_b) {
+      i = GallopKeys(a, i, key_b);
+    } else if (key_b < key_a) {
+      j = GallopKeys(b, j, key_a);
+    } else {
+      PostingContainer c;
+      if (ContainerAnd(&a->containers[i], &b->containers[j], &c) != 0 ||
+          AppendContainer(out, &c) != 0) {
+        return -1;
+      }
+      i++;
+      j++;
+    }
+  }
+  return 0;
+}
+
+int PostingBitmapOr(PostingBitmap a, PostingBitmap b, PostingBitmap out) {
+  int i = 0, j = 0;
+  while (i < a->num_containers || j < b->num_containers) {
+    int result;
+    if (j == b->num_containers ||
+        (i < a->num_containers &&
+         a->containers[i].key < b->containers[j].key)) {
+      result = AppendCopy(out, &a->containers[i++]);
+    } else if (i == a->num_containers ||
+               b->containers[j].key < a->containers[i].key) {
+      result = AppendCopy(out, &b->containers[j++]);
+    } else {
+      PostingContainer c;
+      result = ContainerOr(&a->containers[i++], &b->containers[j++], &c);
+      if (result == 0) {
+        result = AppendContainer(out, &c);
+      }
+    }
+    if (result != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int PostingBitmapAndNot(PostingBitmap a, PostingBitmap b, PostingBitmap out) {
+  int j = 0;
+  for (int i = 0; i < a->num_containers; i++) {
+    PostingContainer *c = &a->containers[i];
+    int result;
+    j = GallopKeys(b, j, c->key);
+    if (j == b->num_containers || b->containers[j].key != c->key) {
+      result = AppendCopy(out, c);
+    } else {
+      PostingContainer diff;
+      result = ContainerAndNot(c, &b->containers[j], &diff);
+      if (result == 0) {
+        result = AppendContainer(out, &diff);
+      }
+    }
+    if (result != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Puts the iter on the first value of its current container.
+static void FirstInContainer(PostingIter iter) {
+  PostingContainer *c = &iter->bitmap->containers[iter->container];
+  iter->position = IsBitmap(c) ? NextSetBit(c->data.words, 0) : 0;
+}
+
+int PostingIterInit(PostingIter iter, PostingBitmap bitmap) {
+  iter->bitmap = bitmap;
+  iter->container = 0;
+  iter->position = 0;
+  if (bitmap->num_containers == 0) {
+    return -1;
+  }
+  FirstInContainer(iter);
+  return 0;
+}
+
+uint64_t PostingIterGet(PostingIter iter) {
+  PostingContainer *c = &iter->bitmap->containers[iter->container];
+  uint64_t low = IsBitmap(c) ? iter->position : c->data.array[iter->position];
+  return (c->key << 16) | low;
+}
+
+int PostingIterNext(PostingIter iter) {
+  PostingContainer *c = &iter->bitmap->containers[iter->container];
+  if (IsBitmap(c)) {
+    int next = NextSetBit(c->data.words, iter->position + 1);
+    if (next >= 0) {
+      iter->position = next;
+      return 0;
+    }
+  } else if (iter->position + 1 < c->cardinality) {
+    iter->position++;
+    return 0;
+  }
+
+  if (iter->container + 1 == iter->bitmap->num_containers) {
+    return -1;
+  }
+  iter->container++;
+  FirstInContainer(iter);
+  return 0;
+}
+
+int PostingIterHasNext(PostingIter iter) {
+  struct postingIter next = *iter;
+  return PostingIterNext(&next) == 0;
+}
@@ -0,0 +1,165 @@
+#ifndef POSTINGBITMAP_H
+#define POSTINGBITMAP_H
+
+#include <stdint.h>
+
+/**
+ * A PostingBitmap is a compressed set of 64 bit values, laid out like a
+ * Roaring bitmap. Values are split into chunks of 65536 by their high
+ * 48 bits (the key), and every chunk that has any values gets a
+ * container holding their low 16 bits. A container with at most
+ * POSTING_ARRAY_MAX values keeps them in a sorted array of uint16_t,
+ * which is 2 bytes a value; a fuller one is a 65536 bit bitmap, which is
+ * never more than 2 bytes a value either. On top of that, every
+ * container is a PostingContainer and a malloc'd array, so a bitmap
+ * with only a few values in each container costs a lot more than 2
+ * bytes a value. Containers are sorted by key.
+ *
+ * Whether a container is an array or a bitmap follows only from its
+ * cardinality, and every operation keeps it that way.
+ */
+#define POSTING_ARRAY_MAX 4096
+#define POSTING_BITMAP_WORDS 1024
+
+typedef struct postingContainer {
+  uint64_t key;  /*!< The high 48 bits of every value in the container. */
+  int cardinality;
+  int capacity;  /*!< How many values array has room for. */
+  union {
+    uint16_t *array;  /*!< If cardinality <= POSTING_ARRAY_MAX. */
+    uint64_t *words;  /*!< POSTING_BITMAP_WORDS words, otherwise. */
+  } data;
+} PostingContainer;
+
+typedef struct postingBitmap {
+  PostingContainer *containers;
+  int num_containers;
+  int capacity;
+  int cardinality;
+} *PostingBitmap;
+
+/**
+ * Walks the values of a PostingBitmap in ascending order.
+ * position is an index into an array container, or the bit number in a
+ * bitmap container.
+ */
+typedef struct postingIter {
+  PostingBitmap bitmap;
+  int container;
+  int position;
+} *PostingIter;
+
+/**
+ * Sets up an empty bitmap. Bitmaps are usually part of another struct,
+ * so this doesn't allocate anything.
+ */
+void InitPostingBitmap(PostingBitmap bitmap);
+
+/**
+ * Frees every container in the bitmap, leaving it empty.
+ */
+void FreePostingBitmap(PostingBitmap bitmap);
+
+/**
+ * Adds value to the bitmap. Adding values in ascending order is
+ * cheapest, but any order works.
+ *
+ * RETURNS: 1 if the value was added,
+ *          0 if it was already there,
+ *         -1 if out of memory.
+ */
+int PostingBitmapAdd(PostingBitmap bitmap, uint64_t value);
+
+/**
+ * Adds the values key * 65536 + i, for every bit i set in words, as a
+ * new last container. words has POSTING_BITMAP_WORDS words and isn't
+ * changed. key must be bigger than the key of every value already in
+ * the bitmap. Much cheaper than adding the values one at a time when
+ * they were found by checking every value in order.
+ *
+ * RETURNS: 0 if successful, -1 if out of memory.
+ */
+int PostingBitmapAppendWords(PostingBitmap bitmap, uint64_t key,
+                             uint64_t *words);
+
+/**
+ * RETURNS: 1 if value is in the bitmap, 0 otherwise.
+ */
+int PostingBitmapContains(PostingBitmap bitmap, uint64_t value);
+
+/**
+ * RETURNS: How many values are in the bitmap.
+ */
+int PostingBitmapCardinality(PostingBitmap bitmap);
+
+/**
+ * Finds the smallest value in the bitmap that is at least from.
+ *
+ * RETURNS: 0 and sets value if there is one, -1 otherwise.
+ */
+int PostingBitmapNextValue(PostingBitmap bitmap, uint64_t from,
+                           uint64_t *value);
+
+/**
+ * The set operations below write their result into out, which must be
+ * an empty bitmap and must not be one of the inputs. The inputs aren't
+ * changed.
+ *
+ * RETURNS: 0 if successful, -1 if out of memory; out then holds part of
+ *          the result and should be freed.
+ */
+int PostingBitmapCopy(PostingBitmap src, PostingBitmap out);
+
+/** Every value in both a and b. */
+int PostingBitmapAnd(PostingBitmap a, PostingBitmap b, PostingBitmap out);
+
+/** Every value in a or b. */
+int PostingBitmapOr(PostingBitmap a, PostingBitmap b, PostingBitmap out);
+
+/** Every value in a that isn't in b. */
+int PostingBitmapAndNot(PostingBitmap a, PostingBitmap b, PostingBitmap out);
+
+/**
+ * Renumbers the values of bitmap into out, in runs: value v is in run
+ * r = v >> run_bits and becomes run_starts[r] + (v & (2^run_bits - 1)).
+ * Values can be given out before it is known how many each run needs,
+ * and moved next to each other once it is. run_bits must be at least
+ * 16, and the runs must stay in order without overlapping: no value of
+ * run r may become run_starts[r + 1] or more.
+ *
+ * Each container is shifted as a whole and appended to out, so this
+ * costs about as much as a copy.
+ *
+ * RETURNS: 0 if successful, -1 if out of memory; out then holds part of
+ *          the result and should be freed.
+ */
+int PostingBitmapRebase(PostingBitmap bitmap, int run_bits,
+                        const uint64_t *run_starts, PostingBitmap out);
+
+/**
+ * Points the iter at the smallest value in the bitmap. The bitmap must
+ * not change while the iter is in use.
+ *
+ * RETURNS: 0 if successful, -1 if the bitmap is empty.
+ */
+int PostingIterInit(PostingIter iter, PostingBitmap bitmap);
+
+/**
+ * RETURNS: The value the iter is on.
+ */
+uint64_t PostingIterGet(PostingIter iter);
+
+/**
+ * Moves the iter to the next value.
+ *
+ * RETURNS: 0 if successful, -1 if there are no more values; the iter
+ *          then stays on the last one.
+ */
+int PostingIterNext(PostingIter iter);
+
+/**
+ * RETURNS: 1 if there is a value after the one the iter is on, 0 if not.
+ */
+int PostingIterHasNext(PostingIter iter);
+
+#endif
@@ -19,13 +19,84 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
 
 #include "QueryProcessor.h"
+#include "FileParser.h"
 #include "MovieIndex.h"
 #include "htll/LinkedList.h"
 #include "htll/Hashtable.h"
 
-SearchResultIter CreateSearchResultIter(MovieSet set) {
+// Most terms and most OR'd groups a single query can have.
+#define MAX_QUERY_TERMS 32
+
+// Ranked queries start with this, optionally followed by how many
+// results to return, as in "rank:20 the love".
+#define RANK_PREFIX "rank:"
+#define RANK_DEFAULT_K 10
+#define RANK_MAX_K 1000
+
+// Prefix queries start with this, as in "prefix:lov", and match the
+// movies with the PREFIX_COMPLETIONS most common words that start with
+// what follows.
+#define PREFIX_PREFIX "prefix:"
+#define PREFIX_COMPLETIONS 10
+
+// Fuzzy queries start with this, optionally followed by how many edits
+// to allow, as in "fuzzy:1 lvoe". They match the movies with the
+// FUZZY_MATCHES closest words.
+#define FUZZY_PREFIX "fuzzy:"
+#define FUZZY_MATCHES 10
+
+// Fields a query can filter on, as in "year:2010..2015 genre:comedy".
+static const char *FILTER_FIELDS[] = { "year", "runtime", "type", "genre",
+                                       "adult" };
+#define NUM_FILTER_FIELDS 5
+// Most numbers a range like "year:2010..2015" can cover, when the Index
+// has no ColumnStore and each number is looked up on its own.
+#define MAX_FILTER_RANGE 10000
+// Most values separated by commas a filter with a range can have, as in
+// "year:1990..1995,2013".
+#define MAX_FILTER_RANGES 16
+// Ranges on year or runtime covering at most MAX_LOOKUP_RANGE numbers,
+// at most MAX_LOOKUP_SETS of which some movie has, are looked up one
+// number at a time; the rest are checked against the ColumnStore.
+#define MAX_LOOKUP_RANGE 256
+#define MAX_LOOKUP_SETS 64
+
+// Most values each facet lists.
+#define FACET_LIMIT 10
+
+// The usual BM25 constants: how fast repeating a word stops helping,
+// and how much a long title is penalized.
+#define BM25_K1 1.2
+#define BM25_B 0.75
+
+// Finds the doc_id and row_id of a row ordinal of iter's index. The
+// file is only looked up when the row isn't in the same one as the last.
+static void ResultOfRow(SearchResultIter iter, uint64_t row,
+                        SearchResult output) {
+  RowFile *file = &iter->cur_file;
+  if ((row < (uint64_t)file->first_row ||
+       row >= (uint64_t)file->first_row + file->num_rows) &&
+      FindRowFile(iter->index, row, file) != 0) {
+    output->doc_id = 0;
+    output->row_id = -1;
+    return;
+  }
+  output->doc_id = file->doc_id;
+  output->row_id = row - file->first_row;
+}
+
+// Makes an iter over bitmap, whose rows are index's. If owned is 1,
+// bitmap was made just for this query and the iter takes it over;
+// otherwise it belongs to a MovieSet and is only read.
+static SearchResultIter CreateIterOverPostings(Index index,
+                                               PostingBitmap bitmap,
+                                               int owned) {
   SearchResultIter iter =
     (SearchResultIter)malloc(sizeof(struct searchResultIter));
 
@@ -34,98 +105,1522 @@ SearchResultIter CreateSearchResultIter(MovieSet set) {
     return NULL;
   }
 
-  // Initialize doc_iter
-  iter->doc_iter = CreateHashtableIterator((Hashtable)set->doc_index);
-
-  if (iter->doc_iter == NULL) {
+  InitPostingBitmap(&iter->owned);
+  iter->index = index;
+  memset(&iter->cur_file, 0, sizeof(iter->cur_file));
+  iter->ranked = NULL;
+  iter->cur_result = 0;
+  iter->facets = NULL;
+  iter->rows_wanted = 1;
+  if (owned) {
+    iter->owned = *bitmap;
+    bitmap = &iter->owned;
+  }
+  if (PostingIterInit(&iter->postings, bitmap) != 0) {
     printf("Couldn't create an iterator; or iterator was empty (no docs)\n");
   }
+  iter->numResults = PostingBitmapCardinality(bitmap);
+  iter->cur_doc_id = 0;
+  if (iter->numResults > 0) {
+    struct searchResult sr;
+    ResultOfRow(iter, PostingIterGet(&iter->postings), &sr);
+    iter->cur_doc_id = sr.doc_id;
+  }
+  return iter;
+}
 
-  // Initialize offset_iter
-  HTKeyValue kvp;
-  HTIteratorGet(iter->doc_iter, &kvp);
+SearchResultIter CreateSearchResultIter(Index index, MovieSet set) {
+  return CreateIterOverPostings(index, &set->postings, 0);
+}
 
-  // key is docid
-  iter->cur_doc_id = kvp.key;
-  // value is offset list
-  iter->offset_iter = CreateLLIter((LinkedList)kvp.value);
+SearchResultIter CreateIterOverResults(struct searchResult *results,
+                                       int num_results, const char *facets,
+                                       int rows_wanted) {
+  SearchResultIter iter =
+    (SearchResultIter)malloc(sizeof(struct searchResultIter));
+  char *facets_copy = facets == NULL ? NULL : strdup(facets);
 
+  if (iter == NULL || (facets != NULL && facets_copy == NULL)) {
+    printf("Couldn't malloc for an iter in CreateIterOverResults\n");
+    free(iter);
+    free(facets_copy);
+    free(results);
+    return NULL;
+  }
+  InitPostingBitmap(&iter->owned);
+  PostingIterInit(&iter->postings, &iter->owned);
+  iter->index = NULL;
+  memset(&iter->cur_file, 0, sizeof(iter->cur_file));
+  iter->facets = facets_copy;
+  iter->rows_wanted = rows_wanted;
+  iter->ranked = results;
+  iter->numResults = num_results;
+  iter->cur_result = 0;
+  iter->cur_doc_id = num_results > 0 ? results[0].doc_id : 0;
   return iter;
 }
 
 void DestroySearchResultIter(SearchResultIter iter) {
-  // Destroy LLIter
-  if (iter->offset_iter != NULL) {
-    DestroyLLIter(iter->offset_iter);
+  FreePostingBitmap(&iter->owned);
+  free(iter->ranked);
+  free(iter->facets);
+  free(iter);
+}
+
+
+int NumResultsInIter(SearchResultIter iter) {
+  return iter->numResults;
+}
+
+// One run of terms joined by AND: every term in terms must match,
+// and none of the terms in not_terms may.
+typedef struct queryGroup {
+  MovieSet terms[MAX_QUERY_TERMS];
+  int num_terms;
+  MovieSet not_terms[MAX_QUERY_TERMS];
+  int num_not_terms;
+  int missing_term;  // 1 if a term in terms isn't in the index.
+} QueryGroup;
+
+static int CompareSetSizes(const void *a, const void *b) {
+  return NumMoviesInSet(*(MovieSet*)a) - NumMoviesInSet(*(MovieSet*)b);
+}
+
+// Sets of postings are combined with the PostingBitmap operations, which
+// write into a fresh bitmap. This runs one of them on result and other
+// and puts the answer back in result.
+// Returns 0 if successful, -1 if out of memory.
+static int ApplyToPostings(int (*op)(PostingBitmap, PostingBitmap,
+                                     PostingBitmap),
+                           PostingBitmap result, PostingBitmap other) {
+  struct postingBitmap out;
+  InitPostingBitmap(&out);
+  if (op(result, other, &out) != 0) {
+    printf("Couldn't malloc to combine postings\n");
+    FreePostingBitmap(&out);
+    return -1;
   }
+  FreePostingBitmap(result);
+  *result = out;
+  return 0;
+}
 
-  // Destroy doc_iter
-  DestroyHashtableIterator(iter->doc_iter);
+// Finds the results for one AND group that pass filter, starting from
+// its smallest set, so the filter and the bigger sets are only ANDed
+// with what is left of it. filter may be NULL for no filter. result must
+// be empty.
+// Returns 0 if successful, -1 if out of memory.
+static int EvaluateGroup(QueryGroup *group, PostingBitmap filter,
+                         PostingBitmap result) {
+  if (group->missing_term || group->num_terms == 0) {
+    return 0;
+  }
 
-  free(iter);
+  qsort(group->terms, group->num_terms, sizeof(MovieSet), &CompareSetSizes);
+  int next = 1;
+  if (filter != NULL) {
+    if (PostingBitmapAnd(&group->terms[0]->postings, filter, result) != 0) {
+      printf("Couldn't malloc to combine postings\n");
+      return -1;
+    }
+  } else if (group->num_terms == 1) {
+    if (PostingBitmapCopy(&group->terms[0]->postings, result) != 0) {
+      printf("Couldn't malloc postings for %s\n", group->terms[0]->desc);
+      return -1;
+    }
+  } else {
+    if (PostingBitmapAnd(&group->terms[0]->postings,
+                         &group->terms[1]->postings, result) != 0) {
+      printf("Couldn't malloc to combine postings\n");
+      return -1;
+    }
+    next = 2;
+  }
+  for (int i = next; i < group->num_terms &&
+           PostingBitmapCardinality(result) > 0; i++) {
+    if (ApplyToPostings(&PostingBitmapAnd, result,
+                        &group->terms[i]->postings) != 0) {
+      return -1;
+    }
+  }
+  for (int i = 0; i < group->num_not_terms &&
+           PostingBitmapCardinality(result) > 0; i++) {
+    if (ApplyToPostings(&PostingBitmapAndNot, result,
+                        &group->not_terms[i]->postings) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Splits the query into AND groups separated by OR, looking up each term.
+// Returns the number of groups, or -1 if the query has too many terms.
+static int ParseQuery(Index index, char *query, QueryGroup *groups) {
+  char *saveptr;
+  int num_groups = 0;
+  int negate = 0;
+  QueryGroup *group = NULL;
+
+  for (char *token = strtok_r(query, " \t\r\n", &saveptr); token != NULL;
+       token = strtok_r(NULL, " \t\r\n", &saveptr)) {
+    if (strcmp(token, "AND") == 0) {
+      continue;
+    }
+    if (strcmp(token, "OR") == 0) {
+      group = NULL;
+      negate = 0;
+      continue;
+    }
+    if (strcmp(token, "NOT") == 0) {
+      negate = 1;
+      continue;
+    }
+    if (group == NULL) {
+      if (num_groups == MAX_QUERY_TERMS) {
+        return -1;
+      }
+      group = &groups[num_groups++];
+      group->num_terms = 0;
+      group->num_not_terms = 0;
+      group->missing_term = 0;
+    }
+    if (group->num_terms + group->num_not_terms == MAX_QUERY_TERMS) {
+      return -1;
+    }
+
+    MovieSet set = GetMovieSet(index, token);
+    if (negate) {
+      // A term nobody has can't take anything away.
+      if (set != NULL) {
+        group->not_terms[group->num_not_terms++] = set;
+      }
+    } else if (set == NULL) {
+      group->missing_term = 1;
+    } else {
+      group->terms[group->num_terms++] = set;
+    }
+    negate = 0;
+  }
+  return num_groups;
+}
+
+// Returns 1 if token filters on a field, like "type:movie".
+static int IsFilter(const char *token) {
+  const char *colon = strchr(token, ':');
+  if (colon == NULL) {
+    return 0;
+  }
+  for (int i = 0; i < NUM_FILTER_FIELDS; i++) {
+    if (strlen(FILTER_FIELDS[i]) == (size_t)(colon - token) &&
+        strncmp(token, FILTER_FIELDS[i], colon - token) == 0) {
+      return 1;
+    }
+  }
+  return 0;
 }
 
+// ORs the movies whose field has value into matches.
+// Returns 0 if successful, -1 if out of memory.
+static int AddFieldValue(Index index, const char *field, const char *value,
+                         PostingBitmap matches) {
+  MovieSet set = GetFieldSet(index, field, value);
+  if (set == NULL) {
+    return 0;
+  }
+  return ApplyToPostings(&PostingBitmapOr, matches, &set->postings);
+}
 
+// ORs the movies whose field has one of values, like "comedy,drama" or
+// "2010..2015", into matches. Values are separated by commas, and a
+// range is looked up a number at a time.
+// Returns 0 if successful, -1 if out of memory or the filter is bad.
+static int AddFieldValues(Index index, const char *field, char *values,
+                          PostingBitmap matches) {
+  char *saveptr;
 
-SearchResultIter FindMovies(Index index, char *term) {
+  for (char *value = strtok_r(values, ",", &saveptr); value != NULL;
+       value = strtok_r(NULL, ",", &saveptr)) {
+    char *dots = strstr(value, "..");
+    if (dots == NULL) {
+      if (AddFieldValue(index, field, value, matches) != 0) {
+        return -1;
+      }
+      continue;
+    }
+
+    char *end;
+    long low = strtol(value, &end, 10);
+    long high = strtol(dots + 2, NULL, 10);
+    if (end != dots || high < low || high - low >= MAX_FILTER_RANGE) {
+      printf("Bad range in filter %s:%s\n", field, value);
+      return -1;
+    }
+    for (long number = low; number <= high; number++) {
+      char text[24];
+      snprintf(text, sizeof(text), "%ld", number);
+      if (AddFieldValue(index, field, text, matches) != 0) {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+// A filter with a range on year or runtime, like "year:1990..1995,2013".
+// A row passes if its value is in any of the ranges; a single number is
+// a range of one. The ranges are cut down to the values the field has,
+// and width is how many numbers they cover altogether. A narrow one is
+// looked up a number at a time like any other filter, but a wide one,
+// where that would be a set lookup and an OR for every number in it, is
+// checked against the field's ColumnStore array instead, for only the
+// movies that pass everything else.
+typedef struct columnFilter {
+  int16_t *column;
+  int num_ranges;
+  long low[MAX_FILTER_RANGES];
+  long high[MAX_FILTER_RANGES];
+  long width;
+} ColumnFilter;
+
+// Returns the ColumnStore array a filter on field can be checked
+// against, or NULL if there isn't one, and sets min and max to the
+// smallest and largest value a row can have in it.
+static int16_t *FilterColumn(Index index, const char *field, long *min,
+                             long *max) {
+  if (index->columns == NULL) {
+    return NULL;
+  }
+  if (strcmp(field, "year") == 0) {
+    *min = index->columns->min_year;
+    *max = index->columns->max_year;
+    return index->columns->year;
+  }
+  if (strcmp(field, "runtime") == 0) {
+    *min = 0;
+    *max = INT16_MAX;
+    return index->columns->runtime;
+  }
+  return NULL;
+}
+
+// Reads a number or a range like "2010..2015" into low and high.
+// Returns 0 if successful, -1 if value isn't one.
+static int ParseRange(const char *value, long *low, long *high) {
+  char *end;
+  *low = strtol(value, &end, 10);
+  if (end == value) {
+    return -1;
+  }
+  *high = *low;
+  if (strncmp(end, "..", 2) == 0) {
+    const char *from = end + 2;
+    *high = strtol(from, &end, 10);
+    if (end == from) {
+      return -1;
+    }
+  }
+  return *end == '\0' && *high >= *low ? 0 : -1;
+}
+
+// Reads values like "1990..1995,2013" into filter, cutting each range
+// down to min..max. A range with nothing left in it is dropped.
+// Returns 0 if successful, -1 if one of them is bad or there are more
+// than MAX_FILTER_RANGES.
+static int ParseColumnFilter(char *values, int16_t *column, long min,
+                             long max, ColumnFilter *filter) {
+  char *saveptr;
+  int num_values = 0;
+
+  filter->column = column;
+  filter->num_ranges = 0;
+  filter->width = 0;
+  for (char *value = strtok_r(values, ",", &saveptr); value != NULL;
+       value = strtok_r(NULL, ",", &saveptr)) {
+    long low, high;
+    if (num_values++ == MAX_FILTER_RANGES ||
+        ParseRange(value, &low, &high) != 0) {
+      return -1;
+    }
+    low = low < min ? min : low;
+    high = high > max ? max : high;
+    if (low <= high) {
+      filter->low[filter->num_ranges] = low;
+      filter->high[filter->num_ranges++] = high;
+      filter->width += high - low + 1;
+    }
+  }
+  return 0;
+}
+
+// Returns 1 if row passes every filter, 0 otherwise. A row without a
+// value for the field (-1) never passes, since no range goes below 0.
+static int PassesColumnFilters(ColumnFilter *filters, int num_filters,
+                               int row) {
+  for (int i = 0; i < num_filters; i++) {
+    int value = filters[i].column[row];
+    int passes = 0;
+    for (int j = 0; j < filters[i].num_ranges && !passes; j++) {
+      passes = value >= filters[i].low[j] && value <= filters[i].high[j];
+    }
+    if (!passes) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Takes the rows that don't pass every filter out of result. If all is
+// set, result must be empty, and every row of the ColumnStore that
+// passes them is put in it instead. Passing rows are collected 65536 at
+// a time in words, the bits of one PostingBitmap container, which is
+// much cheaper than adding them to a bitmap one at a time.
+// Returns 0 if successful, -1 if out of memory.
+static int ApplyColumnFilters(Index index, ColumnFilter *filters,
+                              int num_filters, int all,
+                              PostingBitmap result) {
+  uint64_t words[POSTING_BITMAP_WORDS];
+  struct postingBitmap out;
+  struct postingIter iter;
+  int failed = 0;
+
+  InitPostingBitmap(&out);
+  if (all) {
+    int num_rows = index->columns->num_rows;
+    for (int start = 0; start < num_rows && failed == 0; start += 65536) {
+      int end = num_rows - start < 65536 ? num_rows : start + 65536;
+      memset(words, 0, sizeof(words));
+      for (int row = start; row < end; row++) {
+        if (PassesColumnFilters(filters, num_filters, row)) {
+          words[(row - start) >> 6] |= 1ULL << (row & 63);
+        }
+      }
+      failed = PostingBitmapAppendWords(&out, start >> 16, words);
+    }
+  } else if (PostingIterInit(&iter, result) == 0) {
+    uint64_t key = PostingIterGet(&iter) >> 16;
+    memset(words, 0, sizeof(words));
+    do {
+      uint64_t row = PostingIterGet(&iter);
+      if (row >> 16 != key) {
+        failed = PostingBitmapAppendWords(&out, key, words);
+        key = row >> 16;
+        memset(words, 0, sizeof(words));
+      }
+      if (PassesColumnFilters(filters, num_filters, row)) {
+        words[(row & 0xFFFF) >> 6] |= 1ULL << (row & 63);
+      }
+    } while (failed == 0 && PostingIterNext(&iter) == 0);
+    if (failed == 0) {
+      failed = PostingBitmapAppendWords(&out, key, words);
+    }
+  }
+  if (failed != 0) {
+    printf("Couldn't malloc to filter postings\n");
+    FreePostingBitmap(&out);
+    return -1;
+  }
+  FreePostingBitmap(result);
+  *result = out;
+  return 0;
+}
+
+// Puts the movies that pass a filter like "genre:comedy,drama" or
+// "year:2010..2015" in matches, which must be empty, unless it is a
+// wide range the ColumnStore can check, which is put in column_filter
+// instead.
+// Returns 1 if the filter went in column_filter, 0 if in matches, or -1
+// if out of memory or the filter is bad.
+static int EvaluateFilter(Index index, char *filter, PostingBitmap matches,
+                          ColumnFilter *column_filter) {
+  char *values = strchr(filter, ':') + 1;
+  long min, max;
+
+  values[-1] = '\0';
+  int16_t *column = FilterColumn(index, filter, &min, &max);
+  if (column == NULL || strstr(values, "..") == NULL) {
+    return AddFieldValues(index, filter, values, matches);
+  }
+  if (ParseColumnFilter(values, column, min, max, column_filter) != 0) {
+    printf("Bad range in filter on %s\n", filter);
+    return -1;
+  }
+  if (column_filter->width > MAX_LOOKUP_RANGE) {
+    return 1;
+  }
+
+  MovieSet sets[MAX_LOOKUP_SETS];
+  int num_sets = 0;
+  for (int i = 0; i < column_filter->num_ranges; i++) {
+    for (long number = column_filter->low[i];
+         number <= column_filter->high[i]; number++) {
+      char text[24];
+      snprintf(text, sizeof(text), "%ld", number);
+      MovieSet set = GetFieldSet(index, filter, text);
+      if (set != NULL && num_sets == MAX_LOOKUP_SETS) {
+        return 1;
+      }
+      if (set != NULL) {
+        sets[num_sets++] = set;
+      }
+    }
+  }
+  for (int i = 0; i < num_sets; i++) {
+    if (ApplyToPostings(&PostingBitmapOr, matches, &sets[i]->postings) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Takes the filters out of query, leaving its other words in words.
+// A wide range the ColumnStore can check goes in column_filters, and
+// num_column_filters is set to how many did. The movies that pass every
+// other filter are ANDed together into filter, which must be empty.
+// Returns the number of filters ANDed into filter, or -1 if one of them
+// fails.
+static int ExtractFilters(Index index, char *query, char *words,
+                          PostingBitmap filter, ColumnFilter *column_filters,
+                          int *num_column_filters) {
+  char *saveptr;
+  int num_filters = 0;
+
+  words[0] = '\0';
+  *num_column_filters = 0;
+  for (char *token = strtok_r(query, " \t\r\n", &saveptr); token != NULL;
+       token = strtok_r(NULL, " \t\r\n", &saveptr)) {
+    if (IsFilter(token) == 0) {
+      strcat(words, token);
+      strcat(words, " ");
+      continue;
+    }
+    struct postingBitmap matches;
+    ColumnFilter range;
+    InitPostingBitmap(&matches);
+    int failed = EvaluateFilter(index, token, &matches, &range);
+    if (failed == 1 && *num_column_filters < MAX_QUERY_TERMS) {
+      column_filters[(*num_column_filters)++] = range;
+      continue;
+    }
+    if (failed == 1) {
+      printf("Query has more than %d ranges\n", MAX_QUERY_TERMS);
+      failed = -1;
+    }
+    if (failed == 0 && num_filters == 0) {
+      *filter = matches;
+      InitPostingBitmap(&matches);
+    } else if (failed == 0) {
+      failed = ApplyToPostings(&PostingBitmapAnd, filter, &matches);
+    }
+    FreePostingBitmap(&matches);
+    if (failed != 0) {
+      return -1;
+    }
+    num_filters++;
+  }
+  return num_filters;
+}
+
+// Runs a query with more than one term, any operator or any filter.
+// The filters are ANDed with the smallest set of each group first, and
+// wide ranges are then checked for only the movies that are left.
+static SearchResultIter FindMoviesBoolean(Index index, char *term) {
+  char query[strlen(term) + 1];
+  char words[strlen(term) + 2];
+  ColumnFilter column_filters[MAX_QUERY_TERMS];
+  int num_column_filters;
+  struct postingBitmap result, group_result, filter;
+
+  strcpy(query, term);
+  InitPostingBitmap(&filter);
+  int num_filters = ExtractFilters(index, query, words, &filter,
+                                   column_filters, &num_column_filters);
+  if (num_filters < 0) {
+    FreePostingBitmap(&filter);
+    return NULL;
+  }
+  // Nothing can get past the filters, so don't look at the titles.
+  if (num_filters > 0 && PostingBitmapCardinality(&filter) == 0) {
+    printf("Query \"%s\" matched 0 movies\n", term);
+    FreePostingBitmap(&filter);
+    return NULL;
+  }
+
+  QueryGroup *groups = (QueryGroup*)malloc(MAX_QUERY_TERMS *
+                                           sizeof(QueryGroup));
+  if (groups == NULL) {
+    printf("Couldn't malloc to parse query \"%s\"\n", term);
+    FreePostingBitmap(&filter);
+    return NULL;
+  }
+  int num_groups = ParseQuery(index, words, groups);
+  if (num_groups < 0) {
+    printf("Query has more than %d terms: \"%s\"\n", MAX_QUERY_TERMS, term);
+    FreePostingBitmap(&filter);
+    free(groups);
+    return NULL;
+  }
+
+  InitPostingBitmap(&result);
+  for (int i = 0; i < num_groups; i++) {
+    InitPostingBitmap(&group_result);
+    int failed = EvaluateGroup(&groups[i], num_filters > 0 ? &filter : NULL,
+                               &group_result);
+    if (failed == 0) {
+      failed = ApplyToPostings(&PostingBitmapOr, &result, &group_result);
+    }
+    FreePostingBitmap(&group_result);
+    if (failed != 0) {
+      FreePostingBitmap(&result);
+      FreePostingBitmap(&filter);
+      free(groups);
+      return NULL;
+    }
+  }
+  free(groups);
+
+  // A query with only filters matches every movie that passes them.
+  if (num_groups == 0 && num_filters > 0) {
+    FreePostingBitmap(&result);
+    result = filter;
+    InitPostingBitmap(&filter);
+  }
+  FreePostingBitmap(&filter);
+  // Without words or other filters, every row has to be checked.
+  if (num_column_filters > 0 &&
+      ApplyColumnFilters(index, column_filters, num_column_filters,
+                         num_groups == 0 && num_filters == 0,
+                         &result) != 0) {
+    FreePostingBitmap(&result);
+    return NULL;
+  }
+
+  printf("Query \"%s\" matched %d movies\n", term,
+         PostingBitmapCardinality(&result));
+  if (PostingBitmapCardinality(&result) == 0) {
+    FreePostingBitmap(&result);
+    return NULL;
+  }
+
+  SearchResultIter iter = CreateIterOverPostings(index, &result, 1);
+  if (iter == NULL) {
+    FreePostingBitmap(&result);
+  }
+  return iter;
+}
+
+// One term of a ranked query, walked in ordinal order.
+typedef struct rankedTerm {
+  MovieSet set;
+  double idf;
+  double max_score;  // No movie gets more than this from the term.
+  struct postingIter iter;
+  uint64_t current;  // The ordinal iter is on.
+  int done;  // 1 once iter has gone past the last ordinal.
+} RankedTerm;
+
+// A scored movie. The heap keeps the worst of the top k at the root.
+typedef struct scoredMovie {
+  double score;
+  uint64_t ordinal;
+} ScoredMovie;
+
+// Returns 1 if a ranks below b. Ties go to the smaller ordinal.
+static int RanksBelow(ScoredMovie *a, ScoredMovie *b) {
+  if (a->score != b->score) {
+    return a->score < b->score;
+  }
+  return a->ordinal > b->ordinal;
+}
+
+static void SiftDown(ScoredMovie *heap, int len, int i) {
+  while (1) {
+    int worst = i;
+    int left = 2 * i + 1;
+    int right = left + 1;
+    if (left < len && RanksBelow(&heap[left], &heap[worst])) {
+      worst = left;
+    }
+    if (right < len && RanksBelow(&heap[right], &heap[worst])) {
+      worst = right;
+    }
+    if (worst == i) {
+      return;
+    }
+    ScoredMovie tmp = heap[i];
+    heap[i] = heap[worst];
+    heap[worst] = tmp;
+    i = worst;
+  }
+}
+
+static void SiftUp(ScoredMovie *heap, int i) {
+  while (i > 0 && RanksBelow(&heap[i], &heap[(i - 1) / 2])) {
+    ScoredMovie tmp = heap[i];
+    heap[i] = heap[(i - 1) / 2];
+    heap[(i - 1) / 2] = tmp;
+    i = (i - 1) / 2;
+  }
+}
+
+// Keeps movie if it is in the top k so far.
+static void OfferToHeap(ScoredMovie *heap, int *len, int k,
+                        ScoredMovie movie) {
+  if (*len < k) {
+    heap[*len] = movie;
+    SiftUp(heap, (*len)++);
+  } else if (RanksBelow(&heap[0], &movie)) {
+    heap[0] = movie;
+    SiftDown(heap, *len, 0);
+  }
+}
+
+static int CompareRank(const void *a, const void *b) {
+  ScoredMovie *x = (ScoredMovie*)a;
+  ScoredMovie *y = (ScoredMovie*)b;
+  if (RanksBelow(y, x)) {
+    return -1;
+  }
+  return RanksBelow(x, y) ? 1 : 0;
+}
+
+static int CompareMaxScores(const void *a, const void *b) {
+  double x = ((RankedTerm*)a)->max_score;
+  double y = ((RankedTerm*)b)->max_score;
+  return x < y ? -1 : x > y;
+}
+
+// BM25 of one term for a title of title_terms words that has the term
+// tf times.
+static double Bm25(double idf, int tf, int title_terms,
+                   double avg_title_terms) {
+  double norm = BM25_K1 * (1 - BM25_B +
+                           BM25_B * title_terms / avg_title_terms);
+  return idf * tf * (BM25_K1 + 1) / (tf + norm);
+}
+
+static void AdvanceTerm(RankedTerm *term) {
+  if (PostingIterNext(&term->iter) != 0) {
+    term->done = 1;
+  } else {
+    term->current = PostingIterGet(&term->iter);
+  }
+}
+
+// Finds the k movies whose titles score highest under BM25 for any of
+// the terms, using MaxScore: terms are sorted by the most they can add
+// to a score, and once the top k are good enough that the cheapest
+// terms together can't get a movie in, those terms are only looked up
+// for movies the other terms found, instead of being walked.
+// Puts them in ranked, best first, and returns how many there are.
+static int RankMovies(Index index, RankedTerm *terms, int num_terms, int k,
+                      ScoredMovie *ranked) {
+  double avg_title_terms = index->num_title_terms /
+      (double)(index->num_titles > 0 ? index->num_titles : 1);
+  double bounds[MAX_QUERY_TERMS];
+  int num_ranked = 0;
+
+  for (int i = 0; i < num_terms; i++) {
+    RankedTerm *term = &terms[i];
+    double df = NumMoviesInSet(term->set);
+    term->idf = log(1 + (index->num_titles - df + 0.5) / (df + 0.5));
+    // A one word title that has the term as often as any title does
+    // scores the most.
+    int max_tf = PostingBitmapCardinality(&term->set->repeats) > 0 ? 2 : 1;
+    term->max_score = Bm25(term->idf, max_tf, max_tf, avg_title_terms);
+    term->done = PostingIterInit(&term->iter, &term->set->postings) != 0;
+    if (!term->done) {
+      term->current = PostingIterGet(&term->iter);
+    }
+  }
+  qsort(terms, num_terms, sizeof(RankedTerm), &CompareMaxScores);
+  // bounds[i] is the most terms 0 through i can add up to.
+  for (int i = 0; i < num_terms; i++) {
+    bounds[i] = terms[i].max_score + (i > 0 ? bounds[i - 1] : 0);
+  }
+
+  // Terms before first_essential can't get a movie into the top k on
+  // their own.
+  int first_essential = 0;
+  RowTable rows = NULL;
+  RowFile file = { 0, 0, 0 };
+  while (first_essential < num_terms) {
+    uint64_t candidate = UINT64_MAX;
+    for (int i = first_essential; i < num_terms; i++) {
+      if (!terms[i].done && terms[i].current < candidate) {
+        candidate = terms[i].current;
+      }
+    }
+    if (candidate == UINT64_MAX) {
+      break;
+    }
+
+    if (candidate < (uint64_t)file.first_row ||
+        candidate >= (uint64_t)file.first_row + file.num_rows) {
+      rows = NULL;
+      if (FindRowFile(index, candidate, &file) == 0) {
+        rows = GetRowTable(index, file.doc_id);
+      }
+    }
+    int row_id = candidate - file.first_row;
+    int title_terms = 1;
+    if (rows != NULL && row_id < rows->num_rows &&
+        rows->title_terms[row_id] > 0) {
+      title_terms = rows->title_terms[row_id];
+    }
+
+    ScoredMovie movie = { 0, candidate };
+    for (int i = first_essential; i < num_terms; i++) {
+      if (!terms[i].done && terms[i].current == candidate) {
+        movie.score += Bm25(terms[i].idf,
+                            TimesInTitle(terms[i].set, candidate),
+                            title_terms, avg_title_terms);
+        AdvanceTerm(&terms[i]);
+      }
+    }
+    // Look the cheaper terms up, most valuable first, until even all
+    // that's left of them couldn't beat the worst of the top k.
+    for (int i = first_essential - 1; i >= 0; i--) {
+      if (num_ranked == k && movie.score + bounds[i] <= ranked[0].score) {
+        break;
+      }
+      int tf = TimesInTitle(terms[i].set, candidate);
+      if (tf > 0) {
+        movie.score += Bm25(terms[i].idf, tf, title_terms, avg_title_terms);
+      }
+    }
+    OfferToHeap(ranked, &num_ranked, k, movie);
+
+    if (num_ranked == k) {
+      while (first_essential < num_terms &&
+             bounds[first_essential] <= ranked[0].score) {
+        first_essential++;
+      }
+    }
+  }
+
+  qsort(ranked, num_ranked, sizeof(ScoredMovie), &CompareRank);
+  return num_ranked;
+}
+
+// Runs a query that starts with RANK_PREFIX.
+static SearchResultIter FindMoviesRanked(Index index, char *term) {
+  char query[strlen(term) + 1];
+  RankedTerm terms[MAX_QUERY_TERMS];
+  int num_terms = 0;
+  int k = RANK_DEFAULT_K;
+  char *saveptr;
+
+  strcpy(query, term + strlen(RANK_PREFIX));
+  char *words = query;
+  // k is digits and nothing else; "rank:-5" or "rank:5x" isn't a term.
+  if (*words == '-' || *words == '+') {
+    printf("Ranked query's number of results can't have a sign: \"%s\"\n",
+           term);
+    return NULL;
+  }
+  if (isdigit((unsigned char)*words)) {
+    char *end;
+    long wanted = strtol(words, &end, 10);
+    if (*end != '\0' && !isspace((unsigned char)*end)) {
+      printf("Ranked query's number of results isn't a number: \"%s\"\n",
+             term);
+      return NULL;
+    }
+    if (wanted < 1) {
+      printf("Ranked query wants %ld results\n", wanted);
+      return NULL;
+    }
+    k = wanted > RANK_MAX_K ? RANK_MAX_K : wanted;
+    words = end;
+  }
+
+  for (char *token = strtok_r(words, " \t\r\n", &saveptr); token != NULL;
+       token = strtok_r(NULL, " \t\r\n", &saveptr)) {
+    MovieSet set = GetMovieSet(index, token);
+    if (set == NULL) {
+      continue;
+    }
+    int duplicate = 0;
+    for (int i = 0; i < num_terms; i++) {
+      duplicate |= terms[i].set == set;
+    }
+    if (duplicate) {
+      continue;
+    }
+    if (num_terms == MAX_QUERY_TERMS) {
+      printf("Query has more than %d terms: \"%s\"\n", MAX_QUERY_TERMS,
+             term);
+      return NULL;
+    }
+    terms[num_terms++].set = set;
+  }
+  if (num_terms == 0) {
+    return NULL;
+  }
+
+  ScoredMovie *ranked = (ScoredMovie*)malloc(k * sizeof(ScoredMovie));
+  if (ranked == NULL) {
+    printf("Couldn't malloc to rank \"%s\"\n", term);
+    return NULL;
+  }
+  int num_ranked = RankMovies(index, terms, num_terms, k, ranked);
+  printf("Query \"%s\" ranked %d movies\n", term, num_ranked);
+
+  struct searchResult *results = (struct searchResult*)malloc(
+      (num_ranked + 1) * sizeof(struct searchResult));
+  if (results == NULL) {
+    printf("Couldn't malloc for an iter in FindMovies\n");
+    free(ranked);
+    return NULL;
+  }
+  RowFile file;
+  for (int i = 0; i < num_ranked; i++) {
+    if (FindRowFile(index, ranked[i].ordinal, &file) == 0) {
+      results[i].doc_id = file.doc_id;
+      results[i].row_id = ranked[i].ordinal - file.first_row;
+    } else {
+      results[i].doc_id = 0;
+      results[i].row_id = -1;
+    }
+  }
+  free(ranked);
+  return CreateIterOverResults(results, num_ranked, NULL, 1);
+}
+
+// Matches the movies with any of the words in sets, which are index's.
+static SearchResultIter IterOverAny(Index index, MovieSet *sets,
+                                    int num_sets) {
+  struct postingBitmap result;
+
+  if (num_sets == 0) {
+    return NULL;
+  }
+  if (num_sets == 1) {
+    return CreateSearchResultIter(index, sets[0]);
+  }
+  InitPostingBitmap(&result);
+  for (int i = 0; i < num_sets; i++) {
+    if (ApplyToPostings(&PostingBitmapOr, &result, &sets[i]->postings) != 0) {
+      FreePostingBitmap(&result);
+      return NULL;
+    }
+  }
+  SearchResultIter iter = CreateIterOverPostings(index, &result, 1);
+  if (iter == NULL) {
+    FreePostingBitmap(&result);
+  }
+  return iter;
+}
+
+// Matches the movies with the words closest to word.
+static SearchResultIter FindMoviesFuzzy(Index index, const char *word,
+                                        int max_edits) {
+  MovieSet matches[FUZZY_MATCHES];
+  int expanded;
+
+  int num_matches = FuzzyMatchTerms(index, word, max_edits, matches,
+                                    FUZZY_MATCHES, &expanded);
+  printf("Fuzzy matches for \"%s\" (expanded %d of %d words):", word,
+         expanded, index->num_sorted_terms);
+  for (int i = 0; i < num_matches; i++) {
+    printf(" %s (%d)", matches[i]->desc, NumMoviesInSet(matches[i]));
+  }
+  printf("\n");
+  return IterOverAny(index, matches, num_matches);
+}
+
+// Runs a query that starts with FUZZY_PREFIX.
+static SearchResultIter FindMoviesByFuzzyPrefix(Index index, char *term) {
+  char *word = term + strlen(FUZZY_PREFIX);
+  int max_edits = FUZZY_MAX_EDITS;
+
+  if (isdigit((unsigned char)*word)) {
+    max_edits = strtol(word, &word, 10);
+    if (max_edits > FUZZY_MAX_EDITS) {
+      printf("Fuzzy query wants %d edits; the most is %d\n", max_edits,
+             FUZZY_MAX_EDITS);
+      return NULL;
+    }
+  }
+  while (*word == ' ') {
+    word++;
+  }
+  if (*word == '\0' || strpbrk(word, " \t\r\n") != NULL) {
+    printf("Fuzzy queries take one word: \"%s\"\n", term);
+    return NULL;
+  }
+  return FindMoviesFuzzy(index, word, max_edits);
+}
+
+// Runs a query that starts with PREFIX_PREFIX.
+static SearchResultIter FindMoviesByPrefix(Index index, char *term) {
+  MovieSet completions[PREFIX_COMPLETIONS];
+  char *prefix = term + strlen(PREFIX_PREFIX);
+
+  while (*prefix == ' ') {
+    prefix++;
+  }
+  // Every word starts with nothing; that's no use for type-ahead.
+  if (*prefix == '\0') {
+    return NULL;
+  }
+  int num_completions = CompleteTerm(index, prefix, completions,
+                                     PREFIX_COMPLETIONS);
+  printf("Completions for \"%s\":", prefix);
+  for (int i = 0; i < num_completions; i++) {
+    printf(" %s (%d)", completions[i]->desc,
+           NumMoviesInSet(completions[i]));
+  }
+  printf("\n");
+  return IterOverAny(index, completions, num_completions);
+}
+
+// Returns 1 if the query is just one term, which can be answered
+// straight from its MovieSet.
+static int IsSingleTerm(const char *term) {
+  if (strpbrk(term, " \t\r\n") != NULL) {
+    return 0;
+  }
+  return strcmp(term, "AND") != 0 && strcmp(term, "OR") != 0 &&
+      strcmp(term, "NOT") != 0 && IsFilter(term) == 0;
+}
+
+// Runs a query that has had its options taken out.
+static SearchResultIter FindMoviesForQuery(Index index, char *term) {
+  if (strncmp(term, RANK_PREFIX, strlen(RANK_PREFIX)) == 0) {
+    return FindMoviesRanked(index, term);
+  }
+  if (strncmp(term, PREFIX_PREFIX, strlen(PREFIX_PREFIX)) == 0) {
+    return FindMoviesByPrefix(index, term);
+  }
+  if (strncmp(term, FUZZY_PREFIX, strlen(FUZZY_PREFIX)) == 0) {
+    return FindMoviesByFuzzyPrefix(index, term);
+  }
+  if (IsSingleTerm(term) == 0) {
+    return FindMoviesBoolean(index, term);
+  }
   MovieSet set = GetMovieSet(index, term);
   if (set == NULL) {
     return NULL;
   }
   printf("Getting docs for movieset term: \"%s\"\n", set->desc);
-  SearchResultIter iter = CreateSearchResultIter(set);
+  SearchResultIter iter = CreateSearchResultIter(index, set);
   return iter;
 }
 
 
+// Fields results can be sorted on, as in "sort=year desc".
+enum { SORT_NONE, SORT_YEAR, SORT_RUNTIME, SORT_TITLE };
+static const char *SORT_FIELDS[] = { "", "year", "runtime", "title" };
+#define NUM_SORT_FIELDS 4
+
+// How many results a sorted query returns unless it says "limit=", and
+// the most it can ask for.
+#define SORT_DEFAULT_LIMIT 10
+#define SORT_MAX_LIMIT 1000
+
+// Options that can go anywhere in a query, like "facets=on".
+typedef struct queryOptions {
+  int facets;  // 1 to count facets.
+  int rows;  // 0 if only the facets are wanted.
+  int sort;  // One of SORT_NONE, SORT_YEAR, ...
+  int descending;  // 1 to sort largest first.
+  int limit;  // Most results to return, or 0 for all of them.
+} QueryOptions;
+
+// Reads one option token into options.
+// Returns 1 if it was an option, 0 if it is part of the query, -1 if it
+// is a bad option.
+static int ReadOption(char *token, QueryOptions *options) {
+  char *value = strchr(token, '=');
+  if (value == NULL) {
+    return 0;
+  }
+  value++;
+  if (strncmp(token, "facets=", strlen("facets=")) == 0) {
+    if (strcmp(value, "on") == 0) {
+      options->facets = 1;
+      return 1;
+    }
+    if (strcmp(value, "only") == 0) {
+      options->facets = 1;
+      options->rows = 0;
+      return 1;
+    }
+  } else if (strncmp(token, "sort=", strlen("sort=")) == 0) {
+    for (int i = SORT_YEAR; i < NUM_SORT_FIELDS; i++) {
+      if (strcasecmp(value, SORT_FIELDS[i]) == 0) {
+        options->sort = i;
+        return 1;
+      }
+    }
+  } else if (strncmp(token, "limit=", strlen("limit=")) == 0) {
+    char *end;
+    long limit = strtol(value, &end, 10);
+    if (*end == '\0' && limit >= 1 && limit <= SORT_MAX_LIMIT) {
+      options->limit = limit;
+      return 1;
+    }
+  } else {
+    return 0;
+  }
+  printf("Bad option %s\n", token);
+  return -1;
+}
+
+// Takes the options out of query, leaving the rest of it in rest. A
+// "sort=" can be followed by "asc" or "desc".
+// Returns 0 if successful, -1 if an option is bad.
+static int ExtractOptions(char *query, char *rest, QueryOptions *options) {
+  char *saveptr;
+  int after_sort = 0;
+
+  options->facets = 0;
+  options->rows = 1;
+  options->sort = SORT_NONE;
+  options->descending = 0;
+  options->limit = 0;
+  rest[0] = '\0';
+  for (char *token = strtok_r(query, " \t\r\n", &saveptr); token != NULL;
+       token = strtok_r(NULL, " \t\r\n", &saveptr)) {
+    if (after_sort && (strcmp(token, "asc") == 0 ||
+                       strcmp(token, "desc") == 0)) {
+      options->descending = token[0] == 'd';
+      after_sort = 0;
+      continue;
+    }
+    int option = ReadOption(token, options);
+    if (option < 0) {
+      return -1;
+    }
+    after_sort = option == 1 && strncmp(token, "sort=", strlen("sort=")) == 0;
+    if (option == 1) {
+      continue;
+    }
+    if (rest[0] != '\0') {
+      strcat(rest, " ");
+    }
+    strcat(rest, token);
+  }
+  if (options->sort != SORT_NONE && options->limit == 0) {
+    options->limit = SORT_DEFAULT_LIMIT;
+  }
+  return 0;
+}
+
+// Counts of one facet, by code.
+typedef struct facetCounts {
+  const char *name;
+  int *counts;
+  int num_codes;
+} FacetCounts;
+
+// Adds "name:value=count,..." for the FACET_LIMIT codes with the most
+// movies to out, which has room for size bytes. value_name gives the
+// text of a code.
+static void PrintFacet(FacetCounts *facet, Index index,
+                       void (*value_name)(Index, int, char*, int),
+                       char *out, int size) {
+  int best[FACET_LIMIT];
+  int num_best = 0;
+
+  // Codes are few, so insertion into the top FACET_LIMIT is enough.
+  for (int code = 0; code < facet->num_codes; code++) {
+    int count = facet->counts[code];
+    if (count == 0 ||
+        (num_best == FACET_LIMIT &&
+         count <= facet->counts[best[FACET_LIMIT - 1]])) {
+      continue;
+    }
+    int j = num_best < FACET_LIMIT ? num_best++ : FACET_LIMIT - 1;
+    while (j > 0 && count > facet->counts[best[j - 1]]) {
+      best[j] = best[j - 1];
+      j--;
+    }
+    best[j] = code;
+  }
+
+  // Values that don't fit are left off.
+  char entry[96];
+  snprintf(entry, sizeof(entry), "%s%s:", out[0] != '\0' ? ";" : "",
+           facet->name);
+  if (strlen(out) + strlen(entry) >= (size_t)size) {
+    return;
+  }
+  strcat(out, entry);
+  for (int i = 0; i < num_best; i++) {
+    char value[64];
+    value_name(index, best[i], value, sizeof(value));
+    snprintf(entry, sizeof(entry), "%s%s=%d", i > 0 ? "," : "", value,
+             facet->counts[best[i]]);
+    if (strlen(out) + strlen(entry) >= (size_t)size) {
+      return;
+    }
+    strcat(out, entry);
+  }
+}
+
+static void GenreName(Index index, int code, char *out, int size) {
+  snprintf(out, size, "%s", index->columns->genre_names[code]);
+}
+
+static void TypeName(Index index, int code, char *out, int size) {
+  snprintf(out, size, "%s", index->columns->type_names[code]);
+}
+
+// Year codes count from the ColumnStore's min_year.
+static void YearName(Index index, int code, char *out, int size) {
+  snprintf(out, size, "%d", index->columns->min_year + code);
+}
+
+// Counts the genres, years and types of every result in one pass over
+// the ColumnStore, and puts them in iter->facets.
+// Returns 0 if successful, -1 if there is no ColumnStore or no memory.
+static int CountFacets(Index index, SearchResultIter iter) {
+  ColumnStore columns = index->columns;
+  int genre_counts[MAX_GENRE_CODES] = { 0 };
+  int type_counts[MAX_TYPE_CODES] = { 0 };
+
+  if (columns == NULL) {
+    printf("Facets need a ColumnStore\n");
+    return -1;
+  }
+  int num_years = columns->max_year < 0 ? 0 :
+    columns->max_year - columns->min_year + 1;
+  int *year_counts = (int*)calloc(num_years + 1, sizeof(int));
+  iter->facets = (char*)malloc(MAX_FACETS_LENGTH + 1);
+  if (year_counts == NULL || iter->facets == NULL) {
+    printf("Couldn't malloc to count facets\n");
+    free(year_counts);
+    free(iter->facets);
+    iter->facets = NULL;
+    return -1;
+  }
+
+  // Walk a copy, so iter is still on its first result afterwards.
+  struct searchResultIter walk = *iter;
+  struct searchResult sr;
+  RowTable rows = NULL;
+  uint64_t rows_doc_id = 0;
+  for (int i = 0; i < walk.numResults; i++) {
+    if (i > 0 && SearchResultNext(&walk) != 0) {
+      break;
+    }
+    SearchResultGet(&walk, &sr);
+    if (rows == NULL || rows_doc_id != sr.doc_id) {
+      rows = GetRowTable(index, sr.doc_id);
+      rows_doc_id = sr.doc_id;
+    }
+    if (rows == NULL || sr.row_id >= rows->num_rows) {
+      continue;
+    }
+    int row = rows->first_row + sr.row_id;
+    for (uint32_t genres = columns->genres[row]; genres != 0;
+         genres &= genres - 1) {
+      genre_counts[__builtin_ctz(genres)]++;
+    }
+    if (columns->year[row] >= 0) {
+      year_counts[columns->year[row] - columns->min_year]++;
+    }
+    if (columns->type[row] != NO_TYPE) {
+      type_counts[columns->type[row]]++;
+    }
+  }
+
+  FacetCounts genre = { "genre", genre_counts, columns->num_genres };
+  FacetCounts year = { "year", year_counts, num_years };
+  FacetCounts type = { "type", type_counts, columns->num_types };
+  iter->facets[0] = '\0';
+  PrintFacet(&genre, index, &GenreName, iter->facets, MAX_FACETS_LENGTH + 1);
+  PrintFacet(&year, index, &YearName, iter->facets, MAX_FACETS_LENGTH + 1);
+  PrintFacet(&type, index, &TypeName, iter->facets, MAX_FACETS_LENGTH + 1);
+  free(year_counts);
+  return 0;
+}
+
+// A result being sorted: where it is, its global row in the
+// ColumnStore, and where it was in the results before sorting.
+typedef struct sortedMovie {
+  struct searchResult result;
+  int row;
+  int position;
+} SortedMovie;
+
+typedef struct sortOrder {
+  ColumnStore columns;
+  int field;
+  int descending;
+} SortOrder;
+
+// Returns 1 if a goes before b. Movies without a value for the field go
+// last either way, and ties keep the order they came in.
+static int SortsBefore(SortOrder *order, SortedMovie *a, SortedMovie *b) {
+  ColumnStore columns = order->columns;
+  int cmp = 0;
+
+  if (order->field == SORT_TITLE) {
+    const char *x = GetRowTitle(columns, a->row);
+    const char *y = GetRowTitle(columns, b->row);
+    if ((x[0] == '\0') != (y[0] == '\0')) {
+      return y[0] == '\0';
+    }
+    cmp = strcasecmp(x, y);
+  } else if (order->field != SORT_NONE) {
+    int16_t *keys = order->field == SORT_YEAR ? columns->year
+                                              : columns->runtime;
+    int x = keys[a->row];
+    int y = keys[b->row];
+    if ((x < 0) != (y < 0)) {
+      return y < 0;
+    }
+    cmp = (x > y) - (x < y);
+  }
+  if (order->descending) {
+    cmp = -cmp;
+  }
+  if (cmp != 0) {
+    return cmp < 0;
+  }
+  return a->position < b->position;
+}
+
+// The heap keeps the movie that goes last at the top, so it is the one
+// pushed out when a movie that goes before it comes along.
+static void SiftDownSorted(SortOrder *order, SortedMovie *heap, int len,
+                           int i) {
+  while (1) {
+    int last = i;
+    int left = 2 * i + 1;
+    int right = left + 1;
+    if (left < len && SortsBefore(order, &heap[last], &heap[left])) {
+      last = left;
+    }
+    if (right < len && SortsBefore(order, &heap[last], &heap[right])) {
+      last = right;
+    }
+    if (last == i) {
+      return;
+    }
+    SortedMovie tmp = heap[i];
+    heap[i] = heap[last];
+    heap[last] = tmp;
+    i = last;
+  }
+}
+
+static void SiftUpSorted(SortOrder *order, SortedMovie *heap, int i) {
+  while (i > 0 && SortsBefore(order, &heap[(i - 1) / 2], &heap[i])) {
+    SortedMovie tmp = heap[i];
+    heap[i] = heap[(i - 1) / 2];
+    heap[(i - 1) / 2] = tmp;
+    i = (i - 1) / 2;
+  }
+}
+
+// Keeps only the first options->limit results of iter, in the order
+// options->sort asks for. The results are walked once, keeping the
+// first ones so far in a heap of limit movies that reads the keys
+// straight from the ColumnStore, so only the ones that are kept are
+// ever put in order. Without a sort the first limit results are kept
+// as they come.
+// Returns 0 if successful, -1 if there is no ColumnStore to sort with
+// or no memory.
+static int SortResults(Index index, SearchResultIter iter,
+                       QueryOptions *options) {
+  SortOrder order = { index->columns, options->sort, options->descending };
+  int k = options->limit;
+
+  if (options->sort == SORT_NONE && iter->numResults <= k) {
+    return 0;
+  }
+  if (options->sort != SORT_NONE && index->columns == NULL) {
+    printf("Sorting needs a ColumnStore\n");
+    return -1;
+  }
+  if (iter->numResults < k) {
+    k = iter->numResults;
+  }
+  SortedMovie *heap = (SortedMovie*)malloc(k * sizeof(SortedMovie));
+  struct searchResult *results = (struct searchResult*)malloc(
+      (k + 1) * sizeof(struct searchResult));
+  if (heap == NULL || results == NULL) {
+    printf("Couldn't malloc to sort results\n");
+    free(heap);
+    free(results);
+    return -1;
+  }
+
+  // Walk a copy, so iter is left alone until the results are in.
+  struct searchResultIter walk = *iter;
+  SortedMovie movie;
+  RowTable rows = NULL;
+  uint64_t rows_doc_id = 0;
+  int len = 0;
+  for (int i = 0; i < walk.numResults; i++) {
+    if (i > 0 && SearchResultNext(&walk) != 0) {
+      break;
+    }
+    SearchResultGet(&walk, &movie.result);
+    movie.position = i;
+    if (options->sort == SORT_NONE) {
+      heap[len++] = movie;
+      if (len == k) {
+        break;
+      }
+      continue;
+    }
+    if (rows == NULL || rows_doc_id != movie.result.doc_id) {
+      rows = GetRowTable(index, movie.result.doc_id);
+      rows_doc_id = movie.result.doc_id;
+    }
+    if (rows == NULL || movie.result.row_id >= rows->num_rows) {
+      continue;
+    }
+    movie.row = rows->first_row + movie.result.row_id;
+    if (len < k) {
+      heap[len] = movie;
+      SiftUpSorted(&order, heap, len++);
+    } else if (SortsBefore(&order, &movie, &heap[0])) {
+      heap[0] = movie;
+      SiftDownSorted(&order, heap, len, 0);
+    }
+  }
+
+  // Moving the top of the heap to the end over and over leaves the
+  // movies first to last.
+  if (options->sort != SORT_NONE) {
+    for (int end = len - 1; end > 0; end--) {
+      SortedMovie tmp = heap[0];
+      heap[0] = heap[end];
+      heap[end] = tmp;
+      SiftDownSorted(&order, heap, end, 0);
+    }
+  }
+  for (int i = 0; i < len; i++) {
+    results[i] = heap[i].result;
+  }
+  free(heap);
+
+  FreePostingBitmap(&iter->owned);
+  InitPostingBitmap(&iter->owned);
+  PostingIterInit(&iter->postings, &iter->owned);
+  free(iter->ranked);
+  iter->ranked = results;
+  iter->numResults = len;
+  iter->cur_result = 0;
+  iter->cur_doc_id = len > 0 ? results[0].doc_id : 0;
+  return 0;
+}
+
+SearchResultIter FindMovies(Index index, char *term) {
+  char query[strlen(term) + 1];
+  char rest[strlen(term) + 1];
+  QueryOptions options;
+
+  strcpy(query, term);
+  if (ExtractOptions(query, rest, &options) != 0) {
+    return NULL;
+  }
+  SearchResultIter iter = FindMoviesForQuery(index, rest);
+  if (iter == NULL) {
+    return NULL;
+  }
+  if (options.facets && CountFacets(index, iter) == 0) {
+    printf("Facets: %s\n", iter->facets);
+  }
+  // Facets are counted first, so they cover every match and not just
+  // the ones that are kept.
+  if (options.limit > 0 && SortResults(index, iter, &options) != 0) {
+    DestroySearchResultIter(iter);
+    return NULL;
+  }
+  if (iter->numResults == 0) {
+    DestroySearchResultIter(iter);
+    return NULL;
+  }
+  iter->rows_wanted = options.rows;
+  return iter;
+}
+
+const char *GetFacets(SearchResultIter iter) {
+  return iter->facets;
+}
+
+int ResultRowsWanted(SearchResultIter iter) {
+  return iter->rows_wanted;
+}
+
 int SearchResultGet(SearchResultIter iter, SearchResult output) {
-  void *payload;
-  LLIterGetPayload(iter->offset_iter, &payload);
-  int row_id = *((int*)payload);
-  output->doc_id = iter->cur_doc_id;
-  output->row_id = row_id;
+  if (iter->ranked != NULL) {
+    *output = iter->ranked[iter->cur_result];
+    return 0;
+  }
+  ResultOfRow(iter, PostingIterGet(&iter->postings), output);
   return 0;
 }
 
 int SearchResultNext(SearchResultIter iter) {
-  // If there are no more offsets for this doc
-  if (LLIterHasNext(iter->offset_iter) == 0) {
-    // destroy LLIter, get next docid, create new offset_iter.
-    DestroyLLIter(iter->offset_iter);
-
-    // Get next document
-    if (HTIteratorHasMore(iter->doc_iter)) {
-      HTKeyValue kvp;
-      HTIteratorNext(iter->doc_iter);
-      HTIteratorGet(iter->doc_iter, &kvp);
-      // key is docid
-      iter->cur_doc_id = kvp.key;
-      // value is offset list
-      iter->offset_iter = CreateLLIter((LinkedList)kvp.value);
-    } else {
-      iter->offset_iter = NULL;
-      iter->doc_iter = NULL;
+  if (iter->ranked != NULL) {
+    if (iter->cur_result + 1 >= iter->numResults) {
       return -1;
     }
-  } else {
-    LLIterNext(iter->offset_iter);
+    iter->cur_result++;
+    iter->cur_doc_id = iter->ranked[iter->cur_result].doc_id;
+    return 0;
+  }
+  if (PostingIterNext(&iter->postings) != 0) {
+    return -1;
   }
+  struct searchResult sr;
+  ResultOfRow(iter, PostingIterGet(&iter->postings), &sr);
+  iter->cur_doc_id = sr.doc_id;
   return 0;
 }
 
 // Return 0 if no more
 int SearchResultIterHasMore(SearchResultIter iter) {
-  if (iter->doc_iter == NULL) {
-    return 0;
+  if (iter->ranked != NULL) {
+    return iter->cur_result + 1 < iter->numResults;
   }
-  if (LLIterHasNext(iter->offset_iter) == 0) {
-    return (HTIteratorHasMore(iter->doc_iter));
+  if (iter->numResults == 0) {
+    return 0;
   }
-
-  return 1;
+  return PostingIterHasNext(&iter->postings);
 }
 
+int CopyRowFromFile(Index index, SearchResult result, DocIdMap docIds,
+                    char *dest) {
+  char *file = GetFileFromId(docIds, result->doc_id);
+  RowTable rows = GetRowTable(index, result->doc_id);
+  if (file == NULL || rows == NULL) {
+    printf("File could not be opened\n");
+    return -1;
+  }
+  return GetRowFromFile(file, rows, result->row_id, dest, 1000);
+}
 
+int LocateRow(Index index, SearchResult result, RowLocation location) {
+  RowTable rows = GetRowTable(index, result->doc_id);
+  if (rows == NULL || result->row_id < 0 ||
+      result->row_id >= rows->num_rows) {
+    return -1;
+  }
+  location->offset = rows->offsets[result->row_id];
+  location->length = rows->offsets[result->row_id + 1] - location->offset;
+  return 0;
+}
 
-
-
+int GetRowSlice(Index index, SearchResult result, DocMapping *maps,
+                RowSlice slice) {
+  struct rowLocation location;
+  if (LocateRow(index, result, &location) != 0) {
+    return -1;
+  }
+  DocMapping *map = &maps[result->doc_id];
+  if (location.offset + location.length > (off_t)map->size) {
+    return -1;
+  }
+  slice->data = map->data + location.offset;
+  slice->length = location.length;
+  return 0;
+}
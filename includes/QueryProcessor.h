@@ -19,6 +19,8 @@
 #ifndef QUERYPROCESSOR_H
 #define QUERYPROCESSOR_H
 
+#include <sys/types.h>
+
 #include "MovieIndex.h"
 #include "DocIdMap.h"
 
@@ -33,18 +35,94 @@ typedef struct searchResult {
 } *SearchResult;
 
 /**
- * A SearchResultIter goes through every element in the hashtable,
- * which are all lists of document locations.
+ * Where a row is in its file: the byte offset of its first character and
+ * its length, including the trailing newline.
+ *
+ */
+typedef struct rowLocation {
+  off_t offset;
+  int length;
+} *RowLocation;
+
+/**
+ * A row where it already is in memory: a pointer into a mapped file and
+ * the row's length, including the trailing newline. The row is not NUL
+ * terminated.
+ *
+ */
+typedef struct rowSlice {
+  const char *data;
+  int length;
+} *RowSlice;
+
+/**
+ * A SearchResultIter walks the postings of a MovieSet in order of row
+ * ordinal: file by file, in the order the files were given to the
+ * Index, and by row_id within a file. cur_file is the file of the last
+ * row it looked up in index, so the next row of the same file doesn't
+ * need looking up.
+ *
+ * The result of a boolean query isn't a single MovieSet, so for those
+ * the iter walks a PostingBitmap built for the query, which it keeps in
+ * owned and frees when it is destroyed. owned is empty otherwise.
+ *
+ * Ranked results come best first rather than in order, so for those
+ * the iter walks the ranked array instead; it is NULL otherwise.
  *
  */
 typedef struct searchResultIter {
   int cur_doc_id;
-  HTIter doc_iter;
-  LLIter offset_iter;
+  Index index;
+  RowFile cur_file;
+  struct postingIter postings;
+  struct postingBitmap owned;
   int numResults;
+  struct searchResult *ranked;
+  int cur_result;
+  char *facets;  /*!< The facet block, if the query asked for one. */
+  int rows_wanted;  /*!< 0 if the query only wants the facets. */
 } *SearchResultIter;
 
-SearchResultIter CreateSearchResultIter(MovieSet set);
+/**
+ * The longest a facet block can be, so it fits in the 1000 byte buffers
+ * clients read frames into.
+ */
+#define MAX_FACETS_LENGTH 900
+
+/**
+ * Thread safety:
+ *
+ * Once an Index and its DocIdMap are fully built, any number of threads
+ * can call FindMovies, the SearchResultIter functions, CopyRowFromFile and
+ * LocateRow on them at the same time, as long as nothing adds to or
+ * destroys them while queries are running. None of these functions write
+ * to the Index, its MovieSets, its RowTables or the DocIdMap: lookups copy
+ * the term before lowercasing it, every iterator (PostingIter,
+ * SearchResultIter) is malloc'd by and belongs to the caller,
+ * CopyRowFromFile opens its own file and writes only into the caller's
+ * dest buffer, and LocateRow and GetRowSlice only read the Index and the
+ * read-only mappings.
+ *
+ * A single SearchResultIter must not be shared between threads.
+ */
+
+SearchResultIter CreateSearchResultIter(Index index, MovieSet set);
+
+/**
+ * Makes an iter over results that are already known, in the order they
+ * are in, as if they were ranked.
+ *
+ * INPUT: The results, malloc'd with room for at least one, which the
+ *        iter takes over and frees; how many there are; the facets to
+ *        return from GetFacets, which are copied, or NULL; and what
+ *        ResultRowsWanted should return.
+ *
+ * RETURNS: The iter, or NULL if out of memory, in which case results
+ *          is freed.
+ */
+SearchResultIter CreateIterOverResults(struct searchResult *results,
+                                       int num_results, const char *facets,
+                                       int rows_wanted);
 
 void DestroySearchResultIter(SearchResultIter iter);
 
@@ -61,21 +139,125 @@ int SearchResultNext(SearchResultIter iter);
 
 int SearchResultIterHasMore(SearchResultIter iter);
 
+/**
+ * Finds the movies that match a query.
+ *
+ * A query is one or more title terms separated by spaces. Terms next to
+ * each other must all match (AND is implied), OR between terms matches
+ * either side, and NOT before a term drops the movies that match it.
+ * AND binds tighter than OR, so "star wars OR trek NOT next" finds
+ * movies with both star and wars, plus those with trek but not next.
+ * The operators must be upper case; lower case "and", "or" and "not" are
+ * searched for like any other word. A group made only of NOT terms
+ * matches nothing.
+ *
+ * Filters on the fields of a movie can go anywhere in the query, and
+ * every match must pass all of them: "love year:2010..2015 type:movie
+ * genre:comedy,drama". The fields are year, runtime, type, genre and
+ * adult (0 or 1). Commas separate values any of which will do, and
+ * year and runtime take ranges. A query of only filters matches every
+ * movie that passes them. Filters are PostingBitmap operations on the
+ * Index's fields sets, and if nothing passes them the titles are never
+ * looked at.
+ *
+ * A query that starts with "rank:" is scored instead: the movies whose
+ * titles have any of its terms are ranked by BM25, and only the best
+ * ones come back, best first. "rank:the love" returns the top 10 and
+ * "rank:50 the love" the top 50. Asking for more than 1000 gets the
+ * top 1000; a k of 0, one with a sign, or one with anything but digits
+ * matches nothing. Operators aren't special in ranked queries.
+ *
+ * A query that starts with "prefix:" is for type-ahead: "prefix:lov"
+ * finds the 10 words in the most titles that start with "lov" (see
+ * CompleteTerm), prints them with their counts, and matches every movie
+ * with any of them.
+ *
+ * A query that starts with "fuzzy:" takes one word and matches the
+ * movies with the 10 closest words within 2 edits (see
+ * FuzzyMatchTerms); "fuzzy:1 lvoe" allows only 1. Other queries match
+ * words exactly, so a word that isn't in the index costs one lookup.
+ *
+ * "facets=on" anywhere in any query also counts the genres, years and
+ * types of the matches (see GetFacets), and "facets=only" does that and
+ * asks for no rows (see ResultRowsWanted).
+ *
+ * "sort=year", "sort=runtime" or "sort=title", followed by "asc" (the
+ * default) or "desc", returns the matches in that order, movies without
+ * the field last; "limit=50" says how many to return (at most 1000, 10
+ * if a sort doesn't say). The top ones are picked with a heap over the
+ * Index's ColumnStore in one pass, so the rest are never put in order.
+ * A limit without a sort keeps the first matches. The facets still
+ * count every match.
+ *
+ * Each AND group is intersected starting from its smallest MovieSet,
+ * container by container over the PostingBitmaps, galloping past the
+ * containers and array values the smaller side doesn't have.
+ *
+ * RETURNS: A SearchResultIter over the matches, or NULL if nothing
+ *          matched.
+ */
 SearchResultIter FindMovies(Index index, char *term);
 
+/**
+ * Gets the facets of a query that asked for them: the top 10 genres,
+ * years and types of its results with how many results have each, like
+ * "genre:Comedy=1204,Drama=980;year:2013=600,2012=41;type:movie=80".
+ * They are counted in one pass over the results in the Index's
+ * ColumnStore, without looking at the rows.
+ *
+ * RETURNS: The facets, or NULL if the query didn't ask for them or the
+ *          Index has no ColumnStore. The iter owns the string.
+ */
+const char *GetFacets(SearchResultIter iter);
+
+/**
+ * RETURNS: 0 if the query asked for only its facets, so no rows should
+ *          be sent; 1 otherwise.
+ */
+int ResultRowsWanted(SearchResultIter iter);
+
 /**
  * Opens the file specified by the SearchResult as named
  *  in the DocIdMap and writes the specified row to the dest.
+ *  The row is read with one pread() at the offset that ParseTheFiles
+ *  recorded in the Index's RowTable for the file.
  *
  * INPUT:
+ *    index: The Index the result came from.
  *    result: A SearchResult that contains a docId and rowId
  *     docIds: The DocIdMap that contains the doc names specified in result.
- *     dest: A pointer to a char array where the row from the given file and row should be written.
+ *     dest: A pointer to a char array (at least 1000 bytes) where the row from the given file and row should be written.
  *
  * RETURNS:
  *     0 if successful; Not 0 if failed.
  */
-int CopyRowFromFile(SearchResult result, DocIdMap docIds, char *dest);
+int CopyRowFromFile(Index index, SearchResult result, DocIdMap docIds,
+                    char *dest);
+
+/**
+ * Finds where the row specified by the SearchResult is in its file by
+ * looking it up in the Index's RowTable, without touching the file.
+ *
+ * INPUT: The Index the result came from, the SearchResult, and where to
+ *        put the location.
+ *
+ * RETURNS: 0 if successful.
+ *         -1 if the Index has no such row.
+ */
+int LocateRow(Index index, SearchResult result, RowLocation location);
+
+/**
+ * Points the slice at the row specified by the SearchResult inside the
+ * mapped files, without copying it or making any system call.
+ *
+ * INPUT: The Index the result came from, the SearchResult, the files
+ *        from MapDocFiles, and the slice to fill in.
+ *
+ * RETURNS: 0 if successful.
+ *         -1 if there is no such row.
+ */
+int GetRowSlice(Index index, SearchResult result, DocMapping *maps,
+                RowSlice slice);
 
 
 #endif
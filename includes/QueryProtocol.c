@@ -0,0 +1,240 @@
+/*
+ *  Created by Adrienne Slaughter
+ *  CS 5007 Spring 2019
+ *  Northeastern University, Seattle
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  See <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "QueryProtocol.h"
+
+const char *ACK = "ACK";
+
+const char *GOODBYE = "GOODBYE";
+
+const char *KILL = "KILL_SERVER";
+
+const char *MISSING_ROW = "-\n";
+
+const char *QUERY_V2_PREFIX = "V2:";
+
+const char *SESSION_V2 = "V2SESSION";
+
+int SendAck(int socket_fd) {
+  int result = write(socket_fd, ACK, strlen(ACK));
+  if (result < 0) {
+    perror("Error sending ACK: ");
+    return -1;
+  }
+  return 0;
+}
+
+int CheckAck(char *response) {
+  if (strcmp(ACK, response) != 0) {
+    printf("I expected an ACK. Instead received: %s \n", response);
+    return -1;
+  }
+  return 0;
+}
+
+int SendGoodbye(int socket_fd) {
+  int result = write(socket_fd, GOODBYE, strlen(GOODBYE));
+  if (result < 0) {
+    perror("Error sending GOODBYE: ");
+    return -1;
+  }
+  return 0;
+}
+
+int CheckGoodbye(char *response) {
+  if (strcmp(GOODBYE, response) != 0) {
+    printf("I expected a GOODBYE. Instead received: %s \n", response);
+    return -1;
+  }
+  return 0;
+}
+
+int SendKill(int socket_fd) {
+  int result = write(socket_fd, KILL, strlen(KILL));
+  if (result < 0) {
+    perror("Error sending KILL: ");
+    return -1;
+  }
+  return 0;
+}
+
+int CheckKill(char *response) {
+  if (strcmp(KILL, response) != 0) {
+    return -1;
+  }
+  return 0;
+}
+
+char *CheckQueryV2(char *query) {
+  int prefix_len = strlen(QUERY_V2_PREFIX);
+  if (strncmp(query, QUERY_V2_PREFIX, prefix_len) != 0) {
+    return NULL;
+  }
+  return query + prefix_len;
+}
+
+int CheckSessionV2(char *message, int len) {
+  int session_len = strlen(SESSION_V2);
+  if (len < session_len || strncmp(message, SESSION_V2, session_len) != 0) {
+    return 0;
+  }
+  return session_len;
+}
+
+int SetSessionTimeout(int socket_fd) {
+  struct timeval timeout;
+  timeout.tv_sec = SESSION_IDLE_TIMEOUT;
+  timeout.tv_usec = 0;
+  if (setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO,
+                 &timeout, sizeof(timeout)) == -1) {
+    perror("Error setting session timeout: ");
+    return -1;
+  }
+  return 0;
+}
+
+int SetNoDelay(int socket_fd) {
+  int on = 1;
+  if (setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) == -1) {
+    perror("Error setting TCP_NODELAY: ");
+    return -1;
+  }
+  return 0;
+}
+
+int ParseFrameHeader(const char *header, char *type) {
+  const unsigned char *bytes = (const unsigned char*)header;
+  *type = bytes[4];
+  return (bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+}
+
+void InitFrameBuffer(FrameBuffer *frames) {
+  frames->len = 0;
+  frames->sent = 0;
+}
+
+int PutFrame(FrameBuffer *frames, char type, const char *payload, int len) {
+  if (frames->len + FRAME_HEADER_SIZE + len > FRAME_BUFFER_SIZE) {
+    return -1;
+  }
+  unsigned char *header = (unsigned char*)frames->data + frames->len;
+  header[0] = (len >> 24) & 0xFF;
+  header[1] = (len >> 16) & 0xFF;
+  header[2] = (len >> 8) & 0xFF;
+  header[3] = len & 0xFF;
+  header[4] = type;
+  memcpy(frames->data + frames->len + FRAME_HEADER_SIZE, payload, len);
+  frames->len += FRAME_HEADER_SIZE + len;
+  return 0;
+}
+
+int SendFrames(int socket_fd, FrameBuffer *frames) {
+  while (frames->sent < frames->len) {
+    int result = send(socket_fd, frames->data + frames->sent,
+                      frames->len - frames->sent, MSG_NOSIGNAL);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("Error sending frames: ");
+      return -1;
+    }
+    frames->sent += result;
+  }
+  InitFrameBuffer(frames);
+  return 0;
+}
+
+int BufferFrame(int socket_fd, FrameBuffer *frames, char type,
+                const char *payload, int len) {
+  if (PutFrame(frames, type, payload, len) == 0) {
+    return 0;
+  }
+  if (SendFrames(socket_fd, frames) != 0) {
+    return -1;
+  }
+  return PutFrame(frames, type, payload, len);
+}
+
+void InitFrameReader(FrameReader *reader, int socket_fd) {
+  reader->socket_fd = socket_fd;
+  reader->start = 0;
+  reader->end = 0;
+}
+
+int PreloadFrameReader(FrameReader *reader, const char *data, int len) {
+  if (reader->end + len > FRAME_BUFFER_SIZE) {
+    return -1;
+  }
+  memcpy(reader->data + reader->end, data, len);
+  reader->end += len;
+  return 0;
+}
+
+// Reads from the socket until at least wanted bytes are buffered.
+// Returns 0 on success, -1 if the connection closed first.
+static int FillFrameReader(FrameReader *reader, int wanted) {
+  if (reader->end - reader->start >= wanted) {
+    return 0;
+  }
+  // Slide what's left to the front to make room.
+  memmove(reader->data, reader->data + reader->start,
+          reader->end - reader->start);
+  reader->end -= reader->start;
+  reader->start = 0;
+
+  while (reader->end < wanted) {
+    int result = recv(reader->socket_fd, reader->data + reader->end,
+                      FRAME_BUFFER_SIZE - reader->end, 0);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      return -1;
+    }
+    reader->end += result;
+  }
+  return 0;
+}
+
+int ReadFrame(FrameReader *reader, char *type, char *dest, int dest_size) {
+  if (FillFrameReader(reader, FRAME_HEADER_SIZE) != 0) {
+    return -1;
+  }
+  int len = ParseFrameHeader(reader->data + reader->start, type);
+  if (len < 0 || len >= dest_size ||
+      len > FRAME_BUFFER_SIZE - FRAME_HEADER_SIZE) {
+    return -1;
+  }
+  if (FillFrameReader(reader, FRAME_HEADER_SIZE + len) != 0) {
+    return -1;
+  }
+  memcpy(dest, reader->data + reader->start + FRAME_HEADER_SIZE, len);
+  dest[len] = '\0';
+  reader->start += FRAME_HEADER_SIZE + len;
+  return len;
+}
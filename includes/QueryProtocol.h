@@ -7,6 +7,11 @@ extern const char *GOODBYE;
 
 extern const char *KILL; 
 
+// Sent in place of a row that can't be read, in v1 and as a v2 row
+// frame, so the client still gets as many rows as the count said (and
+// in v1 keeps ACKing).
+extern const char *MISSING_ROW;
+
 /**
  * Sends an ACK (acknowledgement) packet to the 
  * recipient. 
@@ -69,5 +74,191 @@ int SendKill(int socket_fd);
 int CheckKill(char *response); 
 
 
+//===========================
+//
+// Protocol v2
+//
+// In v1 the client has to ACK every row before the server sends the next
+// one. In v2 the client starts its query with QUERY_V2_PREFIX, and the
+// server answers with a stream of length-prefixed frames that it sends
+// without waiting: one FRAME_COUNT, then one FRAME_ROW per result, then
+// FRAME_GOODBYE. TCP flow control keeps a fast server from outrunning a
+// slow client. Servers still answer queries without the prefix with v1.
+//
+// Every frame is a FRAME_HEADER_SIZE byte header (the payload length as
+// a 4 byte big-endian number, then one byte for the frame type) followed
+// by the payload.
+//
+// If the query asked for facets, a FRAME_FACETS with them comes right
+// after FRAME_COUNT; if it asked for only the facets, no FRAME_ROWs do.
+//
+// A client that wants to run many queries over one connection sends
+// SESSION_V2 instead of a query. From then on both sides only send
+// frames: the client sends a FRAME_QUERY for each query, and the server
+// answers each with FRAME_COUNT, the FRAME_ROWs and FRAME_END. The client
+// can send its next query before the last answer is finished. The session
+// ends when the client sends FRAME_GOODBYE or has been idle for
+// SESSION_IDLE_TIMEOUT seconds; the server answers with FRAME_GOODBYE and
+// closes the connection.
+//
+//===========================
+
+extern const char *QUERY_V2_PREFIX;
+
+extern const char *SESSION_V2;
+
+#define FRAME_HEADER_SIZE 5
+#define FRAME_BUFFER_SIZE 65536
+
+#define FRAME_COUNT 'C'
+#define FRAME_ROW 'R'
+#define FRAME_GOODBYE 'G'
+#define FRAME_QUERY 'Q'
+#define FRAME_END 'E'
+#define FRAME_FACETS 'F'
+
+#define SESSION_IDLE_TIMEOUT 30
+
+/**
+ * Frames waiting to be sent. Frames are packed back to back so a whole
+ * batch of rows goes out with a single send.
+ *
+ * Rows are copied in even though they are already in mapped files:
+ * sending them from there with writev takes two iovecs a row (header
+ * and row), and for rows of about 85 bytes the kernel's cost per iovec
+ * is more than the memcpy it saves.
+ */
+typedef struct frameBuffer {
+  char data[FRAME_BUFFER_SIZE];
+  int len;   // Bytes of frames in data.
+  int sent;  // Bytes of data already written to the socket.
+} FrameBuffer;
+
+/**
+ * Frames read off a socket that haven't been handed out yet.
+ */
+typedef struct frameReader {
+  int socket_fd;
+  char data[FRAME_BUFFER_SIZE];
+  int start;  // First byte not yet handed out.
+  int end;    // One past the last byte read off the socket.
+} FrameReader;
+
+/**
+ * Checks if a query asks for protocol v2.
+ *
+ * INPUT: The query received from the client.
+ *
+ * RETURNS: A pointer to the search term inside the query if it is a
+ *          v2 query. NULL otherwise.
+ */
+char *CheckQueryV2(char *query);
+
+/**
+ * Checks if the first message from a client opens a v2 session.
+ *
+ * INPUT: The bytes received and how many there are.
+ *
+ * RETURNS: The number of bytes at the start of the message that belong
+ *          to SESSION_V2; anything after them is already frames.
+ *          0 if the message doesn't open a session.
+ */
+int CheckSessionV2(char *message, int len);
+
+/**
+ * Makes reads on the socket give up after SESSION_IDLE_TIMEOUT seconds
+ * without data, so an idle session gets closed.
+ *
+ * RETURNS: 0 if successful.
+ *         -1 if there is an error.
+ */
+int SetSessionTimeout(int socket_fd);
+
+/**
+ * Turns off Nagle's algorithm on the socket. v2 results are already
+ * batched into FRAME_BUFFER_SIZE sends, and a send larger than one
+ * segment leaves a small tail that Nagle would otherwise hold until the
+ * client's delayed ACK, stalling the stream for tens of milliseconds.
+ *
+ * RETURNS: 0 if successful.
+ *         -1 if there is an error.
+ */
+int SetNoDelay(int socket_fd);
+
+/**
+ * Reads a frame header.
+ *
+ * INPUT: FRAME_HEADER_SIZE bytes at the start of a frame, and where to
+ *        put the frame type.
+ *
+ * RETURNS: The length of the payload that follows the header.
+ */
+int ParseFrameHeader(const char *header, char *type);
+
+/**
+ * Empties the FrameBuffer.
+ */
+void InitFrameBuffer(FrameBuffer *frames);
+
+/**
+ * Adds a frame to the end of the FrameBuffer.
+ *
+ * INPUT: The buffer, the frame type, and the payload and its length.
+ *
+ * RETURNS: 0 if the frame was added.
+ *         -1 if there isn't room for it; send the buffer first.
+ */
+int PutFrame(FrameBuffer *frames, char type, const char *payload, int len);
+
+/**
+ * Adds a frame to the end of the FrameBuffer, sending what is already
+ * in the buffer first if there isn't room.
+ *
+ * INPUT: The socket to send to, the buffer, the frame type, and the
+ *        payload and its length.
+ *
+ * RETURNS: 0 if the frame was added.
+ *         -1 if there is an error.
+ */
+int BufferFrame(int socket_fd, FrameBuffer *frames, char type,
+                const char *payload, int len);
+
+/**
+ * Sends every frame in the FrameBuffer, then empties it.
+ *
+ * INPUT: The socket to send to, and the frames to send.
+ *
+ * RETURNS: 0 if successfully sends.
+ *         -1 if there is an error.
+ */
+int SendFrames(int socket_fd, FrameBuffer *frames);
+
+/**
+ * Sets up a FrameReader to read from the given socket.
+ */
+void InitFrameReader(FrameReader *reader, int socket_fd);
+
+/**
+ * Hands the reader bytes that were already read off its socket, so that
+ * they come out of ReadFrame before anything new.
+ *
+ * RETURNS: 0 if successful.
+ *         -1 if they don't fit.
+ */
+int PreloadFrameReader(FrameReader *reader, const char *data, int len);
+
+/**
+ * Reads the next frame. The payload is copied into dest and
+ * null-terminated.
+ *
+ * INPUT: The reader, where to put the frame type, and a buffer of
+ *        dest_size bytes for the payload.
+ *
+ * RETURNS: The length of the payload.
+ *         -1 if the connection closed, there was an error, or the
+ *          payload doesn't fit in dest.
+ */
+int ReadFrame(FrameReader *reader, char *type, char *dest, int dest_size);
+
 
 #endif // QUERYPROTOCOL_H
@@ -53,6 +53,10 @@ void Setup(char *dir) {
 
   // Create the index
   docIndex = CreateIndex();
+  // Keep every movie's fields in dense columns as well.
+  if (AddColumnStore(docIndex) != 0) {
+    printf("Couldn't make a column store; going without one.\n");
+  }
 
   // Index the files
   printf("Parsing and indexing files...\n");
@@ -67,6 +71,16 @@ int Cleanup() {
   return 0;
 }
 
+// Copies a row into movieSearchResult and sends it, or sends MISSING_ROW
+// if it can't be read, so the client still gets every row it was promised.
+void SendRow(int client_socketfd, SearchResult sr) {
+  const char *row = movieSearchResult;
+  if (CopyRowFromFile(docIndex, sr, docs, movieSearchResult) != 0) {
+    row = MISSING_ROW;
+  }
+  send(client_socketfd, row, strlen(row), 0);
+}
+
 // Takes client's query search and iterates through movie index.
 // Uses the client-server connection to send the results through to the client.
 void runQuery(int client_socketfd, char *buffer) {
@@ -100,8 +114,7 @@ void runQuery(int client_socketfd, char *buffer) {
       return;
     }
     SearchResultGet(results, sr);
-    CopyRowFromFile(sr, docs, movieSearchResult);
-    send(client_socketfd, movieSearchResult, strlen(movieSearchResult), 0);
+    SendRow(client_socketfd, sr);
 
     while (SearchResultIterHasMore(results) != 0) {
       //      sleep(5);  // Used to test server with multiple clients. (Compared to multiserver)
@@ -116,8 +129,7 @@ void runQuery(int client_socketfd, char *buffer) {
 	return;
       }
       SearchResultGet(results, sr);
-      CopyRowFromFile(sr, docs, movieSearchResult);
-      send(client_socketfd, movieSearchResult, strlen(movieSearchResult), 0);
+      SendRow(client_socketfd, sr);
     }
 
     printf("Closing Client Connection...\n");
@@ -127,6 +139,86 @@ void runQuery(int client_socketfd, char *buffer) {
   }
 }
 
+// Takes a v2 query and streams the count, the facets if asked for, every
+// row and an end_type frame to the client without waiting for an ACK
+// between rows.
+void runQueryV2(int client_socketfd, char *term, char end_type) {
+  FrameBuffer frames;
+  struct searchResult sr;
+  int count_len;
+
+  InitFrameBuffer(&frames);
+  SearchResultIter results = FindMovies(docIndex, term);
+
+  if (results == NULL) {
+    printf("No results for this term. Please try another.\n");
+    BufferFrame(client_socketfd, &frames, FRAME_COUNT, "0", 1);
+  } else {
+    count_len = sprintf(movieSearchResult, "%d", NumResultsInIter(results));
+    printf("Number of Results: %s\n", movieSearchResult);
+    BufferFrame(client_socketfd, &frames, FRAME_COUNT, movieSearchResult,
+                count_len);
+    const char *facets = GetFacets(results);
+    if (facets != NULL) {
+      BufferFrame(client_socketfd, &frames, FRAME_FACETS, facets,
+                  strlen(facets));
+    }
+
+    while (ResultRowsWanted(results)) {
+      SearchResultGet(results, &sr);
+      // A row that can't be read still gets a frame, so the client gets
+      // as many rows as the count said.
+      const char *row = movieSearchResult;
+      if (CopyRowFromFile(docIndex, &sr, docs, movieSearchResult) != 0) {
+        row = MISSING_ROW;
+      }
+      if (BufferFrame(client_socketfd, &frames, FRAME_ROW, row,
+                      strlen(row)) != 0) {
+        break;
+      }
+      if (SearchResultIterHasMore(results) == 0 ||
+          SearchResultNext(results) < 0) {
+        break;
+      }
+    }
+    DestroySearchResultIter(results);
+  }
+
+  BufferFrame(client_socketfd, &frames, end_type, "", 0);
+  SendFrames(client_socketfd, &frames);
+}
+
+// Serves a v2 session: answers query frames on the same connection until
+// the client says goodbye or stays idle for too long. Other clients wait
+// while a session is open, so the idle timeout bounds how long that is.
+// pending holds the bytes that arrived together with the session request.
+void runSessionV2(int client_socketfd, char *pending, int pending_len) {
+  FrameReader *reader = (FrameReader*)malloc(sizeof(FrameReader));
+  FrameBuffer frames;
+  char term[BUFFER_SIZE];
+  char type;
+
+  if (reader == NULL) {
+    printf("Couldn't malloc FrameReader\n");
+    return;
+  }
+  InitFrameReader(reader, client_socketfd);
+  PreloadFrameReader(reader, pending, pending_len);
+  SetSessionTimeout(client_socketfd);
+
+  while (ReadFrame(reader, &type, term, BUFFER_SIZE) >= 0 &&
+         type == FRAME_QUERY) {
+    printf("Query Received: %s \n", term);
+    runQueryV2(client_socketfd, term, FRAME_END);
+  }
+
+  printf("Closing Client Connection...\n");
+  InitFrameBuffer(&frames);
+  BufferFrame(client_socketfd, &frames, FRAME_GOODBYE, "", 0);
+  SendFrames(client_socketfd, &frames);
+  free(reader);
+}
+
 
 int main(int argc, char **argv) {
   // Get args
@@ -203,12 +295,29 @@ int main(int argc, char **argv) {
       printf("Waiting for client connection...\n");
       client_socketfd = accept(socketfd, (struct sockaddr *)&client_addr_storage, &addr_size);
       printf("Client connected.");
+      SetNoDelay(client_socketfd);
       // Step 5: Handle clients that connect
       SendAck(client_socketfd);
-      bytes_received = recv(client_socketfd, buffer, BUFFER_SIZE, 0);
+      bytes_received = recv(client_socketfd, buffer, BUFFER_SIZE - 1, 0);
+      if (bytes_received <= 0) {
+        close(client_socketfd);
+        continue;
+      }
       buffer[bytes_received] = '\0';
-      printf("Query Received: %s \n", buffer);
-      runQuery(client_socketfd, buffer);
+      int session_len = CheckSessionV2(buffer, bytes_received);
+      char *term = CheckQueryV2(buffer);
+      if (session_len > 0) {
+        runSessionV2(client_socketfd, buffer + session_len,
+                     bytes_received - session_len);
+      } else if (term != NULL) {
+        printf("Query Received: %s \n", buffer);
+        runQueryV2(client_socketfd, term, FRAME_GOODBYE);
+        printf("Closing Client Connection...\n");
+      } else {
+        printf("Query Received: %s \n", buffer);
+        runQuery(client_socketfd, buffer);
+      }
+      close(client_socketfd);
     }
     // Step 6: Close the socket
     close(socketfd);
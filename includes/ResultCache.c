@@ -0,0 +1,245 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/mman.h>
+
+#include "ResultCache.h"
+#include "MovieSet.h"
+#include "htll/Hashtable.h"
+
+ResultCache CreateResultCache() {
+  // Anonymous mappings start zeroed, which is an empty cache. Pages are
+  // only backed once an entry writes to them, so nothing is reserved
+  // for results that are never cached.
+  void *cache = mmap(NULL, sizeof(struct resultCache),
+                     PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (cache == MAP_FAILED) {
+    perror("Couldn't map the ResultCache");
+    return NULL;
+  }
+  return (ResultCache)cache;
+}
+
+void DestroyResultCache(ResultCache cache) {
+  munmap(cache, sizeof(struct resultCache));
+}
+
+// Returns 1 if a query word means the same in any case, so it can be
+// folded to lower case: words are looked up in lower case, but the
+// operators, options, filters and the "asc" or "desc" after a "sort="
+// have to be written the way they are.
+static int CaseFolds(const char *word, int len, const char *previous) {
+  if ((len == 3 && strncmp(word, "AND", 3) == 0) ||
+      (len == 2 && strncmp(word, "OR", 2) == 0) ||
+      (len == 3 && strncmp(word, "NOT", 3) == 0)) {
+    return 0;
+  }
+  if (previous != NULL && strncmp(previous, "sort=", strlen("sort=")) == 0) {
+    return 0;
+  }
+  for (int i = 0; i < len; i++) {
+    if (word[i] == ':' || word[i] == '=') {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Copies query into out with one space between words and none at the
+// ends, and the words that can be in lower case.
+// Returns 0 if successful, -1 if it doesn't fit in CACHE_MAX_QUERY.
+static int NormalizeQuery(const char *query, char *out) {
+  const char *previous = NULL;
+  int len = 0;
+  const char *c = query;
+
+  while (*c != '\0') {
+    if (isspace((unsigned char)*c)) {
+      c++;
+      continue;
+    }
+    int word_len = 0;
+    while (c[word_len] != '\0' && !isspace((unsigned char)c[word_len])) {
+      word_len++;
+    }
+    if (len + (len > 0) + word_len >= CACHE_MAX_QUERY - 1) {
+      return -1;
+    }
+    if (len > 0) {
+      out[len++] = ' ';
+    }
+    int fold = CaseFolds(c, word_len, previous);
+    previous = out + len;
+    for (int i = 0; i < word_len; i++) {
+      out[len++] = fold ? tolower((unsigned char)c[i]) : c[i];
+    }
+    out[len] = '\0';
+    c += word_len;
+  }
+  out[len] = '\0';
+  return 0;
+}
+
+// Copies the entry for query, if it is one, into the rest of the
+// arguments. results is malloc'd.
+// Returns 1 if it was copied, 0 if it is another query, -1 if a writer
+// changed it while it was being read.
+static int ReadEntry(CacheEntry *entry, const char *query, uint64_t hash,
+                     int *found, int *rows_wanted, char *facets,
+                     struct searchResult **results, int *num_results) {
+  uint32_t seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+  if (seq & 1) {
+    return -1;
+  }
+  if (entry->hash != hash ||
+      strncmp(entry->query, query, CACHE_MAX_QUERY) != 0) {
+    return 0;
+  }
+  *found = entry->found;
+  *rows_wanted = entry->rows_wanted;
+  *num_results = entry->num_results;
+  if (*num_results < 0 || *num_results > CACHE_MAX_RESULTS) {
+    return -1;
+  }
+  memcpy(facets, entry->facets, MAX_FACETS_LENGTH + 1);
+  facets[MAX_FACETS_LENGTH] = '\0';
+  *results = (struct searchResult*)malloc(
+      (*num_results + 1) * sizeof(struct searchResult));
+  if (*results == NULL) {
+    return -1;
+  }
+  for (int i = 0; i < *num_results; i++) {
+    (*results)[i].doc_id = CACHE_RESULT_DOC_ID(entry->results[i]);
+    (*results)[i].row_id = CACHE_RESULT_ROW_ID(entry->results[i]);
+  }
+
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) != seq) {
+    free(*results);
+    return -1;
+  }
+  return 1;
+}
+
+int LookupResults(ResultCache cache, const char *query,
+                  SearchResultIter *results) {
+  char key[CACHE_MAX_QUERY];
+  char facets[MAX_FACETS_LENGTH + 1];
+  struct searchResult *found_results;
+  int found, rows_wanted, num_results;
+
+  if (NormalizeQuery(query, key) == 0) {
+    uint64_t hash = FNVHash64((unsigned char*)key, strlen(key));
+    CacheEntry *set = cache->entries[hash % CACHE_SETS];
+    for (int way = 0; way < CACHE_WAYS; way++) {
+      int read = ReadEntry(&set[way], key, hash, &found, &rows_wanted,
+                           facets, &found_results, &num_results);
+      if (read == 0) {
+        continue;
+      }
+      if (read < 0) {
+        break;
+      }
+      __atomic_store_n(&set[way].referenced, 1, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&cache->hits, 1, __ATOMIC_RELAXED);
+      *results = NULL;
+      if (found) {
+        *results = CreateIterOverResults(found_results, num_results,
+                                         facets[0] != '\0' ? facets : NULL,
+                                         rows_wanted);
+      } else {
+        free(found_results);
+      }
+      return 1;
+    }
+  }
+  __atomic_fetch_add(&cache->misses, 1, __ATOMIC_RELAXED);
+  return 0;
+}
+
+// Picks the entry in set to put query in: the one already holding it, a
+// never used one, or the first one the CLOCK hand finds that hasn't
+// been hit since the hand last went by.
+static CacheEntry *ChooseEntry(CacheEntry *set, uint32_t *hand,
+                               const char *query, uint64_t hash) {
+  for (int way = 0; way < CACHE_WAYS; way++) {
+    if (set[way].hash == hash &&
+        strncmp(set[way].query, query, CACHE_MAX_QUERY) == 0) {
+      return &set[way];
+    }
+  }
+  for (int way = 0; way < CACHE_WAYS; way++) {
+    if (__atomic_load_n(&set[way].seq, __ATOMIC_RELAXED) == 0) {
+      return &set[way];
+    }
+  }
+  // Every entry gets its bit cleared on the first lap, so two laps
+  // always find one.
+  for (int i = 0; i < 2 * CACHE_WAYS; i++) {
+    CacheEntry *entry =
+      &set[__atomic_fetch_add(hand, 1, __ATOMIC_RELAXED) % CACHE_WAYS];
+    if (__atomic_exchange_n(&entry->referenced, 0, __ATOMIC_RELAXED) == 0) {
+      return entry;
+    }
+  }
+  return &set[0];
+}
+
+void CacheResults(ResultCache cache, const char *query,
+                  SearchResultIter results) {
+  char key[CACHE_MAX_QUERY];
+
+  if (NormalizeQuery(query, key) != 0 ||
+      (results != NULL && results->numResults > CACHE_MAX_RESULTS)) {
+    return;
+  }
+  uint64_t hash = FNVHash64((unsigned char*)key, strlen(key));
+  int set_num = hash % CACHE_SETS;
+  CacheEntry *entry = ChooseEntry(cache->entries[set_num],
+                                  &cache->hands[set_num], key, hash);
+
+  // Only one writer at a time; if another one has the entry, let it be.
+  uint32_t seq = __atomic_load_n(&entry->seq, __ATOMIC_RELAXED);
+  if ((seq & 1) ||
+      !__atomic_compare_exchange_n(&entry->seq, &seq, seq + 1, 0,
+                                   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    return;
+  }
+
+  entry->hash = hash;
+  strcpy(entry->query, key);
+  entry->found = results != NULL;
+  entry->rows_wanted = results != NULL ? ResultRowsWanted(results) : 1;
+  entry->num_results = 0;
+  entry->facets[0] = '\0';
+  if (results != NULL) {
+    const char *facets = GetFacets(results);
+    if (facets != NULL) {
+      snprintf(entry->facets, sizeof(entry->facets), "%s", facets);
+    }
+    // Walk a copy, so results is still on its first result afterwards.
+    struct searchResultIter walk = *results;
+    struct searchResult sr;
+    for (int i = 0; i < walk.numResults; i++) {
+      if (i > 0 && SearchResultNext(&walk) != 0) {
+        break;
+      }
+      SearchResultGet(&walk, &sr);
+      entry->results[entry->num_results++] =
+        CACHE_RESULT(sr.doc_id, sr.row_id);
+    }
+  }
+  __atomic_store_n(&entry->referenced, 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+uint64_t CacheHits(ResultCache cache) {
+  return __atomic_load_n(&cache->hits, __ATOMIC_RELAXED);
+}
+
+uint64_t CacheMisses(ResultCache cache) {
+  return __atomic_load_n(&cache->misses, __ATOMIC_RELAXED);
+}
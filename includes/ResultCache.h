@@ -0,0 +1,111 @@
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <stdint.h>
+
+#include "QueryProcessor.h"
+
+// How the cache is laid out: CACHE_SETS sets of CACHE_WAYS entries. A
+// query can only go in the set its hash picks.
+#define CACHE_SETS 128
+#define CACHE_WAYS 4
+
+// Longest query and most results an entry can hold. Queries with more
+// aren't cached. Entries are sized for the popular words that match the
+// most movies, which are the ones most worth caching; an entry only
+// takes memory for the pages its results fill, so small results don't
+// pay for that.
+#define CACHE_MAX_QUERY 256
+#define CACHE_MAX_RESULTS (1 << 15)
+
+/**
+ * How an entry keeps a result in one number: the doc_id in the high 32
+ * bits and the row_id in the low 32 bits. The cache has no Index to
+ * turn a row ordinal back into a doc_id with, so it keeps both.
+ */
+#define CACHE_RESULT(doc_id, row_id) \
+  (((uint64_t)(doc_id) << 32) | (uint32_t)(row_id))
+#define CACHE_RESULT_DOC_ID(result) ((uint64_t)(result) >> 32)
+#define CACHE_RESULT_ROW_ID(result) ((int)((result) & 0xFFFFFFFF))
+
+/**
+ * One cached query: its results as CACHE_RESULTs, in the order they
+ * are sent, and its facets.
+ *
+ * seq is a seqlock. A writer makes it odd while it changes the entry
+ * and even again when it is done, so a reader that sees the same even
+ * seq before and after copying the entry knows nothing changed it in
+ * between. referenced is set by every hit and cleared by the CLOCK hand
+ * of the set, so entries that were not hit since the hand last went by
+ * are the ones replaced.
+ */
+typedef struct cacheEntry {
+  uint32_t seq;
+  uint32_t referenced;
+  uint64_t hash;
+  char query[CACHE_MAX_QUERY];
+  int found;  // 0 if the query matched nothing.
+  int rows_wanted;
+  int num_results;
+  char facets[MAX_FACETS_LENGTH + 1];
+  uint64_t results[CACHE_MAX_RESULTS];
+} CacheEntry;
+
+/**
+ * A ResultCache lives in one shared mapping, so after a fork every
+ * process reads and fills the same cache, and a query one child ran is
+ * a hit for the next. Nothing takes a lock: reads are checked with the
+ * entry's seqlock and retried as a miss if a writer got in the way, and
+ * a writer that finds another one already writing an entry just leaves
+ * it alone.
+ *
+ * The Index must not change while the cache is in use, since nothing
+ * tells the cache when results go stale.
+ */
+typedef struct resultCache {
+  uint64_t hits;
+  uint64_t misses;
+  uint32_t hands[CACHE_SETS];
+  CacheEntry entries[CACHE_SETS][CACHE_WAYS];
+} *ResultCache;
+
+/**
+ * Maps a new, empty ResultCache that is shared with every process
+ * forked after this.
+ *
+ * RETURNS: The cache, or NULL if it couldn't be mapped.
+ */
+ResultCache CreateResultCache();
+
+void DestroyResultCache(ResultCache cache);
+
+/**
+ * Looks up a query. Queries are the same if they have the same words,
+ * however many spaces are between them, and whatever case the words
+ * that are looked up in lower case are in ("Derby" is "derby", but
+ * "AND" isn't "and").
+ *
+ * INPUT: The cache, the query, and where to put the results.
+ *
+ * RETURNS: 1 if the query was cached, in which case *results is a new
+ *          SearchResultIter over its results, or NULL if it matched
+ *          nothing; 0 if it wasn't.
+ */
+int LookupResults(ResultCache cache, const char *query,
+                  SearchResultIter *results);
+
+/**
+ * Caches what FindMovies returned for a query, which may be NULL. The
+ * iter must still be on its first result, and is left there.
+ */
+void CacheResults(ResultCache cache, const char *query,
+                  SearchResultIter results);
+
+/**
+ * RETURNS: How many lookups were hits and how many were misses, over
+ *          every process.
+ */
+uint64_t CacheHits(ResultCache cache);
+uint64_t CacheMisses(ResultCache cache);
+
+#endif
@@ -0,0 +1,398 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_AVX2_SCANNER
+#endif
+
+#include "RowParser.h"
+
+// How many fields a row has; the genres are the last.
+#define ROW_FIELDS 9
+
+// How many bytes FindDelimiters looks at.
+#define WINDOW_SIZE 64
+
+typedef void (*FindDelimitersFn)(const char *data, uint64_t *pipes,
+                                 uint64_t *newlines);
+
+static void FindDelimitersScalar(const char *data, uint64_t *pipes,
+                                 uint64_t *newlines) {
+  *pipes = 0;
+  *newlines = 0;
+  for (int i = 0; i < WINDOW_SIZE; i++) {
+    *pipes |= (uint64_t)(data[i] == '|') << i;
+    *newlines |= (uint64_t)(data[i] == '\n') << i;
+  }
+}
+
+#ifdef __SSE2__
+static void FindDelimitersSSE2(const char *data, uint64_t *pipes,
+                               uint64_t *newlines) {
+  const __m128i pipe = _mm_set1_epi8('|');
+  const __m128i newline = _mm_set1_epi8('\n');
+  *pipes = 0;
+  *newlines = 0;
+  for (int i = 0; i < WINDOW_SIZE; i += 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)(data + i));
+    *pipes |= (uint64_t)(uint16_t)
+      _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, pipe)) << i;
+    *newlines |= (uint64_t)(uint16_t)
+      _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)) << i;
+  }
+}
+#endif
+
+#ifdef HAVE_AVX2_SCANNER
+__attribute__((target("avx2")))
+static void FindDelimitersAVX2(const char *data, uint64_t *pipes,
+                               uint64_t *newlines) {
+  const __m256i pipe = _mm256_set1_epi8('|');
+  const __m256i newline = _mm256_set1_epi8('\n');
+  __m256i low = _mm256_loadu_si256((const __m256i*)data);
+  __m256i high = _mm256_loadu_si256((const __m256i*)(data + 32));
+  *pipes = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, pipe)) |
+    (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, pipe))
+    << 32;
+  *newlines =
+    (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, newline)) |
+    (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, newline))
+    << 32;
+}
+#endif
+
+// Every version of FindDelimiters this build has, best first.
+static const struct {
+  const char *name;
+  FindDelimitersFn find;
+} scanners[] = {
+#ifdef HAVE_AVX2_SCANNER
+  { "avx2", FindDelimitersAVX2 },
+#endif
+#ifdef __SSE2__
+  { "sse2", FindDelimitersSSE2 },
+#endif
+  { "scalar", FindDelimitersScalar },
+};
+
+#define NUM_SCANNERS ((int)(sizeof(scanners) / sizeof(scanners[0])))
+
+static FindDelimitersFn find_delimiters = FindDelimitersScalar;
+static const char *scanner_name = "scalar";
+
+static int CpuHasScanner(const char *name) {
+#ifdef HAVE_AVX2_SCANNER
+  if (strcmp(name, "avx2") == 0) {
+    return __builtin_cpu_supports("avx2");
+  }
+#endif
+  return 1;
+}
+
+int UseDelimiterScanner(const char *name) {
+  for (int i = 0; i < NUM_SCANNERS; i++) {
+    if (strcmp(scanners[i].name, name) == 0 && CpuHasScanner(name)) {
+      find_delimiters = scanners[i].find;
+      scanner_name = scanners[i].name;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+const char *DelimiterScannerName() {
+  return scanner_name;
+}
+
+// Picks the best version before any thread can be parsing.
+__attribute__((constructor))
+static void PickDelimiterScanner() {
+#ifdef HAVE_AVX2_SCANNER
+  __builtin_cpu_init();
+#endif
+  for (int i = 0; i < NUM_SCANNERS; i++) {
+    if (UseDelimiterScanner(scanners[i].name) == 0) {
+      return;
+    }
+  }
+}
+
+void FindDelimiters(const char *data, uint64_t *pipes, uint64_t *newlines) {
+  find_delimiters(data, pipes, newlines);
+}
+
+// FindDelimiters for the length bytes at data, which may be fewer than
+// 64; the bits past length are clear.
+static void FindDelimitersIn(const char *data, size_t length,
+                             uint64_t *pipes, uint64_t *newlines) {
+  if (length >= WINDOW_SIZE) {
+    find_delimiters(data, pipes, newlines);
+    return;
+  }
+  char padded[WINDOW_SIZE] = { 0 };
+  memcpy(padded, data, length);
+  find_delimiters(padded, pipes, newlines);
+}
+
+void InitRowScanner(RowScanner *scanner, const char *data, size_t size,
+                    int at_eof) {
+  scanner->data = data;
+  scanner->size = size;
+  scanner->pos = 0;
+  scanner->at_eof = at_eof;
+  scanner->window = SIZE_MAX;
+  scanner->newlines = 0;
+}
+
+// Finds the first newline in the limit bytes at scanner->pos, moving the
+// scanner's window along as it goes, so rows that share a window only
+// have it scanned once.
+// Returns where it is, or NULL if there isn't one.
+static const char *FindNewline(RowScanner *scanner, size_t limit) {
+  size_t end = scanner->pos + limit;
+  size_t from = scanner->pos;
+
+  if (scanner->window == SIZE_MAX || from < scanner->window ||
+      from >= scanner->window + WINDOW_SIZE) {
+    scanner->window = from;
+  }
+  while (1) {
+    if (scanner->window == from) {
+      uint64_t pipes;
+      FindDelimitersIn(scanner->data + from, scanner->size - from, &pipes,
+                       &scanner->newlines);
+    }
+    uint64_t newlines =
+      scanner->newlines & (~0ULL << (from - scanner->window));
+    if (newlines != 0) {
+      size_t at = scanner->window + __builtin_ctzll(newlines);
+      return at < end ? scanner->data + at : NULL;
+    }
+    from = scanner->window + WINDOW_SIZE;
+    if (from >= end) {
+      return NULL;
+    }
+    scanner->window = from;
+  }
+}
+
+int ScanNextRow(RowScanner *scanner, FieldView *row) {
+  if (scanner->pos >= scanner->size) {
+    return -1;
+  }
+  size_t left = scanner->size - scanner->pos;
+  size_t limit = left < MAX_ROW_LENGTH ? left : MAX_ROW_LENGTH;
+  const char *start = scanner->data + scanner->pos;
+  const char *newline = FindNewline(scanner, limit);
+  size_t length;
+  if (newline != NULL) {
+    length = newline - start + 1;
+  } else if (limit == MAX_ROW_LENGTH || scanner->at_eof) {
+    length = limit;
+  } else {
+    return -1;
+  }
+  row->data = start;
+  row->length = length;
+  scanner->pos += length;
+  return 0;
+}
+
+// A field of "-" is empty, like CheckAndAllocateString makes it.
+static FieldView FieldOrEmpty(const char *data, int length) {
+  FieldView field = { data, length };
+  if (length == 1 && data[0] == '-') {
+    field.data = NULL;
+    field.length = 0;
+  }
+  return field;
+}
+
+// What CheckInt would make of the field.
+static int FieldToInt(const char *data, int length) {
+  char number[32];
+  if (length == 1 && data[0] == '-') {
+    return -1;
+  }
+  if (length >= (int)sizeof(number)) {
+    length = sizeof(number) - 1;
+  }
+  memcpy(number, data, length);
+  number[length] = '\0';
+  return atoi(number);
+}
+
+// Splits the genres field on commas, skipping empty ones like strtok
+// does, and drops the newline. A "-" genre ends the list, as it does in
+// a Movie.
+static void SplitGenres(const char *data, int length, RowView *view) {
+  int pos = 0;
+  view->num_genres = 0;
+  while (view->num_genres < NUM_GENRES) {
+    while (pos < length && data[pos] == ',') {
+      pos++;
+    }
+    if (pos == length) {
+      break;
+    }
+    int end = pos;
+    while (end < length && data[end] != ',') {
+      end++;
+    }
+    const char *newline = (const char*)memchr(data + pos, '\n', end - pos);
+    int genre_length = newline != NULL ? newline - (data + pos) : end - pos;
+    FieldView genre = FieldOrEmpty(data + pos, genre_length);
+    if (genre.data == NULL) {
+      break;
+    }
+    view->genres[view->num_genres++] = genre;
+    pos = end;
+  }
+}
+
+int SplitRow(FieldView row, RowView *view) {
+  const char *fields[ROW_FIELDS];
+  int lengths[ROW_FIELDS];
+  // A row read with fgets ends at a NUL, if it has one.
+  const char *nul = (const char*)memchr(row.data, '\0', row.length);
+  int length = nul != NULL ? nul - row.data : row.length;
+  int num_fields = 0;
+  int field_start = 0;
+
+  // Like strtok, runs of '|' are one separator: a field is whatever is
+  // between two pipes, if anything is.
+  for (int window = 0; window < length && num_fields < ROW_FIELDS;
+       window += WINDOW_SIZE) {
+    uint64_t pipes;
+    uint64_t newlines;
+    FindDelimitersIn(row.data + window, length - window, &pipes, &newlines);
+    while (pipes != 0 && num_fields < ROW_FIELDS) {
+      int pipe = window + __builtin_ctzll(pipes);
+      pipes &= pipes - 1;
+      if (pipe > field_start) {
+        fields[num_fields] = row.data + field_start;
+        lengths[num_fields] = pipe - field_start;
+        num_fields++;
+      }
+      field_start = pipe + 1;
+    }
+  }
+  if (num_fields < ROW_FIELDS && length > field_start) {
+    fields[num_fields] = row.data + field_start;
+    lengths[num_fields] = length - field_start;
+    num_fields++;
+  }
+  if (num_fields < ROW_FIELDS) {
+    return -1;
+  }
+
+  view->id = FieldOrEmpty(fields[0], lengths[0]);
+  view->type = FieldOrEmpty(fields[1], lengths[1]);
+  view->title = FieldOrEmpty(fields[2], lengths[2]);
+  view->isAdult = FieldToInt(fields[4], lengths[4]);
+  view->year = FieldToInt(fields[5], lengths[5]);
+  view->runtime = FieldToInt(fields[7], lengths[7]);
+  view->num_genres = 0;
+  if (FieldOrEmpty(fields[8], lengths[8]).data != NULL) {
+    SplitGenres(fields[8], lengths[8], view);
+  }
+  return 0;
+}
+
+static FieldView ViewOfString(const char *str) {
+  FieldView field = { str, str != NULL ? (int)strlen(str) : 0 };
+  return field;
+}
+
+void RowViewOfMovie(Movie *movie, RowView *view) {
+  view->id = ViewOfString(movie->id);
+  view->type = ViewOfString(movie->type);
+  view->title = ViewOfString(movie->title);
+  view->isAdult = movie->isAdult;
+  view->year = movie->year;
+  view->runtime = movie->runtime;
+  view->num_genres = 0;
+  while (view->num_genres < NUM_GENRES &&
+         movie->genres[view->num_genres] != NULL) {
+    view->genres[view->num_genres] =
+      ViewOfString(movie->genres[view->num_genres]);
+    view->num_genres++;
+  }
+}
+
+// Returns a malloc'd copy of the field, or NULL if it is empty.
+static char *CopyField(FieldView field, int *failed) {
+  if (field.data == NULL) {
+    return NULL;
+  }
+  char *copy = strndup(field.data, field.length);
+  if (copy == NULL) {
+    *failed = 1;
+  }
+  return copy;
+}
+
+Movie *CreateMovieFromView(RowView *view) {
+  Movie *movie = CreateMovie();
+  int failed = 0;
+  if (movie == NULL) {
+    return NULL;
+  }
+  movie->id = CopyField(view->id, &failed);
+  movie->type = CopyField(view->type, &failed);
+  movie->title = CopyField(view->title, &failed);
+  movie->isAdult = view->isAdult;
+  movie->year = view->year;
+  movie->runtime = view->runtime;
+  for (int i = 0; i < view->num_genres && !failed; i++) {
+    movie->genres[i] = CopyField(view->genres[i], &failed);
+  }
+  if (failed) {
+    printf("Couldn't malloc for a Movie\n");
+    DestroyMovie(movie);
+    return NULL;
+  }
+  return movie;
+}
+
+int MapRowFile(const char *file, const char **data, size_t *size) {
+  struct stat info;
+  int fd = open(file, O_RDONLY);
+  if (fd == -1) {
+    return -1;
+  }
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    return -1;
+  }
+  *size = info.st_size;
+  *data = NULL;
+  if (*size > 0) {
+    void *mapped = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      close(fd);
+      return -1;
+    }
+    // Rows are read front to back.
+    madvise(mapped, *size, MADV_SEQUENTIAL);
+    *data = (const char*)mapped;
+  }
+  close(fd);
+  return 0;
+}
+
+void UnmapRowFile(const char *data, size_t size) {
+  if (data != NULL) {
+    munmap((void*)data, size);
+  }
+}
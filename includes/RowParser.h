@@ -0,0 +1,123 @@
+#ifndef ROWPARSER_H
+#define ROWPARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Movie.h"
+
+// The longest row. Longer lines are split into rows this long, the way
+// fgets with a 1000 byte buffer splits them, so row ids agree with
+// ParseTheFiles.
+#define MAX_ROW_LENGTH 999
+
+/**
+ * Some bytes of a row, in place wherever the row is: not NUL terminated,
+ * and only good as long as the row's buffer or mapping is. data is NULL
+ * for a field that is empty ("-").
+ */
+typedef struct fieldView {
+  const char *data;
+  int length;
+} FieldView;
+
+/**
+ * The fields of a row, like a Movie but pointing into the row instead
+ * of holding copies of it, so splitting a row doesn't malloc. isAdult,
+ * year and runtime are -1 if the row doesn't have them.
+ */
+typedef struct rowView {
+  FieldView id;
+  FieldView type;
+  FieldView title;
+  int isAdult;
+  int year;
+  int runtime;
+  int num_genres;
+  FieldView genres[NUM_GENRES];
+} RowView;
+
+/**
+ * Walks the rows of a buffer, such as a file mapped with MapRowFile,
+ * without copying them.
+ */
+typedef struct rowScanner {
+  const char *data;
+  size_t size;
+  size_t pos;  // Where the next row starts.
+  int at_eof;  // 1 if data ends where the file does.
+  size_t window;  // Where the 64 bytes newlines is for start.
+  uint64_t newlines;  // From FindDelimiters, for the bytes at window.
+} RowScanner;
+
+void InitRowScanner(RowScanner *scanner, const char *data, size_t size,
+                    int at_eof);
+
+/**
+ * Gets the next row, with its newline if it has one. A row that runs
+ * off the end of the data is only a row if at_eof is set; otherwise it
+ * is left for the caller, starting at scanner->pos.
+ *
+ * RETURNS: 0 if there was a row, -1 if there are no more.
+ */
+int ScanNextRow(RowScanner *scanner, FieldView *row);
+
+/**
+ * Splits a row into its fields the way CreateMovieFromRow does, but
+ * with each field a view into the row.
+ *
+ * RETURNS: 0 if successful, -1 if the row doesn't have enough fields to
+ *   be a movie.
+ */
+int SplitRow(FieldView row, RowView *view);
+
+/**
+ * Fills view with the fields of movie, so a Movie can go wherever a
+ * RowView can. The views point into movie.
+ */
+void RowViewOfMovie(Movie *movie, RowView *view);
+
+/**
+ * Allocates a Movie with copies of the fields of view, for callers that
+ * need the row after its buffer is gone.
+ *
+ * RETURNS: the Movie, or NULL if out of memory.
+ */
+Movie *CreateMovieFromView(RowView *view);
+
+/**
+ * Finds the delimiters in the 64 bytes at data, all of which must be
+ * readable: bit i of *pipes is set if byte i is a '|', and bit i of
+ * *newlines if it is a '\n'. ScanNextRow and SplitRow find rows and
+ * fields from these masks, 64 bytes at a time, instead of looking at
+ * each byte.
+ *
+ * Uses AVX2 or SSE2 if the CPU has them, picked when the program
+ * starts, or a byte at a time if not.
+ */
+void FindDelimiters(const char *data, uint64_t *pipes, uint64_t *newlines);
+
+/**
+ * Makes FindDelimiters use the "avx2", "sse2" or "scalar" version, for
+ * benchmarks and tests. Not safe while other threads are parsing.
+ *
+ * RETURNS: 0 if successful, -1 if this CPU or build doesn't have it.
+ */
+int UseDelimiterScanner(const char *name);
+
+/**
+ * RETURNS: the name of the version FindDelimiters uses.
+ */
+const char *DelimiterScannerName();
+
+/**
+ * Maps a whole file into memory, read only.
+ *
+ * RETURNS: 0 if successful, with the file in *data and its size in
+ *   *size; *data is NULL for an empty file. -1 if it can't be mapped.
+ */
+int MapRowFile(const char *file, const char **data, size_t *size);
+
+void UnmapRowFile(const char *data, size_t size);
+
+#endif
@@ -9,18 +9,83 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <inttypes.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "Hashtable.h"
 #include "Hashtable_priv.h"
-#include "LinkedList.h"
 #include "Assert007.h"
 
-// a free function that does nothing
-static void NullFree(void *freeme) { }
+// Spreads the bits of a key around, so keys that are alike (doc ids
+// 1, 2, 3, ...) still land in different groups and get different
+// control bytes.
+static uint64_t MixKey(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
+// The control byte of a full slot holding a key with this mixed hash.
+static uint8_t KeyTag(uint64_t hash) {
+  return hash & 0x7F;
+}
 
-static void FreeKVP(void *freeme) {
-  free(freeme);
+// The group a key with this mixed hash is looked for in first.
+static int HomeGroup(Hashtable ht, uint64_t hash) {
+  return (hash >> 7) & (ht->num_buckets / HT_GROUP_SIZE - 1);
+}
+
+// Returns a mask with bit i set if byte i of the group is tag.
+static uint32_t MatchTag(const uint8_t *group, uint8_t tag) {
+#ifdef __SSE2__
+  __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)tag)));
+#else
+  uint32_t mask = 0;
+  for (int i = 0; i < HT_GROUP_SIZE; i++) {
+    mask |= (uint32_t)(group[i] == tag) << i;
+  }
+  return mask;
+#endif
+}
+
+// Returns a mask with bit i set if slot i of the group is empty or
+// deleted; full slots are the only ones without the high bit set.
+static uint32_t MatchFree(const uint8_t *group) {
+#ifdef __SSE2__
+  return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+#else
+  uint32_t mask = 0;
+  for (int i = 0; i < HT_GROUP_SIZE; i++) {
+    mask |= (uint32_t)(group[i] >> 7) << i;
+  }
+  return mask;
+#endif
+}
+
+// Makes the control bytes and slots for num_buckets slots, all empty.
+// Returns 0 if successful, -1 if out of memory.
+static int AllocSlots(Hashtable ht, int num_buckets) {
+  uint8_t *ctrl = (uint8_t*)malloc(num_buckets);
+  HTKeyValue *slots = (HTKeyValue*)malloc(num_buckets * sizeof(HTKeyValue));
+  if (ctrl == NULL || slots == NULL) {
+    free(ctrl);
+    free(slots);
+    return -1;
+  }
+  memset(ctrl, HT_EMPTY, num_buckets);
+  ht->ctrl = ctrl;
+  ht->slots = slots;
+  ht->num_buckets = num_buckets;
+  ht->num_elements = 0;
+  ht->num_deleted = 0;
+  return 0;
 }
 
 Hashtable CreateHashtable(int num_buckets) {
@@ -32,175 +97,141 @@ Hashtable CreateHashtable(int num_buckets) {
     return NULL;
   }
 
-  ht->num_buckets = num_buckets;
-  ht->num_elements = 0;
-  ht->buckets =
-      (LinkedList*)malloc(num_buckets * sizeof(LinkedList));
-
-  if (ht->buckets == NULL) {
+  int slots = HT_GROUP_SIZE;
+  while (slots < num_buckets) {
+    slots *= 2;
+  }
+  if (AllocSlots(ht, slots) != 0) {
     free(ht);
     return NULL;
   }
-
-  for (int i=  0; i < num_buckets; i++) {
-    ht->buckets[i] = CreateLinkedList();
-    if (ht->buckets[i] == NULL) {
-      // Need to free everything and then return NULL
-      for (int j = 0; j < i; j++) {
-        DestroyLinkedList(ht->buckets[j], NULL);
-      }
-      free(ht);
-      return NULL;
-    }
-  }
   return ht;
 }
 
 
 void DestroyHashtable(Hashtable ht, ValueFreeFnPtr valueFreeFunction) {
-  // Go through each bucket, freeing each bucket
   for (int i = 0; i < ht->num_buckets; i++) {
-    LinkedList bucketlist = ht->buckets[i];
-    HTKeyValuePtr nextKV;
-
-    // Free the values in the list; then free the list
-    if (NumElementsInLinkedList(bucketlist) > 0) {
-      LLIter list_iter = CreateLLIter(bucketlist);
-
-      LLIterGetPayload(list_iter, (void**)&nextKV);
-      valueFreeFunction(nextKV->value);
+    if (ht->ctrl[i] < HT_EMPTY) {
+      valueFreeFunction(ht->slots[i].value);
+    }
+  }
+  free(ht->ctrl);
+  free(ht->slots);
+  free(ht);
+}
 
-      // Now loop through the rest
-      while (LLIterHasNext(list_iter) == 1) {
-        LLIterNext(list_iter);
-        LLIterGetPayload(list_iter, (void**)&nextKV);
-        valueFreeFunction(nextKV->value);
+// Groups are probed at home, home + 1, home + 3, home + 6, ..., which
+// visits every group once when there is a power of 2 of them.
+// Returns the slot holding key, or -1 if it isn't in the table.
+static int FindSlot(Hashtable ht, uint64_t key, uint64_t hash) {
+  int group_mask = ht->num_buckets / HT_GROUP_SIZE - 1;
+  int group = HomeGroup(ht, hash);
+  uint8_t tag = KeyTag(hash);
+
+  for (int step = 1; step <= group_mask + 1; step++) {
+    const uint8_t *ctrl = ht->ctrl + group * HT_GROUP_SIZE;
+    for (uint32_t match = MatchTag(ctrl, tag); match != 0;
+         match &= match - 1) {
+      int slot = group * HT_GROUP_SIZE + __builtin_ctz(match);
+      if (ht->slots[slot].key == key) {
+        return slot;
       }
-      DestroyLLIter(list_iter);
     }
-    DestroyLinkedList(bucketlist, FreeKVP);
+    if (MatchTag(ctrl, HT_EMPTY) != 0) {
+      return -1;
+    }
+    group = (group + step) & group_mask;
   }
+  return -1;
+}
 
-  // free the bucket array within the table record,
-  // then free the table record itself.
-  free(ht->buckets);
-  free(ht);
+// Returns the first empty or deleted slot along the probe sequence of a
+// key with this mixed hash, or -1 if the table is full.
+static int FindFreeSlot(Hashtable ht, uint64_t hash) {
+  int group_mask = ht->num_buckets / HT_GROUP_SIZE - 1;
+  int group = HomeGroup(ht, hash);
+
+  for (int step = 1; step <= group_mask + 1; step++) {
+    uint32_t match = MatchFree(ht->ctrl + group * HT_GROUP_SIZE);
+    if (match != 0) {
+      return group * HT_GROUP_SIZE + __builtin_ctz(match);
+    }
+    group = (group + step) & group_mask;
+  }
+  return -1;
 }
 
-// Removes key value node given a specific key and copies old key
-// value pair into the dereferenced pointer.
-// Returns 0 if the key was not found.
-// Returns 1 if the key provdied a valid key value pair that was then deleted.
-int removeOldKeyValue(Hashtable ht,
-                      LinkedList bucketList,
-                      uint64_t key,
-                      HTKeyValue *old_key_value) {
-  int key_found = 0;
-  if (NumElementsInLinkedList(bucketList) > 0) {
-    LLIter chain_iterator = CreateLLIter(bucketList);
-    HTKeyValue *cur_node_payload;
-    int last_node;
-    do {
-      LLIterGetPayload(chain_iterator, (void**)&cur_node_payload);
-      if (cur_node_payload->key == key) {
-        old_key_value->key = key;
-        old_key_value->value = cur_node_payload->value;
-        LLIterDelete(chain_iterator, FreeKVP);
-        ht->num_elements--;
-        DestroyLLIter(chain_iterator);
-        return 1;
-      }
-      last_node = LLIterNext(chain_iterator);
-    } while (!last_node);
-    DestroyLLIter(chain_iterator);
+// Puts a pair that isn't in the table yet into a free slot.
+// Returns 0 if successful, 1 if the table is full.
+static int InsertNewKey(Hashtable ht, HTKeyValue kvp) {
+  uint64_t hash = MixKey(kvp.key);
+  int slot = FindFreeSlot(ht, hash);
+  if (slot < 0) {
+    return 1;
   }
-  return key_found;
+  if (ht->ctrl[slot] == HT_DELETED) {
+    ht->num_deleted--;
+  }
+  ht->ctrl[slot] = KeyTag(hash);
+  ht->slots[slot] = kvp;
+  ht->num_elements++;
+  return 0;
 }
 
 int PutInHashtable(Hashtable ht,
                    HTKeyValue kvp,
                    HTKeyValue *old_key_value) {
   Assert007(ht != NULL);
-  int insert_bucket;
-  LinkedList insert_chain;
-
-  ResizeHashtable(ht);
 
-  // calculate which bucket we're inserting into,
-  // get the list
-  insert_bucket = HashKeyToBucketNum(ht, kvp.key);
-  insert_chain = ht->buckets[insert_bucket];
-
-  // STEP 1: Finish the implementation of the put.
-  // This is a fairly complex task, so you might decide you want
-  // to define/implement a helper function hat helps you find
-  // and optionally remove a key within a chain, rather than putting
-  // all that logic inside here. You might also find that your helper(s)
-  // can be reused in step 2 and 3.
-  int collision = removeOldKeyValue(ht, insert_chain, kvp.key, old_key_value);
-  HTKeyValue *kvp_heap_item = (HTKeyValue*)malloc(sizeof(HTKeyValue));
-  kvp_heap_item->key = kvp.key;
-  kvp_heap_item->value = kvp.value;
-  if (kvp_heap_item == NULL) {
-    // Out of memory
-    return 1;
-  }
-  InsertLinkedList(insert_chain, kvp_heap_item);
-  ht->num_elements++;
-  if (collision) {
+  int slot = FindSlot(ht, kvp.key, MixKey(kvp.key));
+  if (slot >= 0) {
+    *old_key_value = ht->slots[slot];
+    ht->slots[slot].value = kvp.value;
     return 2;
   }
-  return 0;
+
+  ResizeHashtable(ht);
+  return InsertNewKey(ht, kvp);
 }
 
 int HashKeyToBucketNum(Hashtable ht, uint64_t key) {
-  return key % ht->num_buckets;
+  return HomeGroup(ht, MixKey(key));
 }
 
 // -1 if not found; 0 if success
 int LookupInHashtable(Hashtable ht, uint64_t key, HTKeyValue *result) {
   Assert007(ht != NULL);
-  // STEP 2: Implement lookup
-  int bucket_number = HashKeyToBucketNum(ht, key);
-  LinkedList target_chain = ht->buckets[bucket_number];
-  if (NumElementsInLinkedList(target_chain) < 1) {
+  int slot = FindSlot(ht, key, MixKey(key));
+  if (slot < 0) {
     return -1;
-  } else {
-    LLIter chain_iterator = CreateLLIter(target_chain);
-    HTKeyValue *cur_node_payload;
-    int last_node;
-    do {
-      LLIterGetPayload(chain_iterator, (void**)&cur_node_payload);
-      if (cur_node_payload->key == key) {
-        result->key = cur_node_payload->key;
-        result->value = cur_node_payload->value;
-        DestroyLLIter(chain_iterator);
-        return 0;
-      }
-      last_node = LLIterNext(chain_iterator);
-    } while (!last_node);
-    DestroyLLIter(chain_iterator);
   }
-  return -1;
+  *result = ht->slots[slot];
+  return 0;
 }
 
 
 int NumElemsInHashtable(Hashtable ht) {
-  int res = 0;
-  for (int i = 0; i < ht->num_buckets; i++) {
-    res += NumElementsInLinkedList(ht->buckets[i]);
-  }
-  return res;
+  return ht->num_elements;
 }
 
 
 int RemoveFromHashtable(Hashtable ht, uint64_t key, HTKeyValuePtr junkKVP) {
-  int bucket_number = HashKeyToBucketNum(ht, key);
-  LinkedList target_chain = ht->buckets[bucket_number];
-  int success = removeOldKeyValue(ht, target_chain, key, junkKVP);
-  if (!success) {
+  int slot = FindSlot(ht, key, MixKey(key));
+  if (slot < 0) {
     return -1;
   }
+  *junkKVP = ht->slots[slot];
+  // A search that reaches this group stops here if it has an empty
+  // slot, so the slot can go back to empty; otherwise searches have to
+  // go on past it.
+  const uint8_t *group = ht->ctrl + slot / HT_GROUP_SIZE * HT_GROUP_SIZE;
+  if (MatchTag(group, HT_EMPTY) != 0) {
+    ht->ctrl[slot] = HT_EMPTY;
+  } else {
+    ht->ctrl[slot] = HT_DELETED;
+    ht->num_deleted++;
+  }
+  ht->num_elements--;
   return 0;
 }
 
@@ -243,65 +274,28 @@ uint64_t FNVHashInt64(uint64_t makehash) {
 void ResizeHashtable(Hashtable ht) {
   Assert007(ht != NULL);
 
-  // Resize if the load factor is > 3.
-  if (ht->num_elements < 3 * ht->num_buckets)
-    return;
-
-  // This is the resize case.  Allocate a new hashtable,
-  // iterate over the old hashtable, do the surgery on
-  // the old hashtable record and free up the new hashtable
-  // record.
-  Hashtable newht = CreateHashtable(ht->num_buckets * 9);
-  // Give up if out of memory.
-  if (newht == NULL)
+  // Resize once 7/8 of the slots are full or deleted.
+  if ((ht->num_elements + ht->num_deleted + 1) * 8 <= ht->num_buckets * 7)
     return;
 
-  // Loop through the old ht with an iterator,
-  // inserting into the new HT.
-  HTIter it = CreateHashtableIterator(ht);
-  if (it == NULL) {
-    // Give up if out of memory.
-    DestroyHashtable(newht, &NullFree);
-    return;
+  // Double if it is mostly full; if it is mostly deleted slots, the same
+  // size is enough to clear them out.
+  int num_buckets = ht->num_buckets;
+  if ((ht->num_elements + 1) * 2 > num_buckets) {
+    num_buckets *= 2;
   }
-
-  HTKeyValue item;
-  HTIteratorGet(it, &item);
-  HTKeyValue old_kv;
-
-  if (PutInHashtable(newht, item, &old_kv) == 1) {
-    // failure, free up everything, return.
-    DestroyHashtableIterator(it);
-    DestroyHashtable(newht, &NullFree);
+  struct hashtableInfo old = *ht;
+  // Give up if out of memory; puts still work until the table is full.
+  if (AllocSlots(ht, num_buckets) != 0)
     return;
-  }
-
-  while (HTIteratorHasMore(it) != 0) {
-    HTIteratorNext(it);
 
-    HTKeyValue item;
-    HTIteratorGet(it, &item);
-    HTKeyValue old_kv;
-
-    if (PutInHashtable(newht, item, &old_kv) == 1) {
-      // failure, free up everything, return.
-      DestroyHashtableIterator(it);
-      DestroyHashtable(newht, &NullFree);
-      return;
+  for (int i = 0; i < old.num_buckets; i++) {
+    if (old.ctrl[i] < HT_EMPTY) {
+      InsertNewKey(ht, old.slots[i]);
     }
   }
-  // Worked!  Free the iterator.
-  DestroyHashtableIterator(it);
-  // Sneaky: swap the structures, then free the new table,
-  // and we're done.
-  {
-    struct hashtableInfo tmp;
-    tmp = *ht;
-    *ht = *newht;
-    *newht = tmp;
-    DestroyHashtable(newht, &NullFree);
-  }
-  return;
+  free(old.ctrl);
+  free(old.slots);
 }
 
 
@@ -309,6 +303,14 @@ void ResizeHashtable(Hashtable ht) {
 // Hashtable Iterator
 // ==========================
 
+// Returns the first full slot at or after slot, or num_buckets.
+static int NextFullSlot(Hashtable ht, int slot) {
+  while (slot < ht->num_buckets && ht->ctrl[slot] >= HT_EMPTY) {
+    slot++;
+  }
+  return slot;
+}
+
 // Returns NULL on failure, non-NULL on success.
 HTIter CreateHashtableIterator(Hashtable table) {
   if (NumElemsInHashtable(table) == 0) {
@@ -319,35 +321,27 @@ HTIter CreateHashtableIterator(Hashtable table) {
     return NULL;  // Couldn't malloc
   }
   iter->ht = table;
-  iter->which_bucket = 0;
-  iter->bucket_iter = CreateLLIter(iter->ht->buckets[iter->which_bucket]);
-
+  iter->slot = NextFullSlot(table, 0);
+  iter->next_slot = NextFullSlot(table, iter->slot + 1);
   return iter;
 }
 
 
 void DestroyHashtableIterator(HTIter iter) {
-  // Destroy the list iter
-  free(iter->bucket_iter);
   iter->ht = NULL;
   free(iter);
 }
 
-// Moves to the next element; does not return.
+// Moves to the next element.
+// Returns 0 if it moved, -1 if there isn't one; the iterator stays on
+// the last element then.
 int HTIteratorNext(HTIter iter) {
-  if (LLIterHasNext(iter->bucket_iter)) {
-    LLIterNext(iter->bucket_iter);
-    return 0;
-  } else if (HTIteratorHasMore(iter)) {
-    do {
-      DestroyLLIter(iter->bucket_iter);
-      iter->which_bucket++;
-      iter->bucket_iter = CreateLLIter(iter->ht->buckets[iter->which_bucket]);
-    } while (NumElementsInLinkedList(iter->ht->buckets[iter->which_bucket])
-             == 0);
-    return 0;
+  if (iter->next_slot >= iter->ht->num_buckets) {
+    return -1;
   }
-  return -1;
+  iter->slot = iter->next_slot;
+  iter->next_slot = NextFullSlot(iter->ht, iter->slot + 1);
+  return 0;
 }
 
 int HTIteratorGet(HTIter iter, HTKeyValuePtr dest) {
@@ -355,32 +349,11 @@ int HTIteratorGet(HTIter iter, HTKeyValuePtr dest) {
   if (iter == NULL) {
     return -1;
   }
-  HTKeyValue *target_KVP;
-  LLIterGetPayload(iter->bucket_iter, (void**)&target_KVP);
-  dest->key = target_KVP->key;
-  dest->value = target_KVP->value;
+  *dest = iter->ht->slots[iter->slot];
   return 0;
 }
 
 //  0 if there are no more elements.
 int HTIteratorHasMore(HTIter iter) {
-  if (iter->bucket_iter == NULL) {
-    return 0;
-  }
-
-  if (LLIterHasNext(iter->bucket_iter) == 1)
-    return 1;
-
-  // No more in this iter; are there more buckets?
-  int i = iter->which_bucket + 1;
-  while (i < (iter->ht->num_buckets)) {
-    // Make sure one of them has elements in it
-    if ((iter->ht->buckets[i] != NULL) &&
-        (NumElementsInLinkedList(iter->ht->buckets[i]) > 0)) {
-      return 1;
-    }
-    i++;
-  }
-  return 0;
+  return iter->next_slot < iter->ht->num_buckets;
 }
-
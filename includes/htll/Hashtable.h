@@ -12,14 +12,6 @@
 
 //typedef LinkedList *LinkedList_ht;
 
-struct hashtableInfo {
-	int num_buckets;
-	int num_elements;
-	LinkedList* buckets;
-};
-
-typedef struct hashtableInfo* Hashtable;
-
 struct hashtableIter {
 	int placeholder;
 };
@@ -38,6 +30,27 @@ typedef struct {
   void      *value;  // the value in the key/value pair
 } HTKeyValue, *HTKeyValuePtr;
 
+// A Hashtable keeps its key/value pairs in one array of slots, with no
+// node per pair. Each slot has a control byte: HT_EMPTY, HT_DELETED, or
+// the low 7 bits of the slot's mixed key if it is full. Slots are looked
+// at in groups of HT_GROUP_SIZE, starting with the group the key hashes
+// to; the group's control bytes are compared with the key's 7 bits all
+// at once (with SSE2 where there is one), and only the slots that match
+// have their keys checked. A group with an empty slot ends the search.
+#define HT_GROUP_SIZE 16
+#define HT_EMPTY 0x80
+#define HT_DELETED 0xFE
+
+struct hashtableInfo {
+	int num_buckets;   // How many slots; a power of 2, at least HT_GROUP_SIZE.
+	int num_elements;
+	int num_deleted;   // Slots that are HT_DELETED.
+	uint8_t *ctrl;     // num_buckets control bytes.
+	HTKeyValue *slots;
+};
+
+typedef struct hashtableInfo* Hashtable;
+
 // When freeing a HashTable, customers need to pass a pointer to a function
 // that frees the payload.  The pointed-to function is invoked once for each
 // value in the HashTable.
@@ -49,7 +62,8 @@ typedef void(*ValueFreeFnPtr)(void *value);
 // Allocates and returns a new Hashtable.
 //
 // INPUT:
-//   numBuckets: The number of buckets this hashtable will start with.
+//   numBuckets: How many pairs this hashtable has room for to start
+//     with. It grows as it fills up.
 //
 // Returns NULL if the hashtable was unable to be malloc'd, or
 // the hashtable.
@@ -10,9 +10,9 @@
 
 // This is the struct we use to represent an iterator.
 typedef struct ht_itrec {
-  Hashtable  ht;          // the HT we're pointing into
-  int   which_bucket;  // which bucket are we in?
-  LLIter bucket_iter;   // iterator for the bucket, or NULL
+  Hashtable  ht;    // the HT we're pointing into
+  int   slot;       // the full slot we're on
+  int   next_slot;  // the next full slot, or num_buckets if there isn't one
 } HTIterRecord;
 
 
@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "RingQueue.h"
+#include "Assert007.h"
+
+RingQueue CreateRingQueue(int capacity, int num_producers) {
+  Assert007(capacity > 0);
+  RingQueue queue = (RingQueue)malloc(sizeof(struct ringQueueInfo));
+  if (queue == NULL) {
+    return NULL;
+  }
+  queue->items = (void**)malloc(capacity * sizeof(void*));
+  if (queue->items == NULL) {
+    free(queue);
+    return NULL;
+  }
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->not_empty, NULL);
+  pthread_cond_init(&queue->not_full, NULL);
+  queue->capacity = capacity;
+  queue->head = 0;
+  queue->count = 0;
+  queue->producers = num_producers;
+  queue->pushes = 0;
+  queue->full_waits = 0;
+  queue->empty_waits = 0;
+  return queue;
+}
+
+void DestroyRingQueue(RingQueue queue) {
+  pthread_mutex_destroy(&queue->lock);
+  pthread_cond_destroy(&queue->not_empty);
+  pthread_cond_destroy(&queue->not_full);
+  free(queue->items);
+  free(queue);
+}
+
+void PushRingQueue(RingQueue queue, void *item) {
+  pthread_mutex_lock(&queue->lock);
+  if (queue->count == queue->capacity) {
+    queue->full_waits++;
+    do {
+      pthread_cond_wait(&queue->not_full, &queue->lock);
+    } while (queue->count == queue->capacity);
+  }
+  queue->items[(queue->head + queue->count) % queue->capacity] = item;
+  queue->count++;
+  queue->pushes++;
+  pthread_cond_signal(&queue->not_empty);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+int PopRingQueue(RingQueue queue, void **item) {
+  pthread_mutex_lock(&queue->lock);
+  if (queue->count == 0 && queue->producers > 0) {
+    queue->empty_waits++;
+    do {
+      pthread_cond_wait(&queue->not_empty, &queue->lock);
+    } while (queue->count == 0 && queue->producers > 0);
+  }
+  if (queue->count == 0) {
+    pthread_mutex_unlock(&queue->lock);
+    return -1;
+  }
+  *item = queue->items[queue->head];
+  queue->head = (queue->head + 1) % queue->capacity;
+  queue->count--;
+  pthread_cond_signal(&queue->not_full);
+  pthread_mutex_unlock(&queue->lock);
+  return 0;
+}
+
+void RingQueueProducerDone(RingQueue queue) {
+  pthread_mutex_lock(&queue->lock);
+  queue->producers--;
+  if (queue->producers <= 0) {
+    pthread_cond_broadcast(&queue->not_empty);
+  }
+  pthread_mutex_unlock(&queue->lock);
+}
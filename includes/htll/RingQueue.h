@@ -0,0 +1,60 @@
+// A bounded queue that threads can push to and pop from at once.
+#include <pthread.h>
+
+#ifndef RINGQUEUE_H
+#define RINGQUEUE_H
+
+// The items are kept in a fixed array used as a ring, so pushing and
+// popping never allocate. A push waits while the queue is full and a
+// pop waits while it is empty, so a fast stage can't run ahead of a
+// slow one by more than the capacity. Any number of threads may push
+// and pop.
+//
+// The queue counts how often each side had to wait: a stage whose
+// producers keep finding the queue full is slower than the stage after
+// it, and one whose consumers keep finding it empty is faster.
+struct ringQueueInfo {
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  void **items;
+  int capacity;
+  int head;  // Where the next pop comes from.
+  int count;
+  int producers;  // How many producers haven't called RingQueueProducerDone.
+  long pushes;
+  long full_waits;  // Pushes that had to wait for room.
+  long empty_waits;  // Pops that had to wait for an item.
+};
+
+typedef struct ringQueueInfo* RingQueue;
+
+// Allocates and returns a new RingQueue.
+//
+// INPUT:
+//   capacity: How many items it holds before pushes wait.
+//   num_producers: How many threads will push to it; once they have all
+//     called RingQueueProducerDone, pops stop waiting.
+//
+// Returns NULL if it couldn't be malloc'd, or the queue.
+RingQueue CreateRingQueue(int capacity, int num_producers);
+
+// Destroys and frees the queue. No thread may be using it, and anything
+// still in it is not freed.
+void DestroyRingQueue(RingQueue queue);
+
+// Adds item to the back of the queue, waiting for room if it is full.
+void PushRingQueue(RingQueue queue, void *item);
+
+// Takes the item at the front of the queue, waiting for one if it is
+// empty.
+//
+// Returns 0 if successful, -1 if the queue is empty and every producer
+// is done, so nothing more will come.
+int PopRingQueue(RingQueue queue, void **item);
+
+// Tells the queue a producer won't push any more. Once every producer
+// has, threads waiting in PopRingQueue get -1 instead of an item.
+void RingQueueProducerDone(RingQueue queue);
+
+#endif  // RINGQUEUE_H